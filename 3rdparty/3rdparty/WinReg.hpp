@@ -68,7 +68,9 @@
 #include <Windows.h>        // Windows Platform SDK
 #include <crtdbg.h>         // _ASSERTE
 
+#include <cstring>          // memcpy
 #include <memory>           // std::unique_ptr, std::make_unique
+#include <optional>         // std::optional
 #include <string>           // std::wstring
 #include <system_error>     // std::system_error
 #include <utility>          // std::swap, std::pair, std::move
@@ -85,6 +87,7 @@ namespace winreg
 
 class RegException;
 class RegResult;
+class RegValueBatch;
 
 template <typename T>
 class RegExpected;
@@ -430,6 +433,12 @@ public:
     // the DWORD is the value type.
     [[nodiscard]] RegExpected<std::vector<std::pair<std::wstring, DWORD>>> TryEnumValues() const;
 
+    // Read all the values named in the batch at once.
+    // When every value exists this is a single RegQueryMultipleValues call;
+    // otherwise each value is queried into the batch's shared buffer.
+    // Values that don't exist are simply marked as not found.
+    [[nodiscard]] RegResult TryGetValues(RegValueBatch& batch) const;
+
 
     //
     // Misc Registry API Wrappers
@@ -494,6 +503,57 @@ private:
 };
 
 
+//------------------------------------------------------------------------------
+//
+// A set of value names read together by RegKey::TryGetValues.
+//
+// The value data of all the names lands in one buffer owned by the batch,
+// so reusing the same batch object across many keys avoids allocating
+// and re-sizing a buffer for every single value.
+//
+//------------------------------------------------------------------------------
+class RegValueBatch
+{
+public:
+
+    explicit RegValueBatch(std::vector<std::wstring> valueNames);
+
+    [[nodiscard]] size_t Size() const noexcept;
+    [[nodiscard]] const std::wstring& Name(size_t index) const noexcept;
+
+    // Did the last TryGetValues call find the value at the given index?
+    [[nodiscard]] bool Found(size_t index) const noexcept;
+
+    // REG_* type of the value at the given index (REG_NONE if not found)
+    [[nodiscard]] DWORD Type(size_t index) const noexcept;
+
+    // String content of a REG_SZ or REG_EXPAND_SZ value, without the terminating NUL(s)
+    [[nodiscard]] std::wstring GetString(size_t index) const;
+
+    // Content of a REG_DWORD value; empty if the value was not found, is of another type,
+    // or holds fewer than 4 data bytes (which RegSetValueEx happily accepts)
+    [[nodiscard]] std::optional<DWORD> GetDword(size_t index) const noexcept;
+
+private:
+    friend class RegKey;
+
+    struct Slot
+    {
+        bool  Found{ false };
+        DWORD Type{ REG_NONE };
+        DWORD Offset{ 0 };  // in bytes, into m_buffer
+        DWORD Size{ 0 };    // in bytes
+    };
+
+    void Reset() noexcept;
+
+    std::vector<std::wstring> m_names;
+    std::vector<VALENTW> m_entries;
+    std::vector<Slot> m_slots;
+    std::vector<BYTE> m_buffer;
+};
+
+
 //------------------------------------------------------------------------------
 // An exception representing an error with the registry operations
 //------------------------------------------------------------------------------
@@ -2311,6 +2371,113 @@ inline RegExpected<std::vector<std::pair<std::wstring, DWORD>>> RegKey::TryEnumV
 }
 
 
+inline RegResult RegKey::TryGetValues(RegValueBatch& batch) const
+{
+    _ASSERTE(IsValid());
+
+    batch.Reset();
+
+    const DWORD valueCount = static_cast<DWORD>(batch.m_names.size());
+    if (valueCount == 0)
+    {
+        return RegResult{ ERROR_SUCCESS };
+    }
+
+    // Fast path: every value in one round trip
+    LSTATUS retCode = ERROR_MORE_DATA;
+    while (retCode == ERROR_MORE_DATA)
+    {
+        for (DWORD i = 0; i < valueCount; i++)
+        {
+            batch.m_entries[i].ve_valuename = const_cast<LPWSTR>(batch.m_names[i].c_str());
+        }
+
+        DWORD totalSize = static_cast<DWORD>(batch.m_buffer.size());
+        retCode = ::RegQueryMultipleValuesW(
+            m_hKey,
+            batch.m_entries.data(),
+            valueCount,
+            batch.m_buffer.empty() ? nullptr : reinterpret_cast<LPWSTR>(batch.m_buffer.data()),
+            &totalSize
+        );
+
+        if (retCode == ERROR_MORE_DATA)
+        {
+            batch.m_buffer.resize(totalSize);
+        }
+    }
+
+    if (retCode == ERROR_SUCCESS)
+    {
+        const auto base = reinterpret_cast<DWORD_PTR>(batch.m_buffer.data());
+        for (DWORD i = 0; i < valueCount; i++)
+        {
+            auto& slot = batch.m_slots[i];
+            slot.Found = true;
+            slot.Type = batch.m_entries[i].ve_type;
+            slot.Offset = static_cast<DWORD>(batch.m_entries[i].ve_valueptr - base);
+            slot.Size = batch.m_entries[i].ve_valuelen;
+        }
+
+        return RegResult{ ERROR_SUCCESS };
+    }
+
+    // RegQueryMultipleValues fails as a whole if any value is missing,
+    // so fall back to querying the values one by one into the same buffer
+    if (retCode != ERROR_FILE_NOT_FOUND)
+    {
+        return RegResult{ retCode };
+    }
+
+    DWORD used = 0;
+    for (DWORD i = 0; i < valueCount; i++)
+    {
+        auto& slot = batch.m_slots[i];
+
+        for (;;)
+        {
+            // Keep every value aligned, so it can be read back in place
+            used = (used + 7) & ~DWORD{ 7 };
+
+            DWORD type = REG_NONE;
+            DWORD dataSize = static_cast<DWORD>(batch.m_buffer.size() > used ? batch.m_buffer.size() - used : 0);
+            retCode = ::RegQueryValueExW(
+                m_hKey,
+                batch.m_names[i].c_str(),
+                nullptr,    // reserved
+                &type,
+                dataSize ? batch.m_buffer.data() + used : nullptr,
+                &dataSize
+            );
+
+            const bool bufferTooSmall = (retCode == ERROR_SUCCESS) && (used + dataSize > batch.m_buffer.size());
+            if ((retCode == ERROR_MORE_DATA) || bufferTooSmall)
+            {
+                batch.m_buffer.resize(used + dataSize);
+                continue;
+            }
+
+            if (retCode == ERROR_SUCCESS)
+            {
+                slot.Found = true;
+                slot.Type = type;
+                slot.Offset = used;
+                slot.Size = dataSize;
+                used += dataSize;
+            }
+            else if (retCode != ERROR_FILE_NOT_FOUND)
+            {
+                return RegResult{ retCode };
+            }
+
+            break;
+        }
+    }
+
+    return RegResult{ ERROR_SUCCESS };
+}
+
+
 inline DWORD RegKey::QueryValueType(const std::wstring& valueName) const
 {
     _ASSERTE(IsValid());
@@ -2685,6 +2852,99 @@ inline std::wstring RegKey::RegTypeToString(const DWORD regType)
 }
 
 
+//------------------------------------------------------------------------------
+//                          RegValueBatch Inline Methods
+//------------------------------------------------------------------------------
+
+inline RegValueBatch::RegValueBatch(std::vector<std::wstring> valueNames)
+    : m_names{ std::move(valueNames) }
+    , m_entries(m_names.size())
+    , m_slots(m_names.size())
+{
+}
+
+
+inline size_t RegValueBatch::Size() const noexcept
+{
+    return m_names.size();
+}
+
+
+inline const std::wstring& RegValueBatch::Name(const size_t index) const noexcept
+{
+    _ASSERTE(index < m_names.size());
+    return m_names[index];
+}
+
+
+inline bool RegValueBatch::Found(const size_t index) const noexcept
+{
+    _ASSERTE(index < m_slots.size());
+    return m_slots[index].Found;
+}
+
+
+inline DWORD RegValueBatch::Type(const size_t index) const noexcept
+{
+    _ASSERTE(index < m_slots.size());
+    return m_slots[index].Type;
+}
+
+
+inline std::wstring RegValueBatch::GetString(const size_t index) const
+{
+    _ASSERTE(index < m_slots.size());
+
+    const auto& slot = m_slots[index];
+    _ASSERTE(slot.Found && ((slot.Type == REG_SZ) || (slot.Type == REG_EXPAND_SZ)));
+
+    // The data returned by RegQueryMultipleValues is not guaranteed to be wchar_t-aligned,
+    // so copy it out instead of reinterpreting the buffer
+    std::wstring result(slot.Size / sizeof(wchar_t), L'\0');
+    if (!result.empty())
+    {
+        memcpy(result.data(), m_buffer.data() + slot.Offset, result.size() * sizeof(wchar_t));
+    }
+
+    while (!result.empty() && (result.back() == L'\0'))
+    {
+        result.pop_back();
+    }
+
+    return result;
+}
+
+
+inline std::optional<DWORD> RegValueBatch::GetDword(const size_t index) const noexcept
+{
+    _ASSERTE(index < m_slots.size());
+
+    const auto& slot = m_slots[index];
+    if (!slot.Found || (slot.Type != REG_DWORD) || (slot.Size < sizeof(DWORD)))
+    {
+        return std::nullopt;
+    }
+
+    DWORD data = 0;
+    memcpy(&data, m_buffer.data() + slot.Offset, sizeof(data));
+    return data;
+}
+
+
+inline void RegValueBatch::Reset() noexcept
+{
+    for (auto& slot : m_slots)
+    {
+        slot = Slot{};
+    }
+
+    for (auto& entry : m_entries)
+    {
+        entry = VALENTW{};
+    }
+}
+
+
 //------------------------------------------------------------------------------
 //                          RegException Inline Methods
 //------------------------------------------------------------------------------
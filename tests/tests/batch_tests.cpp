@@ -0,0 +1,88 @@
+#include "counting_registry.h"
+#include "fixtures.h"
+#include "test.h"
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <tool/batch.h>
+#include <vector>
+
+using namespace vcwin;
+using namespace vcwin::tests;
+
+VCWIN_TEST(batch_lines_split_at_blanks_outside_quotes)
+{
+    auto args = detail::split_command_line("  uninstall\twdk \"10.0 22621\"  --show-string\r");
+    CHECK(args.size() == 4);
+    CHECK(args[0] == "uninstall" && args[1] == "wdk" && args[2] == "10.0 22621" && args[3] == "--show-string");
+
+    CHECK(detail::split_command_line("state \"\"").size() == 2);
+    CHECK(detail::split_command_line(" \t ").empty());
+}
+
+VCWIN_TEST(batch_probes_once_until_an_install_or_uninstall)
+{
+    auto hive = make_component_hive(10000, 2000);
+    CountingRegistry counting{*hive.registry};
+
+    size_t winsdkProbes = 0, dxsdkProbes = 0;
+    ModelCache models{[] { return VCTools{}; },
+                      [&] {
+                          winsdkProbes++;
+                          return WindowsSDK{counting};
+                      },
+                      [&] {
+                          dxsdkProbes++;
+                          return DirectXSdk{counting};
+                      }};
+
+    // What the commands of this batch need from the models, as vcwin's own commands would ask for it
+    std::istringstream input{"# one probe pass for the first three\n"
+                             "state\n"
+                             "\n"
+                             "winsdk\r\n"
+                             "query \">=10.0.22010 <10.0.22020\"\n"
+                             "install wdk 10.0.22621.0\n"
+                             "winsdk\n"
+                             "uninstall wdk 10.0.22621.0\n"
+                             "remove wdk 10.0.22621.0\n"
+                             "state\n"
+                             "unknown\n"};
+
+    std::vector<std::string> lines;
+    bool succeeded = run_batch(
+        input,
+        [&](const std::vector<std::string> &args, std::string_view line) {
+            lines.emplace_back(line);
+
+            auto &command = args.front();
+            if (command == "state")
+            {
+                models.GetVCTools();
+                models.GetWindowsSDK().ProbeAll();
+                models.GetDirectXSdk();
+            }
+            else if (command == "winsdk" || command == "query")
+            {
+                models.GetWindowsSDK().GetSDKs();
+            }
+            else if (!batch_command_changes_models(command))
+            {
+                return 1;
+            }
+
+            return 0;
+        },
+        [&] { models.Reset(); });
+
+    // The unknown command failed, and was still run after the others
+    CHECK(!succeeded);
+    CHECK(lines.size() == 9);
+    CHECK(lines[1] == "winsdk" && lines.back() == "unknown");
+
+    // One pass before the install, one between it and the uninstall, one for the last state
+    CHECK(winsdkProbes == 3);
+    CHECK(dxsdkProbes == 2);
+    CHECK(counting.Enumerations(L"HKLM\\" + kUninstallPath) == 3);
+    CHECK(counting.Enumerations(L"HKLM\\" + kUserDataPath) == 3);
+}
@@ -0,0 +1,148 @@
+#include "counting_registry.h"
+#include "fixtures.h"
+#include "test.h"
+#include <tool/component_index.h>
+#include <tool/installers.h>
+
+using namespace vcwin;
+using namespace vcwin::tests;
+
+namespace
+{
+    ulib::list<WindowsComponent> scan_uninstall(const RegistryBackend &registry, ComponentIndex &index,
+                                                std::chrono::seconds entryCheckInterval = std::chrono::minutes{10})
+    {
+        ComponentScanOptions options;
+        options.index = &index;
+        options.filterTag = "all;";
+        options.entryCheckInterval = entryCheckInterval;
+
+        return list_uninstall_components(options, registry);
+    }
+} // namespace
+
+VCWIN_TEST(component_index_picks_up_values_rewritten_in_place)
+{
+    TempDir dir{"component-index"};
+    auto path = dir.Path() / "index.json";
+    auto hive = make_component_hive(3000);
+
+    {
+        ComponentIndex index{path};
+        scan_uninstall(*hive.registry, index);
+        index.Save();
+    }
+
+    // An MSI minor upgrade rewrites DisplayVersion under the same GUID. Only the entry's own key gets a new
+    // last-write time, the Uninstall root keeps its time and subkey count.
+    auto &entry = hive.registry->MakeKey(RegistryRoot::LocalMachine, kUninstallPath + L"\\" + fixture_guid(3));
+    hive.registry->SetString(RegistryRoot::LocalMachine, kUninstallPath + L"\\" + fixture_guid(3), L"DisplayVersion",
+                             L"1.3.4");
+    entry.lastWriteTime++;
+
+    // Within the check interval the index answers as it is
+    ComponentIndex index{path};
+    auto components = scan_uninstall(*hive.registry, index);
+    CHECK(components[1].guid == ulib::u8(fixture_guid(3)));
+    CHECK(components[1].DisplayVersion == "1.3.3");
+
+    {
+        ScopedTimer timer{"Uninstall scan comparing every entry, 3000 entries"};
+        components = scan_uninstall(*hive.registry, index, std::chrono::seconds{0});
+    }
+
+    CHECK(components.size() == hive.uninstallComponents);
+    CHECK(components[1].guid == ulib::u8(fixture_guid(3)));
+    CHECK(components[1].DisplayVersion == "1.3.4");
+}
+
+VCWIN_TEST(component_index_warm_scan_opens_no_entries)
+{
+    TempDir dir{"component-index-warm"};
+    auto path = dir.Path() / "index.json";
+    auto hive = make_component_hive(3000);
+    CountingRegistry counting{*hive.registry};
+
+    {
+        ComponentIndex index{path};
+        scan_uninstall(counting, index);
+        index.Save();
+    }
+
+    CHECK(counting.Opens() > 3000);
+
+    ComponentIndex index{path};
+    counting.Reset();
+    ulib::list<WindowsComponent> components;
+    {
+        ScopedTimer timer{"Warm Uninstall scan, 3000 entries"};
+        components = scan_uninstall(counting, index);
+    }
+
+    // The three roots are opened and their info queried, nothing below them is touched
+    CHECK(components.size() == hive.uninstallComponents);
+    CHECK(counting.Opens() == 3);
+    CHECK(counting.InfoQueries() == 3);
+    CHECK(counting.Enumerations() == 0);
+    CHECK(counting.ValueCalls() == 0);
+
+    // Once the interval is up every entry key is opened for its last-write time, values are read only for
+    // those that changed
+    counting.Reset();
+    components = scan_uninstall(counting, index, std::chrono::seconds{0});
+    CHECK(components.size() == hive.uninstallComponents);
+    CHECK(counting.Opens() == 3 + 3000);
+    CHECK(counting.Enumerations() == 0);
+    CHECK(counting.ValueCalls() == 0);
+}
+
+VCWIN_TEST(component_index_is_not_rewritten_when_nothing_changed)
+{
+    TempDir dir{"component-index-clean"};
+    auto path = dir.Path() / "index.json";
+    auto hive = make_component_hive(300);
+
+    {
+        ComponentIndex index{path};
+        auto cold = scan_uninstall(*hive.registry, index);
+        index.Save();
+        CHECK(cold.size() == hive.uninstallComponents);
+    }
+
+    CHECK(fs::exists(path));
+    CHECK(fs::directory_iterator{dir.Path()}->path() == path);
+
+    ComponentIndex index{path};
+    auto warm = scan_uninstall(*hive.registry, index);
+    CHECK(warm.size() == hive.uninstallComponents);
+
+    // Save() writes only what changed, a warm scan of an unchanged hive changes nothing
+    fs::remove(path);
+    index.Save();
+    CHECK(!fs::exists(path));
+}
+
+VCWIN_TEST(component_index_save_replaces_the_file)
+{
+    TempDir dir{"component-index-replace"};
+    auto path = dir.Path() / "nested" / "index.json";
+    auto hive = make_component_hive(30);
+
+    for (int run = 0; run != 2; run++)
+    {
+        // A different filter tag invalidates every root, so each run has something to save
+        ComponentIndex index{path};
+        ComponentScanOptions options;
+        options.index = &index;
+        options.filterTag = run == 0 ? "first;" : "second;";
+        list_uninstall_components(options, *hive.registry);
+        index.Save();
+    }
+
+    // No temporary is left next to the index
+    size_t files = 0;
+    for (auto &file : fs::directory_iterator{path.parent_path()})
+        files += file.path() == path ? 1 : 100;
+    CHECK(files == 1);
+    CHECK(ulib::json::parse(futile::open(path, "r").read())["roots"][0]["filter"].get<ulib::string>() == "second;");
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tool/registry.h>
+
+namespace vcwin::tests
+{
+    // Wraps a backend and counts the calls a probe makes into it, so tests can tell how much of the registry a scan
+    // touched. Value reads are counted as the Win32 calls LiveRegistryKey turns them into.
+    class CountingRegistry : public RegistryBackend
+    {
+    public:
+        explicit CountingRegistry(const RegistryBackend &inner) : mInner(inner), mCounts(std::make_shared<Counts>())
+        {
+        }
+
+        std::unique_ptr<RegistryKey> OpenKey(RegistryRoot root, const std::wstring &path,
+                                             RegistryView view = RegistryView::Default) const override
+        {
+            mCounts->opens++;
+
+            auto key = mInner.OpenKey(root, path, view);
+            if (!key)
+                return nullptr;
+
+            auto name = std::wstring{root == RegistryRoot::CurrentUser ? L"HKCU\\" : L"HKLM\\"} + path;
+            mCounts->Opened(name);
+            return std::make_unique<Key>(std::move(key), std::move(name), mCounts);
+        }
+
+        // OpenKey and OpenSubKey calls, found or not
+        size_t Opens() const
+        {
+            return mCounts->opens;
+        }
+
+        size_t InfoQueries() const
+        {
+            return mCounts->infoQueries;
+        }
+
+        size_t ValueCalls() const
+        {
+            return mCounts->valueCalls;
+        }
+
+        // Subkey listings of every key
+        size_t Enumerations() const
+        {
+            return mCounts->enumerations;
+        }
+
+        // Subkey listings of the key at `path`, "HKLM\..." or "HKCU\...", spelled as the probe opened it
+        size_t Enumerations(const std::wstring &path) const
+        {
+            std::lock_guard lock{mCounts->mutex};
+            auto it = mCounts->enumerated.find(path);
+            return it == mCounts->enumerated.end() ? 0 : it->second;
+        }
+
+        bool WasOpened(const std::wstring &path) const
+        {
+            std::lock_guard lock{mCounts->mutex};
+            return mCounts->opened.count(path) != 0;
+        }
+
+        void Reset()
+        {
+            std::lock_guard lock{mCounts->mutex};
+            mCounts->opens = 0;
+            mCounts->infoQueries = 0;
+            mCounts->valueCalls = 0;
+            mCounts->enumerations = 0;
+            mCounts->opened.clear();
+            mCounts->enumerated.clear();
+        }
+
+    private:
+        struct Counts
+        {
+            std::atomic<size_t> opens = 0;
+            std::atomic<size_t> infoQueries = 0;
+            std::atomic<size_t> valueCalls = 0;
+            std::atomic<size_t> enumerations = 0;
+
+            std::mutex mutex;
+            std::map<std::wstring, size_t, detail::RegistryNameLess> opened;
+            std::map<std::wstring, size_t, detail::RegistryNameLess> enumerated;
+
+            void Opened(const std::wstring &path)
+            {
+                std::lock_guard lock{mutex};
+                opened[path]++;
+            }
+
+            void Enumerated(const std::wstring &path)
+            {
+                enumerations++;
+
+                std::lock_guard lock{mutex};
+                enumerated[path]++;
+            }
+        };
+
+        class Key : public RegistryKey
+        {
+        public:
+            Key(std::unique_ptr<RegistryKey> inner, std::wstring path, std::shared_ptr<Counts> counts)
+                : mInner(std::move(inner)), mPath(std::move(path)), mCounts(std::move(counts))
+            {
+            }
+
+            RegistryKeyInfo QueryInfo() const override
+            {
+                mCounts->infoQueries++;
+                return mInner->QueryInfo();
+            }
+
+            std::unique_ptr<RegistryKey> OpenSubKey(const std::wstring &name) const override
+            {
+                mCounts->opens++;
+
+                auto key = mInner->OpenSubKey(name);
+                if (!key)
+                    return nullptr;
+
+                auto path = mPath + L"\\" + name;
+                mCounts->Opened(path);
+                return std::make_unique<Key>(std::move(key), std::move(path), mCounts);
+            }
+
+            std::vector<std::wstring> EnumSubKeys() const override
+            {
+                mCounts->Enumerated(mPath);
+                return mInner->EnumSubKeys();
+            }
+
+            void ForEachSubKey(const std::function<void(const std::wstring &)> &fn) const override
+            {
+                mCounts->Enumerated(mPath);
+                mInner->ForEachSubKey(fn);
+            }
+
+            std::vector<std::pair<std::wstring, RegistryValueType>> EnumValues() const override
+            {
+                mCounts->valueCalls++;
+                return mInner->EnumValues();
+            }
+
+            std::optional<std::wstring> TryGetString(const std::wstring &name) const override
+            {
+                mCounts->valueCalls++;
+                return mInner->TryGetString(name);
+            }
+
+            std::optional<uint32_t> TryGetDword(const std::wstring &name) const override
+            {
+                mCounts->valueCalls++;
+                return mInner->TryGetDword(name);
+            }
+
+            // RegQueryMultipleValuesW fails as a whole when one of the values is missing, the live backend then
+            // queries them one by one
+            void ReadValues(const std::vector<std::wstring> &names, std::vector<RegistryValue> &values) const override
+            {
+                mInner->ReadValues(names, values);
+
+                mCounts->valueCalls++;
+                for (auto &value : values)
+                {
+                    if (value.type == RegistryValueType::None)
+                    {
+                        mCounts->valueCalls += names.size();
+                        break;
+                    }
+                }
+            }
+
+        private:
+            std::unique_ptr<RegistryKey> mInner;
+            std::wstring mPath;
+            std::shared_ptr<Counts> mCounts;
+        };
+
+        const RegistryBackend &mInner;
+        std::shared_ptr<Counts> mCounts;
+    };
+} // namespace vcwin::tests
@@ -0,0 +1,162 @@
+#include "fixtures.h"
+#include "test.h"
+#include <futile/futile.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tool/dev_environment.h>
+
+using namespace vcwin;
+using namespace vcwin::tests;
+
+namespace
+{
+    // tests/fixtures/vcvars: tree.txt lays out a drive with one Visual Studio instance and one Windows Kit, the
+    // set_*.txt files are `vcvarsall.bat <arch> && set` recorded on a machine with that layout
+    class VcvarsFixture
+    {
+    public:
+        VcvarsFixture() : mDrive("vcvars")
+        {
+            for (auto &line : futile::open(fixture_path("vcvars") / "tree.txt").lines<std::string>())
+            {
+                std::string_view entry{line};
+                if (!entry.empty() && entry.back() == '\r')
+                    entry.remove_suffix(1);
+                if (entry.empty() || entry.front() == '#')
+                    continue;
+
+                if (entry.back() == '/')
+                {
+                    fs::create_directories(Root() / entry);
+                    continue;
+                }
+
+                auto eq = entry.find(" =");
+                auto file = Root() / entry.substr(0, eq);
+                fs::create_directories(file.parent_path());
+                futile::open(file, "w").write(std::string{eq + 3 <= entry.size() ? entry.substr(eq + 3) : ""});
+            }
+
+            auto vsDir = Root() / "Program Files" / "Microsoft Visual Studio" / "2022" / "Community";
+            auto instancesDir = Root() / "ProgramData" / "Microsoft" / "VisualStudio" / "Packages" / "_Instances";
+            fs::create_directories(instancesDir / "1a2b3c4d");
+            futile::open(instancesDir / "1a2b3c4d" / "state.json", "w")
+                .write("{\"installationName\": \"VisualStudio/17.10.1+35004.147\", \"installationPath\": \"" +
+                       json_escape(vsDir.u8string()) +
+                       "\", \"installationVersion\": \"17.10.35004.147\", \"installDate\": \"2024-05-28T09:12:44Z\"}");
+
+            auto kitDir = (Root() / "Program Files (x86)" / "Windows Kits" / "10").make_preferred();
+            auto sdkKey = std::wstring{L"SOFTWARE\\WOW6432Node\\Microsoft\\Microsoft SDKs\\Windows\\v10.0"};
+            mRegistry.SetString(RegistryRoot::LocalMachine, sdkKey, L"InstallationFolder",
+                                kitDir.wstring() + wchar_t(fs::path::preferred_separator));
+            mRegistry.SetString(RegistryRoot::LocalMachine, sdkKey, L"ProductVersion", L"10.0.22621");
+            mRegistry.SetString(RegistryRoot::LocalMachine, sdkKey, L"ProductName", L"Windows SDK");
+
+            mVCTools.emplace(instancesDir);
+            mWindowsSDK.emplace(mRegistry);
+        }
+
+        const fs::path &Root() const
+        {
+            return mDrive.Path();
+        }
+
+        const VCTools &GetVCTools() const
+        {
+            return *mVCTools;
+        }
+
+        const WindowsSDK &GetWindowsSDK() const
+        {
+            return *mWindowsSDK;
+        }
+
+        // The recorded dump with C:\ moved to the fixture drive
+        std::string RecordedSet(std::string_view name) const
+        {
+            auto recorded = futile::open(fixture_path("vcvars") / name, "r").read();
+            std::string text{recorded.data(), recorded.size()};
+
+            auto drive = fs::path{Root()}.make_preferred().u8string();
+            std::string root{reinterpret_cast<const char *>(drive.data()), drive.size()};
+            root += char(fs::path::preferred_separator);
+
+            for (size_t at = text.find("C:\\"); at != std::string::npos; at = text.find("C:\\", at + root.size()))
+                text.replace(at, 3, root);
+
+            return text;
+        }
+
+    private:
+        static std::string json_escape(const std::u8string &text)
+        {
+            std::string out;
+            for (auto c : text)
+            {
+                if (c == '\\' || c == '"')
+                    out += '\\';
+                out += char(c);
+            }
+
+            return out;
+        }
+
+        TempDir mDrive;
+        SnapshotRegistry mRegistry;
+        std::optional<VCTools> mVCTools;
+        std::optional<WindowsSDK> mWindowsSDK;
+    };
+
+    void check_no_mismatches(const ulib::list<DevEnvironmentMismatch> &mismatches)
+    {
+        if (mismatches.size() == 0)
+            return;
+
+        std::string names;
+        for (auto &mismatch : mismatches)
+            names += " " + std::string{mismatch.name.data(), mismatch.name.size()};
+
+        fail(__FILE__, __LINE__, "variables differ from the recording:" + names);
+    }
+
+    bool has_mismatch(const ulib::list<DevEnvironmentMismatch> &mismatches, std::string_view name)
+    {
+        for (auto &mismatch : mismatches)
+        {
+            if (std::string_view{mismatch.name.data(), mismatch.name.size()} == name)
+                return true;
+        }
+
+        return false;
+    }
+} // namespace
+
+VCWIN_TEST(dev_environment_matches_recorded_vcvarsall_x64)
+{
+    VcvarsFixture fixture;
+
+    auto env = make_dev_environment(fixture.GetVCTools(), fixture.GetWindowsSDK());
+    CHECK(*env.Find("VCToolsVersion") == "14.40.33807");
+    CHECK(*env.Find("UCRTVersion") == "10.0.22621.0");
+
+    check_no_mismatches(compare_dev_environment(env, fixture.RecordedSet("set_x64.txt")));
+}
+
+VCWIN_TEST(dev_environment_matches_recorded_vcvarsall_x64_arm64)
+{
+    VcvarsFixture fixture;
+
+    DevEnvironmentOptions options;
+    options.target = "arm64";
+    auto env = make_dev_environment(fixture.GetVCTools(), fixture.GetWindowsSDK(), options);
+
+    check_no_mismatches(compare_dev_environment(env, fixture.RecordedSet("set_x64_arm64.txt")));
+
+    // The other recording is no match, so the comparison is not vacuous
+    auto mismatches = compare_dev_environment(env, fixture.RecordedSet("set_x64.txt"));
+    CHECK(has_mismatch(mismatches, "Platform"));
+    CHECK(has_mismatch(mismatches, "LIB"));
+    CHECK(has_mismatch(mismatches, "PATH"));
+    CHECK(!has_mismatch(mismatches, "INCLUDE"));
+}
@@ -0,0 +1,317 @@
+#include "counting_registry.h"
+#include "fixtures.h"
+#include "test.h"
+#include <chrono>
+#include <string>
+#include <tool/cbor_reader.h>
+#include <tool/projection.h>
+#include <tool/snapshot.h>
+#include <tool/state_document.h>
+#include <ulib/yaml.h>
+
+using namespace vcwin;
+using namespace vcwin::tests;
+
+namespace
+{
+    // `vcwin state` over a hive of 5k SDK and WDK components, see state_snapshot_of_5k_components_loads_back. Many
+    // of them share a DisplayName, which the document folds into one member.
+    class LargeState
+    {
+    public:
+        LargeState() : mHive(make_component_hive(45000)), mWindowsSDK(*mHive.registry), mDirectX(*mHive.registry)
+        {
+            mEnvironment = StateEnvironment::Make(mVCTools, mWindowsSDK);
+        }
+
+        StateDocument Document() const
+        {
+            return StateDocument{&mVCTools, &mWindowsSDK, &mDirectX, &mEnvironment};
+        }
+
+        void WriteSnapshot(const fs::path &path) const
+        {
+            StateSnapshot::Write(path, mVCTools, mWindowsSDK, mDirectX);
+        }
+
+    private:
+        ComponentHive mHive;
+        VCTools mVCTools;
+        WindowsSDK mWindowsSDK;
+        DirectXSdk mDirectX;
+        StateEnvironment mEnvironment;
+    };
+
+    template <class EmitterT, class Model>
+    std::string emit_text(const Model &model)
+    {
+        std::string text;
+        {
+            OutputBuffer out{text};
+            EmitterT emitter{out};
+            model.Emit(emitter);
+        }
+
+        return text;
+    }
+
+    template <class Model>
+    ulib::json emit_dom(const Model &model)
+    {
+        JsonDomEmitter emitter;
+        model.Emit(emitter);
+        return emitter.Take();
+    }
+
+    ulib::json to_json(const CborValue &value)
+    {
+        ulib::json result;
+        switch (value.kind)
+        {
+        case CborValue::Kind::Null:
+            break;
+        case CborValue::Kind::Bool:
+            result = value.boolean;
+            break;
+        case CborValue::Kind::Int:
+            result = value.integer;
+            break;
+        case CborValue::Kind::Double:
+            result = value.number;
+            break;
+        case CborValue::Kind::String:
+            result = ulib::string{std::string_view{value.string}};
+            break;
+        case CborValue::Kind::Array:
+            result = ulib::json::array();
+            for (auto &item : value.items)
+                result.push_back() = to_json(item);
+            break;
+        case CborValue::Kind::Map:
+            result = ulib::json::object();
+            for (auto &member : value.members)
+                result[ulib::string{std::string_view{member.first}}] = to_json(member.second);
+            break;
+        }
+
+        return result;
+    }
+
+    // What `vcwin --format cbor` wrote, read back the way a consumer would and turned into the tree `--format json`
+    // is made from
+    template <class Model>
+    void check_cbor_round_trip(const Model &model)
+    {
+        auto data = emit_text<CborEmitter>(model);
+
+        CborReader reader{data};
+        CborValue value;
+        CHECK(reader.Read(value));
+        CHECK(reader.AtEnd());
+        CHECK(to_json(value).dump() == emit_dom(model).dump());
+    }
+
+    constexpr std::string_view kPlainLookalikes[] = {"+1", "+x", "<<", "=", "-1", ".5", "~", "Null", "Yes", "off",
+                                                     "10.0.22621.0", "a: b", "#x", "*x", "x:"};
+
+    // Scalars at the edges of the CBOR head sizes, which the state documents do not reach on their own
+    struct EdgeValues
+    {
+        void Emit(Emitter &emitter) const
+        {
+            emitter.BeginObject();
+
+            emitter.Key("ints");
+            emitter.BeginArray();
+            for (int64_t value : {0ll, 23ll, 24ll, 255ll, 256ll, 65535ll, 65536ll, 4294967295ll, 4294967296ll, -1ll,
+                                  -24ll, -25ll, -256ll, -257ll, -4294967296ll, -4294967297ll})
+                emitter.Value(value);
+            emitter.EndArray();
+
+            emitter.Key("numbers");
+            emitter.BeginArray();
+            emitter.Number("0.5");
+            emitter.Number("-1234.125");
+            emitter.Number("1e300");
+            emitter.EndArray();
+
+            emitter.Key("strings");
+            emitter.BeginArray();
+            for (size_t size : {0, 23, 24, 255, 256, 65535, 65536})
+                emitter.Value(std::string(size, 'x'));
+            emitter.Value("Kits\\10\n\"quoted\" \xC3\xA9");
+            emitter.EndArray();
+
+            // Strings YAML would read as something else when written plain
+            emitter.Key("plain_lookalikes");
+            emitter.BeginArray();
+            for (auto value : kPlainLookalikes)
+                emitter.Value(value);
+            emitter.EndArray();
+
+            emitter.Key("empty_object");
+            emitter.BeginObject();
+            emitter.EndObject();
+            emitter.Key("empty_array");
+            emitter.BeginArray();
+            emitter.EndArray();
+            emitter.Field("yes", true);
+            emitter.Field("no", false);
+            emitter.Key("nothing");
+            emitter.Null();
+
+            emitter.EndObject();
+        }
+    };
+
+    // What `vcwin state --query <paths>` writes for a document with only the given models behind it
+    std::string project(const StateDocument &document, const ulib::list<ulib::string_view> &paths)
+    {
+        auto projection = Projection::Parse(paths);
+
+        std::string text;
+        {
+            OutputBuffer out{text};
+            JsonEmitter emitter{out};
+            ProjectionEmitter selected{emitter, projection};
+            document.Emit(selected);
+            CHECK(selected.Finish());
+        }
+
+        return text;
+    }
+} // namespace
+
+VCWIN_TEST(json_emitter_writes_what_json_dump_wrote_for_5k_components)
+{
+    LargeState state;
+    auto document = state.Document();
+
+    // print() used to build the tree and dump it
+    ulib::string dumped;
+    {
+        ScopedTimer timer{"ulib::json tree and dump()"};
+        dumped = emit_dom(document).dump();
+    }
+
+    std::string text;
+    {
+        ScopedTimer timer{"JsonEmitter"};
+        text = emit_text<JsonEmitter>(document);
+    }
+
+    CHECK(ulib::json::parse(ulib::string{std::string_view{text}}).dump() == dumped);
+}
+
+VCWIN_TEST(yaml_emitter_writes_what_ulib_yaml_wrote_for_5k_components)
+{
+    LargeState state;
+    auto document = state.Document();
+
+    // print() used to reparse the JSON dump as YAML and dump that
+    ulib::string dumped;
+    {
+        ScopedTimer timer{"ulib::json tree, dump() and ulib::yaml round trip"};
+        dumped = ulib::yaml::parse(emit_dom(document).dump()).dump();
+    }
+
+    std::string text;
+    {
+        ScopedTimer timer{"YamlEmitter"};
+        text = emit_text<YamlEmitter>(document);
+    }
+
+    // Both are read by ulib::yaml and dumped again, so the documents have to agree, not the quoting style
+    CHECK(ulib::yaml::parse(ulib::string{std::string_view{text}}).dump() == dumped);
+}
+
+VCWIN_TEST(yaml_emitter_quotes_strings_that_would_not_read_back)
+{
+    auto text = emit_text<YamlEmitter>(EdgeValues{});
+
+    for (auto value : kPlainLookalikes)
+        CHECK(text.find("- \"" + std::string{value} + "\"\n") != std::string::npos);
+
+    CHECK(ulib::yaml::parse(ulib::string{std::string_view{text}}).dump() ==
+          ulib::yaml::parse(emit_dom(EdgeValues{}).dump()).dump());
+}
+
+VCWIN_TEST(cbor_output_reads_back_as_the_json_tree)
+{
+    LargeState state;
+    check_cbor_round_trip(state.Document());
+
+    StateTimings timings;
+    timings.winsdk = std::chrono::milliseconds{1500};
+    timings.total = std::chrono::hours{2};
+    auto document = state.Document();
+    document.timings = &timings;
+    check_cbor_round_trip(document);
+
+    check_cbor_round_trip(EdgeValues{});
+}
+
+VCWIN_TEST(cbor_output_of_a_loaded_snapshot_reads_back_as_the_json_tree)
+{
+    LargeState state;
+
+    TempDir dir{"cbor-snapshot"};
+    auto path = dir.Path() / "state.vcsnap";
+    state.WriteSnapshot(path);
+
+    auto snapshot = StateSnapshot::Open(path);
+    auto vctools = snapshot->LoadVCTools();
+    auto winsdk = snapshot->LoadWindowsSDK();
+    auto dxsdk = snapshot->LoadDirectXSdk();
+    auto environment = StateEnvironment::Make(vctools, winsdk);
+
+    check_cbor_round_trip(StateDocument{&vctools, &winsdk, &dxsdk, &environment});
+}
+
+VCWIN_TEST(projection_probes_only_the_selected_sections)
+{
+    auto hive = make_component_hive(10000, 2000);
+    std::wstring infoPath = L"SOFTWARE\\WOW6432Node\\Microsoft\\Microsoft SDKs\\Windows\\v10.0";
+    std::wstring wdkPath = L"SOFTWARE\\WOW6432Node\\Microsoft\\Windows Kits\\WDK";
+    hive.registry->SetString(RegistryRoot::LocalMachine, wdkPath, L"WDKProductVersion10", L"10.0.22621.0");
+
+    TempDir kit{"projection-kit"};
+    hive.registry->SetString(RegistryRoot::LocalMachine, infoPath, L"InstallationFolder", kit.Path().wstring());
+    hive.registry->SetString(RegistryRoot::LocalMachine, infoPath, L"ProductVersion", L"10.0.22621");
+    hive.registry->SetString(RegistryRoot::LocalMachine, infoPath, L"ProductName", L"Microsoft Windows SDK");
+
+    CountingRegistry counting{*hive.registry};
+
+    // Only winsdk is selected, so the other models may be missing altogether
+    {
+        WindowsSDK winsdk{counting};
+        StateDocument document{nullptr, &winsdk, nullptr, nullptr};
+
+        CHECK(project(document, {"winsdk.WdkProductVersion10"}) == "\"10.0.22621.0\"\n");
+        CHECK(counting.Opens() == 1 && counting.WasOpened(L"HKLM\\" + wdkPath));
+        CHECK(counting.Enumerations() == 0 && !winsdk.HasItems());
+
+        // The items come in with the first path through them, the kit directory is still not looked for.
+        // Members come out in document order.
+        auto both = project(document, {"/winsdk/SDKs/0/windows_version", "winsdk.WdkProductVersion10"});
+        CHECK(both == "{\"winsdk.WdkProductVersion10\":\"10.0.22621.0\","
+                      "\"/winsdk/SDKs/0/windows_version\":\"10.0.22000.0\"}\n");
+        CHECK(winsdk.HasItems() && counting.Enumerations() != 0);
+        CHECK(!counting.WasOpened(L"HKLM\\" + infoPath));
+    }
+
+    // The whole model probes every section
+    counting.Reset();
+    {
+        WindowsSDK winsdk{counting};
+        std::string text;
+        {
+            OutputBuffer out{text};
+            JsonEmitter emitter{out};
+            winsdk.Emit(emitter);
+        }
+
+        CHECK(counting.WasOpened(L"HKLM\\" + wdkPath) && counting.WasOpened(L"HKLM\\" + infoPath));
+        CHECK(winsdk.HasItems());
+    }
+}
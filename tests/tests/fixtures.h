@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tool/registry.h>
+
+namespace vcwin::tests
+{
+    namespace fs = std::filesystem;
+
+    inline const std::wstring kUninstallPath = L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall";
+    inline const std::wstring kWowUninstallPath =
+        L"SOFTWARE\\WOW6432Node\\Microsoft\\Windows\\CurrentVersion\\Uninstall";
+    inline const std::wstring kUserDataPath = L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Installer\\UserData";
+
+    inline std::wstring fixture_guid(size_t i)
+    {
+        wchar_t guid[40];
+        std::swprintf(guid, std::size(guid), L"{%08zX-0000-4000-8000-%012zX}", i, i * 7919);
+        return guid;
+    }
+
+    // What a synthetic hive holds, for checking scans over it
+    struct ComponentHive
+    {
+        std::unique_ptr<SnapshotRegistry> registry = std::make_unique<SnapshotRegistry>();
+
+        // Entries with a DisplayVersion, i.e. those a scan reports
+        size_t uninstallComponents = 0;
+        size_t installerComponents = 0;
+
+        size_t sdkComponents = 0;
+        size_t wdkComponents = 0;
+    };
+
+    // Entry i is an SDK when i % 10 == 0, a WDK when i % 10 == 1 and an unrelated product otherwise. SDK and WDK
+    // versions spread over 40 builds. Every 50th entry has no DisplayVersion and is not a component. Keys carry
+    // last-write times, every entry its own, so index scans see them as unchanged until a test touches them.
+    inline void add_fixture_component(SnapshotRegistry::Node &node, size_t i, ComponentHive &hive)
+    {
+        std::wstring guid = fixture_guid(i);
+        std::wstring build = std::to_wstring(22000 + (i / 10) % 40);
+
+        std::wstring name, version;
+        if (i % 10 == 0)
+        {
+            name = L"Windows SDK Desktop Headers x64 - 10.0." + build + L"." + std::to_wstring(i % 7);
+            version = L"10.0." + build + L"." + std::to_wstring(i % 7);
+        }
+        else if (i % 10 == 1)
+        {
+            name = L"Windows Driver Kit - Windows 10.0." + build;
+            version = L"10.0." + build + L".0";
+        }
+        else
+        {
+            name = L"Contoso Runtime " + std::to_wstring(i);
+            version = L"1." + std::to_wstring(i % 100) + L"." + std::to_wstring(i);
+        }
+
+        node.lastWriteTime = 1000 + i;
+        node.values.push_back({L"DisplayName", {RegistryValueType::String, name, 0}});
+        node.values.push_back({L"UninstallString", {RegistryValueType::String, L"MsiExec.exe /X" + guid, 0}});
+        node.values.push_back({L"SystemComponent", {RegistryValueType::Dword, {}, i % 4 == 0}});
+
+        if (i % 50 == 49)
+            return;
+
+        node.values.push_back({L"DisplayVersion", {RegistryValueType::String, version, 0}});
+
+        if (i % 10 == 0)
+            hive.sdkComponents++;
+        else if (i % 10 == 1)
+            hive.wdkComponents++;
+    }
+
+    // `uninstallCount` entries spread over the 64-bit, 32-bit and per-user Uninstall roots, then `installerCount`
+    // products spread over four SIDs of Installer\UserData. Entry numbers, and so GUIDs, never repeat.
+    inline ComponentHive make_component_hive(size_t uninstallCount, size_t installerCount = 0)
+    {
+        ComponentHive hive;
+        auto &registry = *hive.registry;
+
+        const std::pair<RegistryRoot, std::wstring> uninstallRoots[] = {
+            {RegistryRoot::LocalMachine, kUninstallPath},
+            {RegistryRoot::LocalMachine, kWowUninstallPath},
+            {RegistryRoot::CurrentUser, kUninstallPath},
+        };
+
+        for (auto &[root, path] : uninstallRoots)
+            registry.MakeKey(root, path).lastWriteTime = 1;
+
+        for (size_t i = 0; i != uninstallCount; i++)
+        {
+            auto &[root, path] = uninstallRoots[i % 3];
+            add_fixture_component(registry.MakeKey(root, path + L"\\" + fixture_guid(i)), i, hive);
+            hive.uninstallComponents += i % 50 != 49;
+        }
+
+        const wchar_t *sids[] = {L"S-1-5-18", L"S-1-5-21-1-1-1-1001", L"S-1-5-21-1-1-1-1002", L"S-1-5-21-1-1-1-1003"};
+        for (auto sid : sids)
+            registry.MakeKey(RegistryRoot::LocalMachine, kUserDataPath + L"\\" + sid + L"\\Products").lastWriteTime = 1;
+
+        for (size_t i = uninstallCount; i != uninstallCount + installerCount; i++)
+        {
+            auto path = kUserDataPath + L"\\" + sids[i % 4] + L"\\Products\\" + fixture_guid(i);
+            path += L"\\InstallProperties";
+            add_fixture_component(registry.MakeKey(RegistryRoot::LocalMachine, path), i, hive);
+            hive.installerComponents += i % 50 != 49;
+        }
+
+        return hive;
+    }
+
+    // The test executable as main() was started, set from argv[0]
+    inline fs::path &executable_path()
+    {
+        static fs::path path;
+        return path;
+    }
+
+    // Checked-in fixture files under tests/fixtures, looked up from the executable's directory upwards. __FILE__ is
+    // relative whenever the compiler was handed relative source paths, the executable path is not.
+    inline fs::path fixture_path(const fs::path &name)
+    {
+        static const fs::path fixtures = [] {
+            auto exe = fs::absolute(executable_path());
+            for (auto dir = exe.parent_path();; dir = dir.parent_path())
+            {
+                if (fs::is_directory(dir / "tests" / "fixtures"))
+                    return dir / "tests" / "fixtures";
+
+                if (dir == dir.parent_path())
+                    throw std::runtime_error{"No tests/fixtures above " + exe.string()};
+            }
+        }();
+
+        return fixtures / name;
+    }
+
+    // Empty directory under the system temp directory, removed again when the object goes away
+    class TempDir
+    {
+    public:
+        TempDir(std::string_view name)
+        {
+            mPath = fs::temp_directory_path() / ("vcwin-tests-" + std::string{name});
+            fs::remove_all(mPath);
+            fs::create_directories(mPath);
+        }
+
+        ~TempDir()
+        {
+            std::error_code ec;
+            fs::remove_all(mPath, ec);
+        }
+
+        const fs::path &Path() const
+        {
+            return mPath;
+        }
+
+    private:
+        fs::path mPath;
+    };
+} // namespace vcwin::tests
@@ -0,0 +1,52 @@
+#include "fixtures.h"
+#include "test.h"
+#include <tool/installers.h>
+
+using namespace vcwin;
+using namespace vcwin::tests;
+
+VCWIN_TEST(installer_scan_of_a_10k_hive_matches_the_serial_walk)
+{
+    auto hive = make_component_hive(0, 10000);
+
+    StringArena arena;
+    ComponentScanOptions options;
+    options.arena = &arena;
+
+    ulib::list<WindowsComponent> components;
+    {
+        ScopedTimer timer{"Installer\\UserData scan on the worker pool, 10000 products"};
+        components = list_installer_components(options, *hive.registry);
+    }
+
+    ulib::list<WindowsComponent> serial;
+    {
+        ScopedTimer timer{"Installer\\UserData serial walk, 10000 products"};
+        for (auto &component : enumerate_installer_components({}, arena, *hive.registry))
+            serial.push_back(component);
+    }
+
+    // Merged back in enumeration order, SID by SID and product by product, whatever the scheduling
+    CHECK(components.size() == hive.installerComponents);
+    CHECK(serial.size() == components.size());
+    for (size_t i = 0; i != components.size(); i++)
+    {
+        CHECK(components[i].guid == serial[i].guid);
+        CHECK(components[i].DisplayVersion == serial[i].DisplayVersion);
+    }
+
+    CHECK(components.front().guid == ulib::u8(fixture_guid(0)));
+    CHECK(components[1].guid == ulib::u8(fixture_guid(4)));
+}
+
+VCWIN_TEST(installer_scan_skips_products_without_install_properties)
+{
+    auto hive = make_component_hive(0, 8);
+    hive.registry->MakeKey(RegistryRoot::LocalMachine, kUserDataPath + L"\\S-1-5-18\\Products\\{BROKEN}");
+
+    StringArena arena;
+    ComponentScanOptions options;
+    options.arena = &arena;
+
+    CHECK(list_installer_components(options, *hive.registry).size() == hive.installerComponents);
+}
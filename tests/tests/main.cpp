@@ -0,0 +1,35 @@
+#include "fixtures.h"
+#include "test.h"
+#include <cstdio>
+#include <exception>
+#include <string_view>
+
+// vcwin-tests [<filter>]: runs every case, or only those whose name contains the filter
+int main(int argc, char **argv)
+{
+    vcwin::tests::executable_path() = argv[0];
+    std::string_view filter = argc > 1 ? argv[1] : "";
+
+    size_t ran = 0;
+    size_t failed = 0;
+    for (auto &test : vcwin::tests::test_cases())
+    {
+        if (!filter.empty() && std::string_view{test.name}.find(filter) == std::string_view::npos)
+            continue;
+
+        ran++;
+        try
+        {
+            test.run();
+            std::printf("[ ok ] %s\n", test.name);
+        }
+        catch (const std::exception &ex)
+        {
+            failed++;
+            std::printf("[fail] %s: %s\n", test.name, ex.what());
+        }
+    }
+
+    std::printf("%zu of %zu passed\n", ran - failed, ran);
+    return failed == 0 ? 0 : 1;
+}
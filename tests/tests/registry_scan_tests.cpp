@@ -0,0 +1,281 @@
+#include "counting_registry.h"
+#include "fixtures.h"
+#include "test.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <tool/installers.h>
+#include <tool/winsdk.h>
+
+using namespace vcwin;
+using namespace vcwin::tests;
+
+VCWIN_TEST(uninstall_scan_reads_every_component_of_a_10k_hive)
+{
+    auto hive = make_component_hive(10000);
+
+    StringArena arena;
+    ComponentScanOptions options;
+    options.arena = &arena;
+
+    ulib::list<WindowsComponent> components;
+    {
+        ScopedTimer timer{"Uninstall scan, 10000 entries"};
+        components = list_uninstall_components(options, *hive.registry);
+    }
+
+    CHECK(components.size() == hive.uninstallComponents);
+
+    // Roots in precedence order, subkeys in key order within each
+    CHECK(components.front().guid == ulib::u8(fixture_guid(0)));
+    CHECK(components.front().DisplayName == "Windows SDK Desktop Headers x64 - 10.0.22000.0");
+    CHECK(components.front().DisplayVersion == "10.0.22000.0");
+    CHECK(components.front().SystemComponent);
+    CHECK(components[1].guid == ulib::u8(fixture_guid(3)));
+    CHECK(!components[1].SystemComponent);
+}
+
+VCWIN_TEST(uninstall_scan_interns_component_strings)
+{
+    auto hive = make_component_hive(10000);
+
+    StringArena arena;
+    ComponentScanOptions options;
+    options.arena = &arena;
+
+    auto components = list_uninstall_components(options, *hive.registry);
+    CHECK(components.size() == hive.uninstallComponents);
+
+    // Each distinct string is stored once, however many components and fields hold it
+    std::map<std::string_view, const char *> stored;
+    size_t bytes = 0, longest = 0;
+    for (auto &component : components)
+    {
+        for (auto str : {component.guid, component.DisplayName, component.DisplayVersion, component.UninstallString})
+        {
+            std::string_view view{str.data(), str.size()};
+            auto [it, inserted] = stored.emplace(view, view.data());
+            CHECK(it->second == view.data());
+
+            if (inserted)
+            {
+                bytes += view.size();
+                longest = std::max(longest, view.size());
+            }
+        }
+    }
+
+    std::printf("    interned strings: %zu for %zu components, %zu bytes\n", arena.GetStringCount(), components.size(),
+                bytes);
+    CHECK(arena.GetStringCount() == stored.size());
+    CHECK(arena.GetStringCount() < 4 * components.size());
+
+    // Packed into full blocks, each leaving less than one string unused at its end
+    size_t blocks = arena.GetBlockCount();
+    std::printf("    arena blocks: %zu\n", blocks);
+    CHECK(blocks * StringArena::kBlockSize >= bytes);
+    CHECK((blocks - 1) * (StringArena::kBlockSize - longest) < bytes);
+
+    // SDK components of a build share their DisplayVersion with the WDK of that build
+    auto sdk = std::find_if(components.begin(), components.end(), [](auto &component) {
+        return component.DisplayVersion == "10.0.22001.0" && WindowsSDK::IsSDKComponent(component.DisplayName);
+    });
+    auto wdk = std::find_if(components.begin(), components.end(), [](auto &component) {
+        return component.DisplayVersion == "10.0.22001.0" && WindowsSDK::IsWDKComponent(component.DisplayName);
+    });
+    CHECK(sdk != components.end() && wdk != components.end());
+    CHECK(sdk->DisplayVersion.data() == wdk->DisplayVersion.data());
+}
+
+VCWIN_TEST(uninstall_scan_filters_by_display_name)
+{
+    auto hive = make_component_hive(10000);
+
+    StringArena arena;
+    ComponentScanOptions options;
+    options.arena = &arena;
+    options.filter = WindowsSDK::IsSDKComponent;
+
+    ulib::list<WindowsComponent> components;
+    {
+        ScopedTimer timer{"Uninstall scan, 10000 entries, SDK filter"};
+        components = list_uninstall_components(options, *hive.registry);
+    }
+
+    CHECK(components.size() == hive.sdkComponents);
+    for (auto &component : components)
+        CHECK(WindowsSDK::IsSDKComponent(component.DisplayName));
+}
+
+VCWIN_TEST(uninstall_scan_reports_a_guid_once)
+{
+    SnapshotRegistry registry;
+    registry.SetString(RegistryRoot::LocalMachine, kUninstallPath + L"\\{A}", L"DisplayName", L"Native");
+    registry.SetString(RegistryRoot::LocalMachine, kUninstallPath + L"\\{A}", L"DisplayVersion", L"1.0");
+    registry.SetString(RegistryRoot::LocalMachine, kWowUninstallPath + L"\\{a}", L"DisplayName", L"Wow");
+    registry.SetString(RegistryRoot::LocalMachine, kWowUninstallPath + L"\\{a}", L"DisplayVersion", L"1.0");
+
+    StringArena arena;
+    ComponentScanOptions options;
+    options.arena = &arena;
+
+    auto components = list_uninstall_components(options, registry);
+    CHECK(components.size() == 1);
+    CHECK(components.front().DisplayName == "Native");
+}
+
+VCWIN_TEST(component_read_makes_three_value_calls)
+{
+    // Most real Uninstall entries have no SystemComponent value
+    SnapshotRegistry registry;
+    auto path = kUninstallPath + L"\\{A}";
+    registry.SetString(RegistryRoot::LocalMachine, path, L"DisplayName", L"Windows SDK Desktop Headers x64 - 10.0.1");
+    registry.SetString(RegistryRoot::LocalMachine, path, L"DisplayVersion", L"10.0.22621.1");
+    registry.SetString(RegistryRoot::LocalMachine, path, L"UninstallString", L"MsiExec.exe /X{A}");
+
+    CountingRegistry counting{registry};
+    auto node = counting.OpenKey(RegistryRoot::LocalMachine, path);
+    StringArena arena;
+
+    counting.Reset();
+    auto component = detail::read_component(*node, L"{A}", {}, arena);
+    CHECK(component && !component->SystemComponent);
+    CHECK(counting.ValueCalls() == 3);
+
+    // The read it replaced: DisplayName, then a batch of three that fell apart over the missing value
+    counting.Reset();
+    std::vector<RegistryValue> values;
+    CHECK(node->TryGetString(L"DisplayName"));
+    node->ReadValues({L"DisplayVersion", L"UninstallString", L"SystemComponent"}, values);
+    CHECK(counting.ValueCalls() == 5);
+
+    registry.SetDword(RegistryRoot::LocalMachine, path, L"SystemComponent", 1);
+    counting.Reset();
+    component = detail::read_component(*node, L"{A}", {}, arena);
+    CHECK(component && component->SystemComponent);
+    CHECK(counting.ValueCalls() == 3);
+
+    // Entries the filter turns down cost the DisplayName read alone
+    counting.Reset();
+    CHECK(!detail::read_component(*node, L"{A}", WindowsSDK::IsWDKComponent, arena));
+    CHECK(counting.ValueCalls() == 1);
+}
+
+VCWIN_TEST(uninstall_scan_value_calls_per_entry)
+{
+    auto hive = make_component_hive(10000);
+    CountingRegistry counting{*hive.registry};
+
+    StringArena arena;
+    ComponentScanOptions options;
+    options.arena = &arena;
+    options.filter = WindowsSDK::IsSDKComponent;
+
+    auto components = list_uninstall_components(options, counting);
+    CHECK(components.size() == hive.sdkComponents);
+
+    // One DisplayName read per entry, two more per SDK component
+    std::printf("    value calls per entry, 10000 entries, SDK filter: %.2f\n", counting.ValueCalls() / 10000.0);
+    std::printf("    value calls per SDK component: %.2f\n",
+                double(counting.ValueCalls() - 10000) / double(hive.sdkComponents));
+    CHECK(counting.ValueCalls() == 10000 + 2 * hive.sdkComponents);
+}
+
+VCWIN_TEST(wdk_uninstaller_search_stops_at_the_first_match)
+{
+    auto hive = make_component_hive(10000);
+    CountingRegistry counting{*hive.registry};
+    StringArena arena;
+
+    // Entry 21 is the first WDK in the 64-bit root, which is listed first and holds every third entry
+    auto component = WindowsSDK::FindWdkUninstaller("10.0.22002.0", arena, counting);
+    CHECK(component && component->guid == ulib::u8(fixture_guid(21)));
+
+    CHECK(counting.WasOpened(L"HKLM\\" + kUninstallPath + L"\\" + fixture_guid(21)));
+    CHECK(!counting.WasOpened(L"HKLM\\" + kUninstallPath + L"\\" + fixture_guid(24)));
+    CHECK(!counting.WasOpened(L"HKLM\\" + kWowUninstallPath));
+    CHECK(!counting.WasOpened(L"HKCU\\" + kUninstallPath));
+
+    // The root key and entries 0, 3, ..., 21
+    std::printf("    keys opened for the first match: %zu of 10000 entries\n", counting.Opens());
+    CHECK(counting.Opens() == 1 + 8);
+    CHECK(counting.Enumerations() == 1);
+}
+
+VCWIN_TEST(winsdk_probe_lists_each_root_once)
+{
+    auto hive = make_component_hive(10000, 2000);
+    auto rootsPath = std::wstring{L"SOFTWARE\\WOW6432Node\\Microsoft\\Windows Kits\\Installed Roots"};
+    hive.registry->MakeKey(RegistryRoot::LocalMachine, rootsPath + L"\\10.0.22000.0");
+    hive.registry->MakeKey(RegistryRoot::LocalMachine, rootsPath + L"\\10.0.22621.0");
+
+    CountingRegistry counting{*hive.registry};
+    WindowsSDK winsdk{counting};
+
+    size_t sdkComponents = 0, wdkComponents = 0;
+    winsdk.SetComponentObserver([&](ulib::string_view kind, ComponentSource, const WindowsComponent &) {
+        (kind == "sdk" ? sdkComponents : wdkComponents)++;
+    });
+    winsdk.GetSDKs();
+
+    // SDK and WDK classifiers share the one scan
+    CHECK(sdkComponents == hive.sdkComponents);
+    CHECK(wdkComponents == hive.wdkComponents);
+
+    CHECK(counting.Enumerations(L"HKLM\\" + kUninstallPath) == 1);
+    CHECK(counting.Enumerations(L"HKLM\\" + kWowUninstallPath) == 1);
+    CHECK(counting.Enumerations(L"HKCU\\" + kUninstallPath) == 1);
+    CHECK(counting.Enumerations(L"HKLM\\" + kUserDataPath) == 1);
+    for (auto sid : {L"S-1-5-18", L"S-1-5-21-1-1-1-1001", L"S-1-5-21-1-1-1-1002", L"S-1-5-21-1-1-1-1003"})
+        CHECK(counting.Enumerations(L"HKLM\\" + kUserDataPath + L"\\" + sid + L"\\Products") == 1);
+    CHECK(counting.Enumerations(L"HKLM\\" + rootsPath) == 1);
+
+    // Nothing else is listed, and probing again costs nothing
+    CHECK(counting.Enumerations() == 3 + 1 + 4 + 1);
+    counting.Reset();
+    winsdk.GetSDKs();
+    CHECK(counting.Enumerations() == 0 && counting.Opens() == 0);
+}
+
+VCWIN_TEST(snapshot_registry_loads_reg_exports)
+{
+    SnapshotRegistry registry;
+    registry.LoadRegExport("Windows Registry Editor Version 5.00\r\n"
+                           "\r\n"
+                           "[HKEY_LOCAL_MACHINE\\SOFTWARE\\WOW6432Node\\Microsoft\\Microsoft SDKs\\Windows\\v10.0]\r\n"
+                           "\"InstallationFolder\"=\"C:\\\\Program Files (x86)\\\\Windows Kits\\\\10\\\\\"\r\n"
+                           "\"ProductVersion\"=\"10.0.22621\"\r\n"
+                           "\"Flags\"=dword:0000002a\r\n"
+                           "\r\n"
+                           "[-HKEY_LOCAL_MACHINE\\SOFTWARE\\Removed]\r\n");
+
+    // The 32-bit view of SOFTWARE resolves to WOW6432Node, as it does on Windows
+    auto key = registry.OpenKey(RegistryRoot::LocalMachine, L"SOFTWARE\\Microsoft\\Microsoft SDKs\\Windows\\v10.0",
+                                RegistryView::Wow64_32);
+    CHECK(key);
+    CHECK(key->TryGetString(L"InstallationFolder") == L"C:\\Program Files (x86)\\Windows Kits\\10\\");
+    CHECK(key->TryGetString(L"productversion") == L"10.0.22621");
+    CHECK(key->TryGetDword(L"Flags") == 42u);
+    CHECK(!key->TryGetString(L"Flags"));
+
+    CHECK(!registry.OpenKey(RegistryRoot::LocalMachine, L"SOFTWARE\\Removed"));
+}
+
+VCWIN_TEST(snapshot_registry_loads_json_snapshots)
+{
+    SnapshotRegistry registry;
+    registry.LoadJson(ulib::json::parse(R"({"keys": [{"path": "HKLM\\SOFTWARE\\Vendor", "last_write": 42, "values": [
+        {"name": "Name", "type": "sz", "data": "Product"}, {"name": "Count", "type": "dword", "data": 7}]}]})"));
+
+    auto key = registry.OpenKey(RegistryRoot::LocalMachine, L"software\\vendor");
+    CHECK(key);
+    CHECK(key->QueryInfo().lastWriteTime == 42);
+    CHECK(key->TryGetString(L"Name") == L"Product");
+    CHECK(key->TryGetDword(L"Count") == 7u);
+
+    std::vector<RegistryValue> values;
+    key->ReadValues({L"Name", L"Missing", L"Count"}, values);
+    CHECK(values[0].type == RegistryValueType::String && values[0].text == L"Product");
+    CHECK(values[1].type == RegistryValueType::None);
+    CHECK(values[2].type == RegistryValueType::Dword && values[2].number == 7);
+}
@@ -0,0 +1,178 @@
+#include "fixtures.h"
+#include "test.h"
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tool/parallel.h>
+#include <tool/resident.h>
+
+using namespace vcwin;
+using namespace vcwin::tests;
+
+namespace
+{
+    bool contains(const ulib::string &text, std::string_view part)
+    {
+        return std::string_view{text.data(), text.size()}.find(part) != std::string_view::npos;
+    }
+
+    bool is_error(const ulib::string &reply)
+    {
+        return std::string_view{reply.data(), reply.size()}.starts_with("{\"error\":");
+    }
+
+    // The watcher refreshes on its own thread, this gives it a few seconds to get there
+    template <class Fn>
+    bool wait_until(Fn &&done)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+        while (!done())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+
+            std::this_thread::sleep_for(std::chrono::milliseconds{5});
+        }
+
+        return true;
+    }
+
+    // Watch() on a thread of its own, stopped again when the test is done
+    class Watcher
+    {
+    public:
+        Watcher(ResidentState &state, const ResidentWatches &watches)
+            : mThread([&state, &watches, this] { state.Watch(mSource, watches, std::chrono::milliseconds{10}); })
+        {
+        }
+
+        ~Watcher()
+        {
+            mSource.Stop();
+            mThread.join();
+        }
+
+        FakeRegistryChangeSource &Source()
+        {
+            return mSource;
+        }
+
+    private:
+        FakeRegistryChangeSource mSource;
+        std::thread mThread;
+    };
+
+    std::string render_state(const VCTools &vctools, const WindowsSDK &winsdk, const DirectXSdk &dxsdk)
+    {
+        auto environment = StateEnvironment::Make(vctools, winsdk);
+
+        std::string text;
+        {
+            OutputBuffer out{text};
+            JsonEmitter emitter{out};
+            StateDocument{&vctools, &winsdk, &dxsdk, &environment}.Emit(emitter);
+        }
+
+        return text;
+    }
+} // namespace
+
+VCWIN_TEST(resident_watch_rebuilds_only_the_section_of_a_changed_key)
+{
+    auto hive = make_component_hive(300);
+    ResidentState state{*hive.registry};
+
+    ResidentWatches watches;
+    watches.keys = default_registry_watches();
+    Watcher watcher{state, watches};
+
+    // Fixture WDKs cover builds 22000 to 22029, entry 301 brings 22030 into the 64-bit Uninstall key
+    CHECK(!contains(state.State(), "10.0.22030"));
+    auto &entry = hive.registry->MakeKey(RegistryRoot::LocalMachine, kUninstallPath + L"\\" + fixture_guid(301));
+    add_fixture_component(entry, 301, hive);
+    watcher.Source().Post(0);
+
+    CHECK(wait_until([&] { return state.GetRefreshCount(ResidentSection::WindowsSDK) == 2; }));
+    CHECK(contains(state.State(), "10.0.22030"));
+    CHECK(state.GetRefreshCount(ResidentSection::VCTools) == 1);
+    CHECK(state.GetRefreshCount(ResidentSection::DirectX) == 1);
+}
+
+VCWIN_TEST(resident_refresh_runs_on_the_watcher)
+{
+    auto hive = make_component_hive(300);
+    ResidentState state{*hive.registry};
+
+    // Without a watcher there is nothing to run it
+    CHECK(is_error(state.Handle("refresh")));
+
+    ResidentWatches watches;
+    watches.keys = default_registry_watches();
+    Watcher watcher{state, watches};
+
+    // The reply is the current state, the rescan of every section follows on the watcher thread. Until the
+    // watcher has started, refresh is refused as above.
+    ulib::string reply;
+    CHECK(wait_until([&] { return !is_error(reply = state.Handle("refresh")); }));
+    CHECK(contains(reply, "\"winsdk\""));
+
+    CHECK(wait_until([&] {
+        return state.GetRefreshCount(ResidentSection::VCTools) == 2 &&
+               state.GetRefreshCount(ResidentSection::WindowsSDK) == 2 &&
+               state.GetRefreshCount(ResidentSection::DirectX) == 2;
+    }));
+}
+
+VCWIN_TEST(resident_state_is_the_state_document)
+{
+    auto hive = make_component_hive(300);
+    ResidentState state{*hive.registry};
+
+    auto document = state.State();
+    for (auto member : {"\"vctools\":", "\"winsdk\":", "\"dxsdk\":", "\"environment\":"})
+        CHECK(contains(document, member));
+    CHECK(!contains(document, "\"timings_ms\":"));
+
+    auto timed = state.Handle("state --timings");
+    CHECK(contains(timed, "\"timings_ms\":{\"vctools\":"));
+    CHECK(contains(timed, "\"total\":"));
+}
+
+VCWIN_TEST(concurrent_state_probes_write_what_serial_probes_wrote)
+{
+    auto hive = make_component_hive(5000, 1000);
+    auto &registry = *hive.registry;
+
+    std::string serial;
+    {
+        VCTools vctools;
+        WindowsSDK winsdk{registry};
+        winsdk.ProbeAll();
+        DirectXSdk dxsdk{registry};
+        serial = render_state(vctools, winsdk, dxsdk);
+    }
+
+    // As `vcwin state` runs them: every probe on its own thread, the document written once all are done
+    for (size_t round = 0; round != 5; round++)
+    {
+        std::optional<VCTools> vctools;
+        std::optional<WindowsSDK> winsdk;
+        std::optional<DirectXSdk> dxsdk;
+
+        std::function<void()> probes[] = {
+            [&] { vctools.emplace(); },
+            [&] { winsdk.emplace(registry).ProbeAll(); },
+            [&] { dxsdk.emplace(registry); },
+        };
+        parallel_for(std::size(probes), [&](size_t i) { probes[i](); }, std::size(probes));
+
+        CHECK(render_state(*vctools, *winsdk, *dxsdk) == serial);
+    }
+
+    // The resident server probes its sections the same way
+    ResidentState state{registry};
+    CHECK(state.State() == ulib::string{std::string_view{serial}});
+}
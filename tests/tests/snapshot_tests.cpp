@@ -0,0 +1,55 @@
+#include "fixtures.h"
+#include "test.h"
+#include <memory>
+#include <optional>
+#include <string>
+#include <tool/snapshot.h>
+
+using namespace vcwin;
+using namespace vcwin::tests;
+
+namespace
+{
+    size_t count_components(const WindowsSDK &winsdk)
+    {
+        size_t count = 0;
+        for (auto &sdk : winsdk.GetSDKs())
+        {
+            count += sdk.sdkUninstallComponents.size() + sdk.sdkInstallerComponents.size();
+            count += sdk.wdkUninstallComponents.size() + sdk.wdkInstallerComponents.size();
+        }
+
+        return count;
+    }
+} // namespace
+
+VCWIN_TEST(state_snapshot_of_5k_components_loads_back)
+{
+    // A fifth of the fixture entries are SDK or WDK components. The model files one version per build, so a bit
+    // over half of those end up in it.
+    auto hive = make_component_hive(45000);
+
+    VCTools vctools;
+    WindowsSDK winsdk{*hive.registry};
+    DirectXSdk dxsdk{*hive.registry};
+
+    TempDir dir{"snapshot"};
+    auto path = dir.Path() / "state.vcsnap";
+    StateSnapshot::Write(path, vctools, winsdk, dxsdk);
+
+    size_t components = count_components(winsdk);
+    CHECK(components >= 5000);
+
+    std::shared_ptr<const StateSnapshot> snapshot;
+    std::optional<WindowsSDK> loaded;
+    {
+        ScopedTimer timer{"StateSnapshot::Open and Load*, " + std::to_string(components) + " components"};
+        snapshot = StateSnapshot::Open(path);
+        snapshot->LoadVCTools();
+        snapshot->LoadDirectXSdk();
+        loaded.emplace(snapshot->LoadWindowsSDK());
+    }
+
+    CHECK(count_components(*loaded) == components);
+    CHECK(loaded->ToJson().dump() == winsdk.ToJson().dump());
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Just enough of a test harness for vcwin: cases register themselves and main.cpp runs them. Cases that double as
+// benchmarks print their timings with ScopedTimer. Nothing here needs Windows, the registry comes from a
+// SnapshotRegistry and the file system from fixture trees.
+
+namespace vcwin::tests
+{
+    struct TestCase
+    {
+        const char *name;
+        void (*run)();
+    };
+
+    inline std::vector<TestCase> &test_cases()
+    {
+        static std::vector<TestCase> cases;
+        return cases;
+    }
+
+    struct TestRegistrar
+    {
+        TestRegistrar(const char *name, void (*run)())
+        {
+            test_cases().push_back({name, run});
+        }
+    };
+
+    struct TestFailure : std::runtime_error
+    {
+        using std::runtime_error::runtime_error;
+    };
+
+    inline void fail(const char *file, int line, std::string_view what)
+    {
+        throw TestFailure{std::string{file} + ":" + std::to_string(line) + ": " + std::string{what}};
+    }
+
+    // Prints the time between construction and destruction under `label`
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(std::string label) : mLabel(std::move(label)), mStart(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~ScopedTimer()
+        {
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - mStart;
+            std::printf("    %s: %.3f ms\n", mLabel.c_str(), elapsed.count());
+        }
+
+    private:
+        std::string mLabel;
+        std::chrono::steady_clock::time_point mStart;
+    };
+} // namespace vcwin::tests
+
+#define VCWIN_TEST(name)                                                                                               \
+    static void name();                                                                                                \
+    static ::vcwin::tests::TestRegistrar name##_registrar{#name, name};                                                \
+    static void name()
+
+#define CHECK(cond)                                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+            ::vcwin::tests::fail(__FILE__, __LINE__, #cond);                                                           \
+    } while (false)
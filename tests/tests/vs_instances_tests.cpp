@@ -0,0 +1,156 @@
+#include "fixtures.h"
+#include "test.h"
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <tool/vctools.h>
+#include <tool/vs_instances.h>
+
+using namespace vcwin;
+using namespace vcwin::tests;
+
+namespace
+{
+    void write_state(const fs::path &instancesDir, std::string_view id, std::string_view json)
+    {
+        fs::create_directories(instancesDir / id);
+        std::ofstream{instancesDir / id / "state.json", std::ios::binary}.write(json.data(), json.size());
+    }
+
+    // The fields vcwin reads come first, as the installer writes them, then `packages` entries of package list
+    std::string state_json(std::string_view version, std::string_view date, std::string_view extra = {},
+                           size_t packages = 0)
+    {
+        std::string json = "{\"installationName\": \"VisualStudio/" + std::string{version} + "\",\r\n";
+        json += "\"installationPath\": \"C:\\\\VS\\\\" + std::string{version} + "\",\r\n";
+        json += "\"installationVersion\": \"" + std::string{version} + "\",\r\n";
+        json += "\"installDate\": \"" + std::string{date} + "\",\r\n";
+        json += extra;
+        json += "\"packages\": [";
+        for (size_t i = 0; i != packages; i++)
+        {
+            json += i ? ",\r\n" : "\r\n";
+            json += "{\"id\": \"Microsoft.VisualStudio.Component.Fixture" + std::to_string(i) +
+                    "\", \"version\": \"17.0." + std::to_string(i) + "\", \"chip\": \"x64\", \"language\": \"en-US\"}";
+        }
+        json += "]}";
+        return json;
+    }
+
+    // An instance installed under `root`/<id> with VC/Tools/MSVC/<version>/bin/Host<host>/<target> for each toolset
+    void write_instance_with_toolsets(const fs::path &root, std::string_view id, std::string_view version,
+                                      std::initializer_list<std::string_view> toolsets, std::string_view target = "x64")
+    {
+        auto installationPath = root / id;
+        for (auto toolset : toolsets)
+            fs::create_directories(installationPath / "VC/Tools/MSVC" / toolset / "bin/Hostx64" / target);
+
+        std::string path;
+        for (char c : installationPath.string())
+        {
+            if (c == '\\' || c == '"')
+                path += '\\';
+            path += c;
+        }
+
+        write_state(root / "_Instances", id,
+                    "{\"installationPath\": \"" + path + "\", \"installationVersion\": \"" + std::string{version} +
+                        "\", \"installDate\": \"2024-05-01T10:00:00Z\"}");
+    }
+} // namespace
+
+VCWIN_TEST(vs_instances_skip_incomplete_and_broken_instances)
+{
+    TempDir dir{"vs-instances"};
+    write_state(dir.Path(), "a1", state_json("17.9.34607.119", "2024-03-01T10:00:00Z"));
+    write_state(dir.Path(), "b2", state_json("17.10.35004.147", "2024-06-01T10:00:00Z", "\"isComplete\": false,\r\n"));
+    write_state(dir.Path(), "c3", state_json("17.11.35208.52", "2024-09-01T10:00:00Z", "\"installState\": 3,\r\n"));
+    write_state(dir.Path(), "d4", "{\"installationPath\": \"C:\\\\VS\\\\cut");
+    write_state(dir.Path(), "e5", state_json("17.8.34525.116", "2024-01-01T10:00:00Z",
+                                             "\"isComplete\": true, \"installState\": 4294967295,\r\n"));
+
+    auto instances = read_vs_instances(dir.Path());
+    CHECK(instances.size() == 2);
+    CHECK(instances[0].instanceId == "a1");
+    CHECK(instances[1].instanceId == "e5");
+
+    auto latest = find_latest_vs_instance(instances);
+    CHECK(latest && latest->instanceId == "a1");
+
+    // A list from elsewhere may still carry one, it is never the latest
+    auto incomplete = instances[0];
+    incomplete.instanceId = "z9";
+    incomplete.installationVersion = "18.0.0.0";
+    incomplete.isComplete = false;
+    instances.push_back(incomplete);
+
+    latest = find_latest_vs_instance(instances);
+    CHECK(latest && latest->instanceId == "a1");
+}
+
+VCWIN_TEST(vs_instances_read_state_files_with_a_bom)
+{
+    TempDir dir{"vs-instances-bom"};
+    write_state(dir.Path(), "a1", "\xEF\xBB\xBF" + state_json("17.9.34607.119", "2024-03-01T10:00:00Z"));
+
+    auto instances = read_vs_instances(dir.Path());
+    CHECK(instances.size() == 1);
+    CHECK(instances[0].installationVersion == "17.9.34607.119");
+    CHECK(instances[0].installationPath == fs::path{"C:\\VS\\17.9.34607.119"});
+}
+
+VCWIN_TEST(vs_instances_pick_the_latest_by_version_then_date)
+{
+    TempDir dir{"vs-instances-latest"};
+    write_state(dir.Path(), "a1", state_json("17.9.5", "2024-05-01T10:00:00Z"));
+    write_state(dir.Path(), "b2", state_json("17.10.0", "2024-02-01T10:00:00Z"));
+    write_state(dir.Path(), "c3", state_json("17.10.0", "2024-03-01T10:00:00Z"));
+
+    auto latest = find_latest_vs_instance(read_vs_instances(dir.Path()));
+    CHECK(latest && latest->instanceId == "c3");
+}
+
+VCWIN_TEST(vs_instances_read_large_state_files)
+{
+    // Real state.json files list every installed package, hundreds of kilobytes each
+    TempDir dir{"vs-instances-large"};
+    for (size_t i = 0; i != 20; i++)
+        write_state(dir.Path(), "i" + std::to_string(i), state_json("17.9." + std::to_string(i), "2024", {}, 3000));
+
+    ulib::list<VSInstance> instances;
+    {
+        ScopedTimer timer{"read_vs_instances, 20 state.json files of 3000 packages"};
+        instances = read_vs_instances(dir.Path());
+    }
+
+    CHECK(instances.size() == 20);
+}
+
+VCWIN_TEST(vc_toolsets_match_a_version_prefix_only_at_a_dot)
+{
+    TempDir dir{"vc-toolsets"};
+    write_instance_with_toolsets(dir.Path(), "a1", "17.9.5", {"14.38.33130", "14.39.33519", "14.3.12345"});
+    write_instance_with_toolsets(dir.Path(), "b2", "17.8.0", {"14.38.33133", "14.30.30705"}, "arm64");
+
+    VCTools vctools{dir.Path() / "_Instances"};
+    auto version = [&](ulib::string_view wanted, ulib::string_view host = {}, ulib::string_view target = {}) {
+        auto toolset = vctools.FindToolset(wanted, host, target);
+        return toolset ? toolset->version : ulib::string{};
+    };
+
+    CHECK(version({}) == "14.39.33519");
+    CHECK(version("14") == "14.39.33519");
+
+    // "14.3" names 14.3.x, never 14.30 or 14.38 which only share its digits
+    CHECK(version("14.3") == "14.3.12345");
+    CHECK(version("14.38") == "14.38.33133");
+    CHECK(version("14.38.33130") == "14.38.33130");
+    CHECK(version("14.38.3").empty());
+    CHECK(version("14.38.33").empty());
+    CHECK(version("14.4").empty());
+
+    CHECK(version("14.38", "x64", "x64") == "14.38.33130");
+    CHECK(version("14.38", "x64", "arm64") == "14.38.33133");
+    CHECK(version("14.3", "x64", "arm64").empty());
+    CHECK(version({}, "x86").empty());
+}
@@ -0,0 +1,259 @@
+#include "counting_registry.h"
+#include "fixtures.h"
+#include "test.h"
+#include <cstdio>
+#include <string>
+#include <tool/query.h>
+#include <tool/winsdk.h>
+
+using namespace vcwin;
+using namespace vcwin::tests;
+
+namespace
+{
+    // The component hive plus Installed Roots entries: a build the components also have, one they do not and a
+    // name that is not a version
+    ComponentHive make_sdk_hive(size_t uninstallCount, size_t installerCount = 0)
+    {
+        auto hive = make_component_hive(uninstallCount, installerCount);
+
+        std::wstring rootsPath = L"SOFTWARE\\WOW6432Node\\Microsoft\\Windows Kits\\Installed Roots";
+        for (auto name : {L"10.0.22000.0", L"10.0.30000.0", L"Kits Preview"})
+            hive.registry->MakeKey(RegistryRoot::LocalMachine, rootsPath + L"\\" + name);
+
+        return hive;
+    }
+
+    // FindSDKByWDKVersion() as it was before the index: the first item whose first WDK uninstaller has the version
+    const WindowsSDKItem *find_sdk_by_wdk_version_linear(const WindowsSDK &winsdk, ulib::string_view wdkVersion)
+    {
+        for (auto &sdk : winsdk.GetSDKs())
+        {
+            if (sdk.wdkUninstallComponents.size() > 0)
+            {
+                if (sdk.wdkUninstallComponents.front().DisplayVersion == wdkVersion)
+                    return &sdk;
+            }
+        }
+
+        return nullptr;
+    }
+
+    // The newest item with an SDK, of all items in the model, that satisfies the build bounds and the WDK term
+    const WindowsSDKItem *resolve_sdk_query_linear(const WindowsSDK &winsdk, const SDKQuery &query)
+    {
+        const WindowsSDKItem *best = nullptr;
+        uint64_t bestBuild = 0;
+
+        for (auto &sdk : winsdk.GetSDKs())
+        {
+            auto &name = sdk.windowsBuildVersion;
+            auto key = wversion::parse_key(std::string_view{name.data(), name.size()});
+            if (!key)
+                continue;
+
+            auto build = wversion::build_id(*key);
+            bool matches = true;
+            for (auto &c : query.build)
+                matches = matches && c.Matches(build);
+
+            matches = matches && (sdk.inInstalledRoots || sdk.sdkUninstallComponents.size() > 0);
+            matches = matches && (!query.requireWDK || sdk.wdkUninstallComponents.size() > 0 || sdk.hasWDKInOptions);
+
+            if (matches && (!best || build > bestBuild))
+            {
+                best = &sdk;
+                bestBuild = build;
+            }
+        }
+
+        return best;
+    }
+
+    ulib::string resolved_version(const WindowsSDK &winsdk, ulib::string_view text)
+    {
+        auto result = resolve_sdk_query(winsdk, SDKQuery::Parse(text));
+        return result.sdk ? result.sdk->windowsBuildVersion : ulib::string{};
+    }
+} // namespace
+
+VCWIN_TEST(sdk_index_finds_what_the_linear_search_found)
+{
+    auto hive = make_sdk_hive(10000, 2000);
+    WindowsSDK winsdk{*hive.registry};
+
+    // The old MakeSDKItem compared names, so every name has exactly one item and the index hands back that item
+    auto &sdks = winsdk.GetSDKs();
+    CHECK(sdks.size() == 40 + 2);
+    for (auto &sdk : sdks)
+    {
+        size_t sameName = 0;
+        for (auto &other : sdks)
+            sameName += other.windowsBuildVersion == sdk.windowsBuildVersion;
+
+        CHECK(sameName == 1);
+        CHECK(winsdk.FindSDKItem(sdk.windowsBuildVersion) == &sdk);
+    }
+
+    CHECK(winsdk.FindSDKItem("10.0.30000.0") && winsdk.FindSDKItem("10.0.30000.0")->inInstalledRoots);
+    CHECK(winsdk.FindSDKItem("Kits Preview") && winsdk.FindSDKItem("Kits Preview")->inInstalledRoots);
+    CHECK(!winsdk.FindSDKItem("10.0.30001.0"));
+    CHECK(!winsdk.FindSDKItem("Kits"));
+
+    // WDK versions of every build, SDK versions that share a build with a WDK, and builds nobody has
+    std::vector<ulib::string> queries;
+    for (size_t build = 21990; build != 22050; build++)
+    {
+        for (auto qfe : {"0", "3", "6"})
+            queries.push_back(ulib::format("10.0.{}.{}", build, qfe));
+    }
+    queries.push_back("10.0.30000.0");
+    queries.push_back("Kits Preview");
+    queries.push_back("");
+
+    size_t found = 0;
+    for (auto &query : queries)
+    {
+        auto sdk = winsdk.FindSDKByWDKVersion(query);
+        CHECK(sdk == find_sdk_by_wdk_version_linear(winsdk, query));
+        found += sdk != nullptr;
+    }
+
+    CHECK(found == 40);
+
+    const size_t rounds = 1000;
+    size_t hits = 0;
+    {
+        ScopedTimer timer{"linear FindSDKByWDKVersion, " + std::to_string(rounds * queries.size()) + " lookups"};
+        for (size_t i = 0; i != rounds; i++)
+        {
+            for (auto &query : queries)
+                hits += find_sdk_by_wdk_version_linear(winsdk, query) != nullptr;
+        }
+    }
+    {
+        ScopedTimer timer{"indexed FindSDKByWDKVersion, " + std::to_string(rounds * queries.size()) + " lookups"};
+        for (size_t i = 0; i != rounds; i++)
+        {
+            for (auto &query : queries)
+                hits += winsdk.FindSDKByWDKVersion(query) != nullptr;
+        }
+    }
+
+    CHECK(hits == 2 * rounds * found);
+}
+
+VCWIN_TEST(sdk_query_resolves_prefixes_and_ranges)
+{
+    auto hive = make_sdk_hive(10000);
+    WindowsSDK winsdk{*hive.registry};
+
+    // Components cover builds 22000 to 22039, each with an SDK and a WDK; 30000 is only in Installed Roots
+    CHECK(resolved_version(winsdk, "") == "10.0.30000.0");
+    CHECK(resolved_version(winsdk, "wdk") == "10.0.22039.0");
+
+    // A version with fewer parts, or another QFE, names the whole build
+    CHECK(resolved_version(winsdk, "10.0.22010") == "10.0.22010.0");
+    CHECK(resolved_version(winsdk, "=10.0.22010.999") == "10.0.22010.0");
+    CHECK(resolved_version(winsdk, "sdk==10.0.22010.3") == "10.0.22010.0");
+    CHECK(resolved_version(winsdk, "<=10.0.22020.5") == "10.0.22020.0");
+    CHECK(resolved_version(winsdk, "10.0.22040").empty());
+
+    // Bounds of both kinds, however the terms are separated
+    CHECK(resolved_version(winsdk, ">=10.0.22010 <10.0.22020") == "10.0.22019.0");
+    CHECK(resolved_version(winsdk, ">10.0.22005,<10.0.22007") == "10.0.22006.0");
+    CHECK(resolved_version(winsdk, ">=10.0.22005, <=10.0.22005 wdk") == "10.0.22005.0");
+    CHECK(resolved_version(winsdk, ">10.0.22039") == "10.0.30000.0");
+    CHECK(resolved_version(winsdk, ">10.0.22039 wdk").empty());
+    CHECK(resolved_version(winsdk, ">10.0.22010 <10.0.22011").empty());
+    CHECK(resolved_version(winsdk, "<10.0.22000").empty());
+
+    bool threw = false;
+    try
+    {
+        SDKQuery::Parse(">=10.0.x");
+    }
+    catch (const std::exception &)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+
+    // Every bound pair over the builds around the model, against a scan of all items
+    size_t queries = 0;
+    for (size_t low = 21998; low < 22042; low += 3)
+    {
+        for (size_t high = low; high < 22042; high += 4)
+        {
+            for (auto [lowOp, highOp] : {std::pair{">=", "<="}, std::pair{">", "<"}, std::pair{">=", "<"}})
+            {
+                auto query = SDKQuery::Parse(ulib::format("{}10.0.{} {}10.0.{}", lowOp, low, highOp, high));
+                for (bool wdk : {false, true})
+                {
+                    query.requireWDK = wdk;
+                    CHECK(resolve_sdk_query(winsdk, query).sdk == resolve_sdk_query_linear(winsdk, query));
+                    queries++;
+                }
+            }
+        }
+    }
+
+    std::printf("    bound queries checked against the linear scan: %zu\n", queries);
+}
+
+VCWIN_TEST(winsdk_probes_only_the_sections_asked_for)
+{
+    auto hive = make_sdk_hive(10000, 2000);
+    TempDir kit{"winsdk-sections"};
+
+    std::wstring infoPath = L"SOFTWARE\\WOW6432Node\\Microsoft\\Microsoft SDKs\\Windows\\v10.0";
+    std::wstring wdkPath = L"SOFTWARE\\WOW6432Node\\Microsoft\\Windows Kits\\WDK";
+    hive.registry->SetString(RegistryRoot::LocalMachine, infoPath, L"InstallationFolder", kit.Path().wstring());
+    hive.registry->SetString(RegistryRoot::LocalMachine, infoPath, L"ProductVersion", L"10.0.22621");
+    hive.registry->SetString(RegistryRoot::LocalMachine, infoPath, L"ProductName", L"Microsoft Windows SDK");
+    hive.registry->SetString(RegistryRoot::LocalMachine, wdkPath, L"WDKProductVersion10", L"10.0.22621.0");
+
+    CountingRegistry counting{*hive.registry};
+    {
+        WindowsSDK winsdk{counting};
+        CHECK(counting.Opens() == 0);
+
+        CHECK(winsdk.GetWDKProductVersion10() == ulib::string{"10.0.22621.0"});
+        CHECK(counting.Opens() == 1 && counting.WasOpened(L"HKLM\\" + wdkPath));
+
+        CHECK(winsdk.GetWindows10SdkInfo() && winsdk.GetWindows10SdkInfo()->version == "10.0.22621");
+        CHECK(counting.Opens() == 2 && counting.WasOpened(L"HKLM\\" + infoPath));
+
+        // KMDF reads the kit directory the Info section already found
+        CHECK(winsdk.GetKMDFVersions().size() == 0);
+        CHECK(counting.Opens() == 2);
+
+        // The components were never asked for, so neither their roots nor Installed Roots were touched
+        CHECK(counting.Enumerations() == 0);
+        CHECK(!counting.WasOpened(L"HKLM\\" + kUninstallPath));
+        CHECK(!counting.WasOpened(L"HKLM\\" + kUserDataPath));
+        CHECK(!winsdk.HasItems());
+
+        CHECK(winsdk.GetSDKs().size() != 0);
+        CHECK(winsdk.HasItems());
+        CHECK(counting.Enumerations() != 0);
+
+        // Every section is read once, however often it is asked for
+        counting.Reset();
+        winsdk.GetSDKs();
+        winsdk.GetWDKProductVersion10();
+        winsdk.GetWindows10SdkInfo();
+        winsdk.GetKMDFVersions();
+        CHECK(counting.Opens() == 0 && counting.ValueCalls() == 0 && counting.Enumerations() == 0);
+    }
+
+    // KMDF alone pulls in the Info section and nothing else
+    counting.Reset();
+    {
+        WindowsSDK winsdk{counting};
+        winsdk.GetKMDFVersions();
+        CHECK(counting.Opens() == 1 && counting.WasOpened(L"HKLM\\" + infoPath));
+        CHECK(!counting.WasOpened(L"HKLM\\" + wdkPath));
+        CHECK(counting.Enumerations() == 0);
+    }
+}
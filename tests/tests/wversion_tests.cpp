@@ -0,0 +1,125 @@
+#include "test.h"
+#include <charconv>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <tool/winsdk.h>
+
+using namespace vcwin;
+using namespace vcwin::tests;
+
+namespace
+{
+    // The rules parse_key follows, written the slow way: three or four dot-separated decimal parts of 16 bits
+    std::optional<uint64_t> reference_key(std::string_view ver)
+    {
+        uint32_t parts[4] = {};
+        size_t count = 0;
+
+        while (true)
+        {
+            size_t dot = ver.find('.');
+            auto part = ver.substr(0, dot);
+
+            if (count == 4 || part.empty() || part.find_first_not_of("0123456789") != std::string_view::npos)
+                return std::nullopt;
+
+            uint64_t value = 0;
+            auto [end, ec] = std::from_chars(part.data(), part.data() + part.size(), value);
+            if (ec != std::errc{} || value > 0xFFFF)
+                return std::nullopt;
+
+            parts[count++] = uint32_t(value);
+
+            if (dot == std::string_view::npos)
+                break;
+
+            ver.remove_prefix(dot + 1);
+        }
+
+        if (count < 3)
+            return std::nullopt;
+
+        return wversion::make_key(parts[0], parts[1], parts[2], parts[3]);
+    }
+} // namespace
+
+VCWIN_TEST(wversion_parse_key_rejects_malformed_versions)
+{
+    const char *malformed[] = {
+        "",
+        ".",
+        "...",
+        "10",
+        "10.0",
+        "10.0.",
+        ".10.0.1",
+        "10..0.1",
+        "10.0.22621.",
+        "10.0.22621.2428.",
+        "10.0.22621.2428.1",
+        " 10.0.22621",
+        "10.0.22621 ",
+        "+10.0.22621",
+        "-10.0.22621",
+        "10.0.-1",
+        "10,0,22621",
+        "10.0.0x10",
+        "10.0.22621a",
+        "10.0.65536",
+        "10.0.99999999999999999999",
+        "10.0.4294967296",
+        "v10.0.22621.0",
+        "10.0.2262\xD9\xA1",
+    };
+
+    for (auto ver : malformed)
+    {
+        if (wversion::parse_key(ver))
+            fail(__FILE__, __LINE__, std::string{"parse_key accepted \""} + ver + "\"");
+    }
+
+    // An embedded NUL ends nothing, it is one more character that is not a digit
+    CHECK(!wversion::parse_key(std::string_view{"10.0.22621\0.1", 13}));
+
+    // Bounds and leading zeros are still numbers
+    CHECK(wversion::parse_key("65535.65535.65535.65535") == wversion::make_key(0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF));
+    CHECK(wversion::parse_key("010.00.022621.0002428") == wversion::parse_key("10.0.22621.2428"));
+    CHECK(wversion::parse_key("0.0.0") == 0u);
+}
+
+VCWIN_TEST(wversion_parse_leaves_malformed_versions_zero)
+{
+    auto wv = wversion::parse("10.0.x");
+    CHECK(wv.source == "10.0.x");
+    CHECK(wv.win == 0 && wv.mark == 0 && wv.build == 0 && wv.qfe == 0);
+
+    CHECK(!wversion::try_parse("10.0.22621.2428.1"));
+    CHECK(wversion::to_windows_build("not a version") == "0.0.0.0");
+    CHECK(wversion::build_number("10.0.65536") == 0);
+}
+
+VCWIN_TEST(wversion_parse_key_matches_the_reference_on_random_input)
+{
+    // Short strings over digits, dots and a few strays hit every branch of the parser many times over
+    constexpr std::string_view alphabet = "0123456789....x -";
+    std::mt19937 random{14};
+
+    size_t accepted = 0;
+    for (size_t n = 0; n != 200000; n++)
+    {
+        std::string ver(random() % 16, ' ');
+        for (auto &c : ver)
+            c = alphabet[random() % alphabet.size()];
+
+        auto key = wversion::parse_key(ver);
+        if (key != reference_key(ver))
+            fail(__FILE__, __LINE__, "parse_key disagrees with the reference on \"" + ver + "\"");
+
+        accepted += key.has_value();
+    }
+
+    // Make sure the input was not all garbage
+    CHECK(accepted > 1000);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "dxsdk.h"
+#include "vctools.h"
+#include "winsdk.h"
+#include <functional>
+#include <istream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vcwin
+{
+    namespace detail
+    {
+        // Splits a batch line into arguments at spaces and tabs, "double quotes" keep spaces within one argument
+        inline std::vector<std::string> split_command_line(std::string_view line)
+        {
+            std::vector<std::string> args;
+
+            std::string arg;
+            bool inArg = false;
+            bool quoted = false;
+            for (char c : line)
+            {
+                if (c == '"')
+                {
+                    quoted = !quoted;
+                    inArg = true;
+                }
+                else if (!quoted && (c == ' ' || c == '\t' || c == '\r' || c == '\n'))
+                {
+                    if (inArg)
+                        args.push_back(std::move(arg));
+
+                    arg.clear();
+                    inArg = false;
+                }
+                else
+                {
+                    arg += c;
+                    inArg = true;
+                }
+            }
+
+            if (inArg)
+                args.push_back(std::move(arg));
+
+            return args;
+        }
+    } // namespace detail
+
+    // The models the commands of one process share, each made on first use, so all commands of a batch share one
+    // probe pass. Different models may be made from different threads at once, the same one may not.
+    class ModelCache
+    {
+    public:
+        ModelCache(std::function<VCTools()> makeVCTools, std::function<WindowsSDK()> makeWindowsSDK,
+                   std::function<DirectXSdk()> makeDirectXSdk)
+            : mMakeVCTools(std::move(makeVCTools)), mMakeWindowsSDK(std::move(makeWindowsSDK)),
+              mMakeDirectXSdk(std::move(makeDirectXSdk))
+        {
+        }
+
+        const VCTools &GetVCTools()
+        {
+            if (!mVCTools)
+                mVCTools.emplace(mMakeVCTools());
+
+            return *mVCTools;
+        }
+
+        WindowsSDK &GetWindowsSDK()
+        {
+            if (!mWindowsSDK)
+                mWindowsSDK.emplace(mMakeWindowsSDK());
+
+            return *mWindowsSDK;
+        }
+
+        const DirectXSdk &GetDirectXSdk()
+        {
+            if (!mDirectXSdk)
+                mDirectXSdk.emplace(mMakeDirectXSdk());
+
+            return *mDirectXSdk;
+        }
+
+        // The next use probes again
+        void Reset()
+        {
+            mVCTools.reset();
+            mWindowsSDK.reset();
+            mDirectXSdk.reset();
+        }
+
+    private:
+        std::function<VCTools()> mMakeVCTools;
+        std::function<WindowsSDK()> mMakeWindowsSDK;
+        std::function<DirectXSdk()> mMakeDirectXSdk;
+
+        std::optional<VCTools> mVCTools;
+        std::optional<WindowsSDK> mWindowsSDK;
+        std::optional<DirectXSdk> mDirectXSdk;
+    };
+
+    // Installs and uninstalls change what the models describe
+    inline bool batch_command_changes_models(std::string_view command)
+    {
+        return command == "install" || command == "uninstall" || command == "remove";
+    }
+
+    // Runs one command per line of `input`, skipping empty lines and lines starting with #. `run` gets the split
+    // arguments and the line and returns the exit code, `resetModels` is called after every command that changes
+    // what the models describe. Returns false if any command failed, the rest of the batch still runs.
+    inline bool run_batch(std::istream &input,
+                          const std::function<int(const std::vector<std::string> &args, std::string_view line)> &run,
+                          const std::function<void()> &resetModels)
+    {
+        bool failed = false;
+
+        std::string line;
+        while (std::getline(input, line))
+        {
+            if (line.ends_with('\r'))
+                line.pop_back();
+
+            auto args = detail::split_command_line(line);
+            if (args.empty() || args.front().starts_with('#'))
+                continue;
+
+            failed |= run(args, line) != 0;
+
+            if (batch_command_changes_models(args.front()))
+                resetModels();
+        }
+
+        return !failed;
+    }
+} // namespace vcwin
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Reader for `vcwin --format cbor` output. It needs nothing but the standard library, so consumers can take this
+// one file as it is. The documents carry the same members as the JSON output: objects become maps with text keys,
+// strings are UTF-8 text and missing values are null.
+
+namespace vcwin
+{
+    struct CborValue
+    {
+        enum class Kind : uint8_t
+        {
+            Null,
+            Bool,
+            Int,
+            Double,
+            String,
+            Array,
+            Map,
+        };
+
+        Kind kind = Kind::Null;
+        bool boolean = false;
+        int64_t integer = 0;
+        double number = 0;
+        std::string string;
+        std::vector<CborValue> items;
+        std::vector<std::pair<std::string, CborValue>> members;
+
+        bool IsNull() const
+        {
+            return kind == Kind::Null;
+        }
+
+        // Member of a map, nullptr if there is none or this is not a map
+        const CborValue *Find(std::string_view key) const
+        {
+            for (auto &member : members)
+            {
+                if (member.first == key)
+                    return &member.second;
+            }
+
+            return nullptr;
+        }
+    };
+
+    // Reads one document after another from a buffer. Read() returns false on malformed or truncated input.
+    class CborReader
+    {
+    public:
+        CborReader(std::string_view data) : mData(data)
+        {
+        }
+
+        bool AtEnd() const
+        {
+            return mPos == mData.size();
+        }
+
+        bool Read(CborValue &out)
+        {
+            out = CborValue{};
+            return ReadItem(out, 0);
+        }
+
+    private:
+        static constexpr size_t kMaxDepth = 256;
+        static constexpr uint8_t kIndefinite = 31;
+
+        bool ReadByte(uint8_t &byte)
+        {
+            if (mPos == mData.size())
+                return false;
+
+            byte = uint8_t(mData[mPos++]);
+            return true;
+        }
+
+        bool ReadBigEndian(size_t size, uint64_t &value)
+        {
+            if (mData.size() - mPos < size)
+                return false;
+
+            value = 0;
+            for (size_t i = 0; i != size; i++)
+                value = (value << 8) | uint8_t(mData[mPos++]);
+
+            return true;
+        }
+
+        // Initial byte and argument of an item. `info` is kIndefinite for indefinite lengths and breaks.
+        bool ReadHead(uint8_t &major, uint8_t &info, uint64_t &argument)
+        {
+            uint8_t initial;
+            if (!ReadByte(initial))
+                return false;
+
+            major = initial >> 5;
+            info = initial & 0x1F;
+            argument = info;
+
+            if (info < 24 || info == kIndefinite)
+                return true;
+
+            if (info > 27)
+                return false;
+
+            return ReadBigEndian(size_t(1) << (info - 24), argument);
+        }
+
+        bool AtBreak() const
+        {
+            return mPos != mData.size() && uint8_t(mData[mPos]) == 0xFF;
+        }
+
+        // Byte and text strings, definite or in chunks
+        bool ReadString(uint8_t major, uint8_t info, uint64_t length, std::string &out)
+        {
+            if (info != kIndefinite)
+            {
+                if (length > mData.size() - mPos)
+                    return false;
+
+                out.append(mData.data() + mPos, size_t(length));
+                mPos += size_t(length);
+                return true;
+            }
+
+            while (!AtBreak())
+            {
+                uint8_t chunkMajor, chunkInfo;
+                uint64_t chunkLength;
+                if (!ReadHead(chunkMajor, chunkInfo, chunkLength) || chunkMajor != major || chunkInfo == kIndefinite)
+                    return false;
+
+                if (!ReadString(major, chunkInfo, chunkLength, out))
+                    return false;
+            }
+
+            mPos++;
+            return true;
+        }
+
+        static double HalfToDouble(uint16_t half)
+        {
+            int exponent = (half >> 10) & 0x1F;
+            double mantissa = half & 0x3FF;
+
+            double value;
+            if (exponent == 0)
+                value = std::ldexp(mantissa, -24);
+            else if (exponent != 31)
+                value = std::ldexp(mantissa + 1024, exponent - 25);
+            else
+                value = mantissa == 0 ? INFINITY : NAN;
+
+            return half & 0x8000 ? -value : value;
+        }
+
+        bool ReadItem(CborValue &out, size_t depth)
+        {
+            if (depth == kMaxDepth)
+                return false;
+
+            uint8_t major, info;
+            uint64_t argument;
+            if (!ReadHead(major, info, argument))
+                return false;
+
+            switch (major)
+            {
+            case 0:
+                if (argument > uint64_t(INT64_MAX))
+                    return false;
+
+                out.kind = CborValue::Kind::Int;
+                out.integer = int64_t(argument);
+                return true;
+            case 1:
+                if (argument > uint64_t(INT64_MAX))
+                    return false;
+
+                out.kind = CborValue::Kind::Int;
+                out.integer = -1 - int64_t(argument);
+                return true;
+            case 2:
+            case 3:
+                out.kind = CborValue::Kind::String;
+                return ReadString(major, info, argument, out.string);
+            case 4:
+                out.kind = CborValue::Kind::Array;
+                for (uint64_t i = 0; info == kIndefinite ? !AtBreak() : i != argument; i++)
+                {
+                    if (!ReadItem(out.items.emplace_back(), depth + 1))
+                        return false;
+                }
+
+                if (info == kIndefinite)
+                    mPos++;
+                return true;
+            case 5:
+                out.kind = CborValue::Kind::Map;
+                for (uint64_t i = 0; info == kIndefinite ? !AtBreak() : i != argument; i++)
+                {
+                    auto &member = out.members.emplace_back();
+
+                    // Keys are always text in vcwin output
+                    CborValue key;
+                    if (!ReadItem(key, depth + 1) || key.kind != CborValue::Kind::String)
+                        return false;
+
+                    member.first = std::move(key.string);
+                    if (!ReadItem(member.second, depth + 1))
+                        return false;
+                }
+
+                if (info == kIndefinite)
+                    mPos++;
+                return true;
+            case 6:
+                // Tags, such as the self-describe tag in front of each document, carry nothing vcwin needs
+                return ReadItem(out, depth + 1);
+            default:
+                break;
+            }
+
+            switch (info)
+            {
+            case 20:
+            case 21:
+                out.kind = CborValue::Kind::Bool;
+                out.boolean = info == 21;
+                return true;
+            case 22:
+            case 23:
+                out.kind = CborValue::Kind::Null;
+                return true;
+            case 25:
+                out.kind = CborValue::Kind::Double;
+                out.number = HalfToDouble(uint16_t(argument));
+                return true;
+            case 26: {
+                uint32_t bits = uint32_t(argument);
+                float number;
+                std::memcpy(&number, &bits, sizeof(number));
+
+                out.kind = CborValue::Kind::Double;
+                out.number = number;
+                return true;
+            }
+            case 27:
+                out.kind = CborValue::Kind::Double;
+                std::memcpy(&out.number, &argument, sizeof(out.number));
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        std::string_view mData;
+        size_t mPos = 0;
+    };
+} // namespace vcwin
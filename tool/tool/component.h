@@ -0,0 +1,17 @@
+#pragma once
+
+#include "string_arena.h"
+#include <ulib/string.h>
+
+namespace vcwin
+{
+    // Strings point into the StringArena of the scan that produced the component
+    struct WindowsComponent
+    {
+        ulib::string_view DisplayName;
+        ulib::string_view DisplayVersion;
+        ulib::string_view UninstallString;
+        bool SystemComponent;
+        ulib::string_view guid;
+    };
+} // namespace vcwin
@@ -0,0 +1,256 @@
+#pragma once
+
+#include "component.h"
+#include "registry.h"
+#include <filesystem>
+#include <futile/futile.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <ulib/env.h>
+#include <ulib/json.h>
+#include <ulib/string.h>
+
+namespace vcwin
+{
+    namespace fs = std::filesystem;
+
+    // On-disk cache of component scans. Every scanned root key remembers its subkey count and last-write time,
+    // and every entry under it its own last-write time, so a warm scan only re-reads keys that changed.
+    //
+    // A root whose subkeys are unchanged is taken from the index as it is, without opening a single entry, which
+    // is what makes a warm scan cost about as much as reading this file. The catch is a value rewritten in place,
+    // e.g. DisplayVersion by an MSI minor upgrade: it bumps only the entry's key, never the root. Every entry's
+    // last-write time is therefore compared again once the root was last checked longer ago than the scan's
+    // `entryCheckInterval`, so such a change shows up at most one interval late, or at once with --no-index.
+    class ComponentIndex
+    {
+    public:
+        static constexpr int kVersion = 1;
+
+        struct Entry
+        {
+            std::wstring key;
+            uint64_t lastWriteTime = 0;
+
+            // Empty if the entry did not pass the scan filter or has no DisplayVersion.
+            // Its strings live in the index arena.
+            std::optional<WindowsComponent> component;
+        };
+
+        struct Root
+        {
+            ulib::string filterTag;
+            uint32_t subKeyCount = 0;
+            uint64_t lastWriteTime = 0;
+            ulib::list<Entry> entries;
+
+            // Seconds since the epoch of the last scan that compared every entry's last-write time
+            uint64_t checkedAt = 0;
+
+            // Adding or removing a subkey bumps the root's last-write time, so a root that still matches has the
+            // indexed subkeys and need not be enumerated. Values changed inside a subkey leave the root untouched,
+            // see the class comment for when the entries are compared on their own.
+            bool HasSameSubKeys(const RegistryKeyInfo &info) const
+            {
+                return lastWriteTime != 0 && info.lastWriteTime == lastWriteTime && info.subKeyCount == subKeyCount;
+            }
+
+            const Entry *Find(const std::wstring &key) const
+            {
+                auto it = lookup.find(key);
+                return it == lookup.end() ? nullptr : &entries[it->second];
+            }
+
+            void Reindex()
+            {
+                lookup.clear();
+                for (size_t i = 0; i != entries.size(); i++)
+                    lookup[entries[i].key] = i;
+            }
+
+            std::unordered_map<std::wstring, size_t> lookup;
+        };
+
+        ComponentIndex(fs::path path) : mPath(std::move(path)), mArena(std::make_shared<StringArena>())
+        {
+            try
+            {
+                if (fs::exists(mPath))
+                    Load(ulib::json::parse(futile::open(mPath, "r").read()));
+            }
+            catch (...)
+            {
+                // A broken index is just a cold start
+                mRoots.clear();
+            }
+        }
+
+        // %LOCALAPPDATA%\vcwin\component_index.json, machine-local like the registry it caches
+        static fs::path DefaultPath()
+        {
+            if (auto localAppData = ulib::getenv(u8"LOCALAPPDATA"))
+                return fs::path{*localAppData} / "vcwin" / "component_index.json";
+
+            throw ulib::RuntimeError{"Failed to determine LOCALAPPDATA env variable"};
+        }
+
+        // Components read while scanning with this index must be interned here, next to the reused ones
+        const std::shared_ptr<StringArena> &GetArena() const
+        {
+            return mArena;
+        }
+
+        // Roots are never changed once stored, storing one again replaces it, so the returned one stays as it is
+        // for as long as the caller holds it
+        std::shared_ptr<const Root> FindRoot(const std::wstring &name) const
+        {
+            std::lock_guard lock{mMutex};
+
+            auto it = mRoots.find(name);
+            return it == mRoots.end() ? nullptr : it->second;
+        }
+
+        void StoreRoot(const std::wstring &name, Root root)
+        {
+            root.Reindex();
+            auto stored = std::make_shared<const Root>(std::move(root));
+
+            std::lock_guard lock{mMutex};
+            mRoots[name] = std::move(stored);
+            mDirty = true;
+        }
+
+        void Save()
+        {
+            std::lock_guard lock{mMutex};
+
+            if (!mDirty)
+                return;
+
+            // Written next to the index and renamed over it, so concurrent runs and crashes never leave a torn file
+            // behind. Every writer has its own temporary, the last rename wins.
+            fs::path temp = mPath;
+            temp += "." + std::to_string(std::random_device{}()) + ".tmp";
+
+            try
+            {
+                fs::create_directories(mPath.parent_path());
+                futile::open(temp, "w").write(ToJson().dump());
+                fs::rename(temp, mPath);
+            }
+            catch (...)
+            {
+                std::error_code ec;
+                fs::remove(temp, ec);
+                throw;
+            }
+
+            mDirty = false;
+        }
+
+    private:
+        ulib::json ToJson() const
+        {
+            ulib::json val;
+            val["version"] = kVersion;
+
+            auto &jroots = val["roots"];
+            jroots = ulib::json::array();
+
+            for (auto &[name, root] : mRoots)
+            {
+                auto &jroot = jroots.push_back();
+                jroot["name"] = ulib::u8(name);
+                jroot["filter"] = root->filterTag;
+                jroot["sub_keys"] = root->subKeyCount;
+                jroot["last_write"] = root->lastWriteTime;
+                jroot["checked_at"] = root->checkedAt;
+
+                auto &jentries = jroot["entries"];
+                jentries = ulib::json::array();
+
+                for (auto &entry : root->entries)
+                {
+                    auto &jentry = jentries.push_back();
+                    jentry["key"] = ulib::u8(entry.key);
+                    jentry["last_write"] = entry.lastWriteTime;
+
+                    if (auto &comp = entry.component)
+                    {
+                        auto &jcomp = jentry["component"];
+                        jcomp["DisplayName"] = comp->DisplayName;
+                        jcomp["DisplayVersion"] = comp->DisplayVersion;
+                        jcomp["UninstallString"] = comp->UninstallString;
+                        jcomp["SystemComponent"] = comp->SystemComponent;
+                        jcomp["guid"] = comp->guid;
+                    }
+                }
+            }
+
+            return val;
+        }
+
+        void Load(ulib::json val)
+        {
+            auto version = val.search("version");
+            if (!version || version->get<int>() != kVersion)
+                return;
+
+            auto jroots = val.search("roots");
+            if (!jroots)
+                return;
+
+            for (size_t i = 0; i != jroots->size(); i++)
+            {
+                auto &jroot = (*jroots)[i];
+
+                Root root;
+                root.filterTag = jroot["filter"].get<ulib::string>();
+                root.subKeyCount = jroot["sub_keys"].get<uint32_t>();
+                root.lastWriteTime = jroot["last_write"].get<uint64_t>();
+
+                // Indexes written before it was recorded are checked on their first warm scan
+                if (auto checkedAt = jroot.search("checked_at"))
+                    root.checkedAt = checkedAt->get<uint64_t>();
+
+                auto &jentries = jroot["entries"];
+                for (size_t j = 0; j != jentries.size(); j++)
+                {
+                    auto &jentry = jentries[j];
+
+                    Entry entry;
+                    entry.key = ulib::wstr(jentry["key"].get<ulib::string>());
+                    entry.lastWriteTime = jentry["last_write"].get<uint64_t>();
+
+                    if (auto jcomp = jentry.search("component"))
+                    {
+                        WindowsComponent comp;
+                        comp.DisplayName = mArena->Intern((*jcomp)["DisplayName"].get<ulib::string>());
+                        comp.DisplayVersion = mArena->Intern((*jcomp)["DisplayVersion"].get<ulib::string>());
+                        comp.UninstallString = mArena->Intern((*jcomp)["UninstallString"].get<ulib::string>());
+                        comp.SystemComponent = (*jcomp)["SystemComponent"].get<bool>();
+                        comp.guid = mArena->Intern((*jcomp)["guid"].get<ulib::string>());
+
+                        entry.component = std::move(comp);
+                    }
+
+                    root.entries.push_back(std::move(entry));
+                }
+
+                root.Reindex();
+                mRoots[ulib::wstr(jroot["name"].get<ulib::string>())] = std::make_shared<const Root>(std::move(root));
+            }
+        }
+
+        fs::path mPath;
+        std::shared_ptr<StringArena> mArena;
+        std::map<std::wstring, std::shared_ptr<const Root>> mRoots;
+        mutable std::mutex mMutex;
+        bool mDirty = false;
+    };
+} // namespace vcwin
@@ -0,0 +1,387 @@
+#pragma once
+
+#include "emitter.h"
+#include "vctools.h"
+#include "winsdk.h"
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ulib/format.h>
+#include <ulib/json.h>
+#include <ulib/runtimeerror.h>
+#include <ulib/string.h>
+
+namespace vcwin
+{
+    namespace fs = std::filesystem;
+
+    struct DevEnvironmentOptions
+    {
+        // Architecture names as vcvarsall takes them: x64, x86, arm64, arm
+        ulib::string host = "x64";
+        ulib::string target = "x64";
+
+        // Empty selects the default toolset of the latest instance, or else the newest one that has the arch
+        ulib::string toolsetVersion;
+
+        // Empty selects the newest SDK that has headers, the way vcvarsall does
+        ulib::string sdkVersion;
+    };
+
+    struct DevEnvironmentVariable
+    {
+        ulib::string name;
+        ulib::string value;
+
+        // Semicolon separated directories
+        bool isList = false;
+    };
+
+    // Variables of a developer command prompt, in the order vcvarsall sets them
+    class DevEnvironment
+    {
+    public:
+        void Set(ulib::string_view name, std::string_view value, bool isList = false)
+        {
+            mVariables.push_back({ulib::string{name}, ulib::string{value}, isList});
+        }
+
+        const ulib::string *Find(ulib::string_view name) const
+        {
+            for (auto &var : mVariables)
+            {
+                if (var.name == name)
+                    return &var.value;
+            }
+
+            return nullptr;
+        }
+
+        const ulib::list<DevEnvironmentVariable> &GetVariables() const
+        {
+            return mVariables;
+        }
+
+        void Emit(Emitter &emitter) const
+        {
+            emitter.BeginObject();
+            for (auto &var : mVariables)
+                emitter.Field(var.name, var.value);
+            emitter.EndObject();
+        }
+
+        ulib::json ToJson() const
+        {
+            JsonDomEmitter emitter;
+            Emit(emitter);
+            return emitter.Take();
+        }
+
+    private:
+        ulib::list<DevEnvironmentVariable> mVariables;
+    };
+
+    // One variable where the computed environment and a recorded one disagree
+    struct DevEnvironmentMismatch
+    {
+        ulib::string name;
+        ulib::string computed;
+        ulib::string recorded;
+    };
+
+    namespace detail
+    {
+        inline std::string utf8_of(const fs::path &path)
+        {
+            auto u8 = fs::path{path}.make_preferred().u8string();
+            return std::string{reinterpret_cast<const char *>(u8.data()), u8.size()};
+        }
+
+        // vcvarsall ends directory variables with a separator
+        inline std::string dir_value(const fs::path &path)
+        {
+            auto value = utf8_of(path);
+            if (!value.empty() && value.back() != char(fs::path::preferred_separator))
+                value += char(fs::path::preferred_separator);
+
+            return value;
+        }
+
+        // Joins the directories that exist, like vcvarsall skips the components that are not installed
+        inline std::string list_value(const std::vector<fs::path> &dirs, std::string_view inherited = {})
+        {
+            std::string value;
+            for (auto &dir : dirs)
+            {
+                std::error_code ec;
+                if (!fs::is_directory(dir, ec))
+                    continue;
+
+                value += utf8_of(dir);
+                value += ';';
+            }
+
+            if (inherited.empty() && !value.empty())
+                value.pop_back();
+            else
+                value += inherited;
+
+            return value;
+        }
+
+        // Newest include/<version> with the SDK version header, vcvarsall's rule for the default SDK
+        inline std::string find_newest_sdk_version(const fs::path &kitDir)
+        {
+            auto dirs = list_subdirectories(kitDir / "include");
+
+            std::string newest;
+            for (auto &dir : dirs)
+            {
+                std::error_code ec;
+                if (!fs::exists(dir / "um" / "winsdkver.h", ec))
+                    continue;
+
+                auto name = filename_of(dir);
+                std::string_view version{name.data(), name.size()};
+                if (newest.empty() || version_less(newest, version))
+                    newest = version;
+            }
+
+            return newest;
+        }
+
+        inline std::string lower_ascii(std::string_view str)
+        {
+            std::string out{str};
+            for (auto &c : out)
+            {
+                if (c >= 'A' && c <= 'Z')
+                    c = char(c - 'A' + 'a');
+            }
+
+            return out;
+        }
+
+        // Case-insensitive and indifferent to a trailing or doubled separator, the way Windows compares paths.
+        // vcvarsall appends \include and the like to WindowsSdkDir, which already ends in one.
+        inline std::string normalize_entry(std::string_view entry)
+        {
+            while (!entry.empty() && (entry.back() == '\\' || entry.back() == '/'))
+                entry.remove_suffix(1);
+
+            auto out = lower_ascii(entry);
+            std::replace(out.begin(), out.end(), '/', '\\');
+            out.erase(std::unique(out.begin(), out.end(), [](char l, char r) { return l == '\\' && r == '\\'; }),
+                      out.end());
+            return out;
+        }
+
+        inline std::vector<std::string> split_list(std::string_view value)
+        {
+            std::vector<std::string> entries;
+            while (!value.empty())
+            {
+                auto end = value.find(';');
+                auto entry = value.substr(0, end);
+                if (!entry.empty())
+                    entries.push_back(normalize_entry(entry));
+
+                value = end == std::string_view::npos ? std::string_view{} : value.substr(end + 1);
+            }
+
+            return entries;
+        }
+    } // namespace detail
+
+    // Computes what `vcvarsall.bat <host>_<target>` would set, from the probed models alone. PATH starts with the
+    // toolchain directories and continues with inheritedPath, as vcvarsall prepends to the current PATH.
+    inline DevEnvironment make_dev_environment(const VCTools &vctools, const WindowsSDK &winsdk,
+                                               const DevEnvironmentOptions &options = {},
+                                               std::string_view inheritedPath = {})
+    {
+        std::string_view host{options.host.data(), options.host.size()};
+        std::string_view target{options.target.data(), options.target.size()};
+
+        const VCToolset *toolset = nullptr;
+        if (!options.toolsetVersion.empty())
+        {
+            toolset = vctools.FindToolset(options.toolsetVersion, options.host, options.target);
+        }
+        else
+        {
+            if (auto defaultVersion = vctools.GetVCToolsDefaultVersion())
+                toolset = vctools.FindToolset(*defaultVersion, options.host, options.target);
+            if (!toolset)
+                toolset = vctools.FindToolset({}, options.host, options.target);
+        }
+
+        if (!toolset && options.toolsetVersion.empty())
+            throw ulib::RuntimeError{ulib::format("No MSVC toolset for {}_{}", options.host, options.target)};
+        if (!toolset)
+        {
+            throw ulib::RuntimeError{
+                ulib::format("No MSVC toolset {} for {}_{}", options.toolsetVersion, options.host, options.target)};
+        }
+
+        auto sdkInfo = winsdk.GetWindows10SdkInfo();
+        if (!sdkInfo)
+            throw ulib::RuntimeError{"Windows 10 SDK not found"};
+
+        const fs::path &vsDir = vctools.GetInstallations()[toolset->installation].instance.installationPath;
+        const fs::path &vcToolsDir = toolset->directory;
+        const fs::path &kitDir = sdkInfo->directory;
+
+        std::string sdkVersion{options.sdkVersion.data(), options.sdkVersion.size()};
+        if (sdkVersion.empty())
+            sdkVersion = detail::find_newest_sdk_version(kitDir);
+        if (sdkVersion.empty())
+            sdkVersion = std::string{sdkInfo->version.data(), sdkInfo->version.size()} + ".0";
+
+        std::string hostDir = "Host" + std::string{host};
+        std::string toolsetVersion{toolset->version.data(), toolset->version.size()};
+
+        DevEnvironment env;
+
+        env.Set("VSINSTALLDIR", detail::dir_value(vsDir));
+        env.Set("VCINSTALLDIR", detail::dir_value(vsDir / "VC"));
+        env.Set("DevEnvDir", detail::dir_value(vsDir / "Common7" / "IDE"));
+        env.Set("VCToolsInstallDir", detail::dir_value(vcToolsDir));
+        env.Set("VCToolsVersion", toolsetVersion);
+        env.Set("VSCMD_ARG_HOST_ARCH", host);
+        env.Set("VSCMD_ARG_TGT_ARCH", target);
+        if (target != "x86")
+            env.Set("Platform", target);
+
+        env.Set("WindowsSdkDir", detail::dir_value(kitDir));
+        env.Set("WindowsSDKVersion", sdkVersion + char(fs::path::preferred_separator));
+        env.Set("WindowsSDKLibVersion", sdkVersion + char(fs::path::preferred_separator));
+        env.Set("WindowsSdkBinPath", detail::dir_value(kitDir / "bin"));
+        env.Set("WindowsSdkVerBinPath", detail::dir_value(kitDir / "bin" / sdkVersion));
+        env.Set("WindowsLibPath",
+                detail::list_value({kitDir / "UnionMetadata" / sdkVersion, kitDir / "References" / sdkVersion}), true);
+        env.Set("UniversalCRTSdkDir", detail::dir_value(kitDir));
+        env.Set("UCRTVersion", sdkVersion);
+
+        auto sdkInclude = kitDir / "include" / sdkVersion;
+        auto include = detail::list_value({
+            vcToolsDir / "include",
+            vcToolsDir / "ATLMFC" / "include",
+            vsDir / "VC" / "Auxiliary" / "VS" / "include",
+            sdkInclude / "ucrt",
+            sdkInclude / "um",
+            sdkInclude / "shared",
+            sdkInclude / "winrt",
+            sdkInclude / "cppwinrt",
+        });
+        env.Set("INCLUDE", include, true);
+        env.Set("EXTERNAL_INCLUDE", include, true);
+
+        auto sdkLib = kitDir / "lib" / sdkVersion;
+        env.Set("LIB", detail::list_value({
+                           vcToolsDir / "ATLMFC" / "lib" / target,
+                           vcToolsDir / "lib" / target,
+                           sdkLib / "ucrt" / target,
+                           sdkLib / "um" / target,
+                       }),
+                true);
+
+        env.Set("LIBPATH", detail::list_value({
+                               vcToolsDir / "ATLMFC" / "lib" / target,
+                               vcToolsDir / "lib" / target,
+                               vcToolsDir / "lib" / "x86" / "store" / "references",
+                               kitDir / "UnionMetadata" / sdkVersion,
+                               kitDir / "References" / sdkVersion,
+                           }),
+                true);
+
+        // A cross compiler loads DLLs from the native toolset of its host, vcvarsall puts both on PATH
+        std::vector<fs::path> path = {vcToolsDir / "bin" / hostDir / target};
+        if (host != target)
+            path.push_back(vcToolsDir / "bin" / hostDir / host);
+
+        path.push_back(vsDir / "Common7" / "IDE" / "VC" / "VCPackages");
+        path.push_back(kitDir / "bin" / sdkVersion / host);
+        path.push_back(kitDir / "bin" / host);
+        path.push_back(host == "x64" ? vsDir / "MSBuild" / "Current" / "Bin" / "amd64"
+                                     : vsDir / "MSBuild" / "Current" / "Bin");
+        path.push_back(vsDir / "Common7" / "IDE");
+        path.push_back(vsDir / "Common7" / "Tools");
+
+        env.Set("PATH", detail::list_value(path, inheritedPath), true);
+
+        return env;
+    }
+
+    // Compares against the output of `vcvarsall.bat <arch> && set`. Only variables the computed environment has
+    // are checked. List variables match when every computed entry appears in the recorded list in the same
+    // order, so entries vcwin does not model (.NET SDK, extensions) are tolerated.
+    inline ulib::list<DevEnvironmentMismatch> compare_dev_environment(const DevEnvironment &env,
+                                                                      std::string_view recordedSet)
+    {
+        std::vector<std::pair<std::string, std::string>> recorded;
+        while (!recordedSet.empty())
+        {
+            auto end = recordedSet.find('\n');
+            auto line = recordedSet.substr(0, end);
+            recordedSet = end == std::string_view::npos ? std::string_view{} : recordedSet.substr(end + 1);
+
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+
+            auto eq = line.find('=');
+            if (eq == std::string_view::npos || eq == 0)
+                continue;
+
+            recorded.push_back({detail::lower_ascii(line.substr(0, eq)), std::string{line.substr(eq + 1)}});
+        }
+
+        auto findRecorded = [&](std::string_view name) -> const std::string * {
+            auto key = detail::lower_ascii(name);
+            for (auto &[recordedName, value] : recorded)
+            {
+                if (recordedName == key)
+                    return &value;
+            }
+
+            return nullptr;
+        };
+
+        ulib::list<DevEnvironmentMismatch> mismatches;
+        for (auto &var : env.GetVariables())
+        {
+            std::string_view computed{var.value.data(), var.value.size()};
+            auto other = findRecorded(std::string_view{var.name.data(), var.name.size()});
+
+            bool matches = false;
+            if (other)
+            {
+                auto computedEntries = detail::split_list(computed);
+                auto recordedEntries = detail::split_list(*other);
+
+                if (!var.isList)
+                {
+                    matches = computedEntries == recordedEntries;
+                }
+                else
+                {
+                    // Ordered subsequence
+                    size_t next = 0;
+                    for (auto &entry : recordedEntries)
+                    {
+                        if (next != computedEntries.size() && entry == computedEntries[next])
+                            next++;
+                    }
+
+                    matches = next == computedEntries.size();
+                }
+            }
+
+            if (!matches)
+                mismatches.push_back({var.name, var.value, other ? ulib::string{*other} : ulib::string{}});
+        }
+
+        return mismatches;
+    }
+} // namespace vcwin
@@ -1,8 +1,9 @@
 #pragma once
 
+#include "emitter.h"
+#include "registry.h"
 #include <ulib/string.h>
 #include <ulib/env.h>
-#include <3rdparty/WinReg.hpp>
 #include <filesystem>
 
 #include <ulib/json.h>
@@ -14,7 +15,7 @@ namespace vcwin
     class DirectXSdk
     {
     public:
-        DirectXSdk()
+        DirectXSdk(const RegistryBackend &registry = default_registry())
         {
             mDXSDK_DIR = ulib::getenv(u8"DXSDK_DIR");
 
@@ -22,19 +23,18 @@ namespace vcwin
             mVersionSource = "HKLM:SOFTWARE\\Microsoft\\DirectX\\SDKVersion";
             mPathSource = "Check Directories";
 
+            try
             {
-                winreg::RegKey node;
-
-                try
-                {
-                    node.Create(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Microsoft\\DirectX", KEY_READ | KEY_WOW64_32KEY);
-                    mVersion = ulib::u8(node.GetStringValue(L"SDKVersion"));
-                }
-                catch (...)
+                auto node = registry.OpenKey(RegistryRoot::LocalMachine, L"SOFTWARE\\Microsoft\\DirectX",
+                                             RegistryView::Wow64_32);
+                if (node)
                 {
+                    if (auto version = node->TryGetString(L"SDKVersion"))
+                        mVersion = ulib::u8(*version);
                 }
-
-                node.Close();
+            }
+            catch (...)
+            {
             }
 
             if (mDXSDK_DIR)
@@ -102,28 +102,48 @@ namespace vcwin
             return mDXSDK_DIR_Source;
         }
 
-        ulib::json ToJson()
+        void Emit(Emitter &emitter) const
         {
-            ulib::json val = ulib::json::object();
-
-            val["version"] = mVersion;
-            val["version_source"] = mVersionSource;
-            val["path"] = mPath;
-            val["path_source"] = mPathSource;
-            val["DXSDK_DIR"] = mDXSDK_DIR;
-
-            val["DXSDK_Mismatches"] = ulib::json::array();
-            for (auto& mm : mDXSDK_Mismatches)
+            emitter.BeginObject();
+            emitter.Field("version", mVersion);
+            emitter.Field("version_source", mVersionSource);
+            emitter.Field("path", mPath);
+            emitter.Field("path_source", mPathSource);
+            emitter.Field("DXSDK_DIR", mDXSDK_DIR);
+
+            emitter.Key("DXSDK_Mismatches");
+            emitter.BeginArray();
+            for (auto &mm : mDXSDK_Mismatches)
             {
-                auto& newMm = val["DXSDK_Mismatches"].push_back();
-                newMm.push_back() = mm.first;
-                newMm.push_back() = mm.second;
+                emitter.BeginArray();
+                emitter.Value(mm.first);
+                emitter.Value(mm.second);
+                emitter.EndArray();
             }
+            emitter.EndArray();
 
-            return val;
+            emitter.EndObject();
+        }
+
+        ulib::json ToJson() const
+        {
+            JsonDomEmitter emitter;
+            Emit(emitter);
+            return emitter.Take();
         }
 
     private:
+        friend class StateSnapshot;
+
+        // Empty model to be filled from a snapshot
+        struct Unprobed
+        {
+        };
+
+        DirectXSdk(Unprobed)
+        {
+        }
+
         std::optional<ulib::u8string> mVersion;
         ulib::string mVersionSource;
 
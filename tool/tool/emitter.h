@@ -0,0 +1,912 @@
+#pragma once
+
+#include "json_scanner.h"
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <ulib/json.h>
+#include <ulib/runtimeerror.h>
+#include <ulib/string.h>
+
+namespace vcwin
+{
+    namespace fs = std::filesystem;
+
+    // Collects output in a fixed-size chunk and hands it to the file whenever the chunk fills up, so writing a
+    // document of any size costs the same bounded amount of memory. A string target keeps everything instead.
+    class OutputBuffer
+    {
+    public:
+        static constexpr size_t kCapacity = 64 * 1024;
+
+        OutputBuffer(FILE *file) : mFile(file)
+        {
+            mBuffer.reserve(kCapacity);
+        }
+
+        OutputBuffer(std::string &target) : mTarget(&target)
+        {
+        }
+
+        OutputBuffer(const OutputBuffer &) = delete;
+        OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+        ~OutputBuffer()
+        {
+            Flush();
+        }
+
+        void Write(std::string_view text)
+        {
+            if (mTarget)
+            {
+                mTarget->append(text);
+                return;
+            }
+
+            if (mBuffer.size() + text.size() > kCapacity)
+                Flush();
+
+            // Pieces as large as the chunk itself gain nothing from the copy
+            if (text.size() >= kCapacity)
+                std::fwrite(text.data(), 1, text.size(), mFile);
+            else
+                mBuffer.append(text);
+        }
+
+        void Put(char c)
+        {
+            if (mTarget)
+            {
+                mTarget->push_back(c);
+                return;
+            }
+
+            if (mBuffer.size() == kCapacity)
+                Flush();
+
+            mBuffer.push_back(c);
+        }
+
+        void Flush()
+        {
+            if (!mFile || mBuffer.empty())
+                return;
+
+            std::fwrite(mBuffer.data(), 1, mBuffer.size(), mFile);
+            std::fflush(mFile);
+            mBuffer.clear();
+        }
+
+    private:
+        FILE *mFile = nullptr;
+        std::string *mTarget = nullptr;
+        std::string mBuffer;
+    };
+
+    namespace detail
+    {
+        template <class T>
+        struct is_optional : std::false_type
+        {
+        };
+
+        template <class T>
+        struct is_optional<std::optional<T>> : std::true_type
+        {
+        };
+
+        // Bytes of any string-like type with one-byte characters: ulib and std strings, views and u8 variants
+        template <class T>
+            requires requires(const T &value) {
+                value.data();
+                value.size();
+            } && (sizeof(*std::declval<const T &>().data()) == 1)
+        std::string_view text_of(const T &value)
+        {
+            return std::string_view{reinterpret_cast<const char *>(value.data()), value.size()};
+        }
+
+        inline std::string_view text_of(const char *value)
+        {
+            return value;
+        }
+    } // namespace detail
+
+    // Receives a document as a sequence of events, the way the models describe themselves in Emit(). Inside an
+    // object every value is preceded by Key(). Implementations write the events straight to their output.
+    class Emitter
+    {
+    public:
+        virtual ~Emitter() = default;
+
+        virtual void BeginObject() = 0;
+        virtual void EndObject() = 0;
+        virtual void BeginArray() = 0;
+        virtual void EndArray() = 0;
+
+        template <class K>
+        void Key(const K &key)
+        {
+            WriteKey(detail::text_of(key));
+        }
+
+        template <class T>
+        void Value(const T &value)
+        {
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                WriteBool(value);
+            }
+            else if constexpr (std::is_integral_v<T>)
+            {
+                Int(int64_t(value));
+            }
+            else if constexpr (detail::is_optional<T>::value)
+            {
+                if (value)
+                    Value(*value);
+                else
+                    Null();
+            }
+            else if constexpr (std::is_same_v<T, fs::path>)
+            {
+                WriteString(detail::text_of(value.u8string()));
+            }
+            else
+            {
+                WriteString(detail::text_of(value));
+            }
+        }
+
+        template <class K, class T>
+        void Field(const K &key, const T &value)
+        {
+            Key(key);
+            Value(value);
+        }
+
+        void Int(int64_t value)
+        {
+            char text[24];
+            auto result = std::to_chars(std::begin(text), std::end(text), value);
+            WriteNumber(std::string_view{text, size_t(result.ptr - text)});
+        }
+
+        // A number already in JSON notation
+        void Number(std::string_view text)
+        {
+            WriteNumber(text);
+        }
+
+        void Null()
+        {
+            WriteNull();
+        }
+
+        // False when whatever is written under `key` of the current object would be thrown away, so a model can
+        // skip the value and leave the probes behind it unrun. Emitters that keep everything always want it.
+        virtual bool Wants([[maybe_unused]] std::string_view key) const
+        {
+            return true;
+        }
+
+    protected:
+        virtual void WriteKey(std::string_view key) = 0;
+        virtual void WriteString(std::string_view value) = 0;
+        virtual void WriteBool(bool value) = 0;
+        virtual void WriteNull() = 0;
+        virtual void WriteNumber(std::string_view text) = 0;
+    };
+
+    // Compact JSON, the same layout as ulib::json::dump(), followed by a newline
+    class JsonEmitter : public Emitter
+    {
+    public:
+        JsonEmitter(OutputBuffer &out) : mOut(out)
+        {
+        }
+
+        void BeginObject() override
+        {
+            BeforeValue();
+            mOut.Put('{');
+            mFirst.push_back(true);
+        }
+
+        void EndObject() override
+        {
+            mFirst.pop_back();
+            mOut.Put('}');
+            AfterValue();
+        }
+
+        void BeginArray() override
+        {
+            BeforeValue();
+            mOut.Put('[');
+            mFirst.push_back(true);
+        }
+
+        void EndArray() override
+        {
+            mFirst.pop_back();
+            mOut.Put(']');
+            AfterValue();
+        }
+
+    protected:
+        void WriteKey(std::string_view key) override
+        {
+            Separate();
+            WriteQuoted(key);
+            mOut.Put(':');
+            mAfterKey = true;
+        }
+
+        void WriteString(std::string_view value) override
+        {
+            BeforeValue();
+            WriteQuoted(value);
+            AfterValue();
+        }
+
+        void WriteBool(bool value) override
+        {
+            WriteNumber(value ? "true" : "false");
+        }
+
+        void WriteNull() override
+        {
+            WriteNumber("null");
+        }
+
+        void WriteNumber(std::string_view text) override
+        {
+            BeforeValue();
+            mOut.Write(text);
+            AfterValue();
+        }
+
+        // Called once a top-level value is complete
+        virtual void EndDocument()
+        {
+            mOut.Put('\n');
+        }
+
+        OutputBuffer &mOut;
+
+    private:
+        void Separate()
+        {
+            if (mFirst.empty())
+                return;
+
+            if (!mFirst.back())
+                mOut.Put(',');
+            mFirst.back() = false;
+        }
+
+        void BeforeValue()
+        {
+            if (mAfterKey)
+                mAfterKey = false;
+            else
+                Separate();
+        }
+
+        void AfterValue()
+        {
+            if (mFirst.empty())
+                EndDocument();
+        }
+
+        void WriteQuoted(std::string_view text)
+        {
+            mOut.Put('"');
+
+            size_t begin = 0;
+            for (size_t i = 0; i != text.size(); i++)
+            {
+                unsigned char c = text[i];
+                if (c >= 0x20 && c != '"' && c != '\\')
+                    continue;
+
+                mOut.Write(text.substr(begin, i - begin));
+                begin = i + 1;
+
+                switch (c)
+                {
+                case '"':
+                    mOut.Write("\\\"");
+                    break;
+                case '\\':
+                    mOut.Write("\\\\");
+                    break;
+                case '\n':
+                    mOut.Write("\\n");
+                    break;
+                case '\r':
+                    mOut.Write("\\r");
+                    break;
+                case '\t':
+                    mOut.Write("\\t");
+                    break;
+                default: {
+                    constexpr char hex[] = "0123456789abcdef";
+                    char escape[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                    mOut.Write(std::string_view{escape, sizeof(escape)});
+                }
+                }
+            }
+
+            mOut.Write(text.substr(begin));
+            mOut.Put('"');
+        }
+
+        std::vector<bool> mFirst;
+        bool mAfterKey = false;
+    };
+
+    // JSON Lines: every top-level value is one line, handed to the file as soon as it is complete so a reader
+    // sees each record while the rest are still being produced
+    class NdjsonEmitter : public JsonEmitter
+    {
+    public:
+        using JsonEmitter::JsonEmitter;
+
+    protected:
+        void EndDocument() override
+        {
+            JsonEmitter::EndDocument();
+            mOut.Flush();
+        }
+    };
+
+    // Record stream shared by several producers, e.g. probes running in parallel. Each Record() call writes one
+    // complete line, records of different threads never interleave.
+    class NdjsonWriter
+    {
+    public:
+        NdjsonWriter(FILE *file) : mOut(file), mEmitter(mOut)
+        {
+        }
+
+        template <class Fn>
+        void Record(Fn &&fn)
+        {
+            std::lock_guard lock{mMutex};
+            fn(static_cast<Emitter &>(mEmitter));
+        }
+
+    private:
+        std::mutex mMutex;
+        OutputBuffer mOut;
+        NdjsonEmitter mEmitter;
+    };
+
+    // CBOR (RFC 8949) with the same members as the JSON output, for consumers that parse it in a loop. Containers
+    // have indefinite length, so nothing is counted or held back. Every document starts with the self-describe tag
+    // 55799 and several documents simply follow each other. cbor_reader.h reads it back.
+    class CborEmitter : public Emitter
+    {
+    public:
+        CborEmitter(OutputBuffer &out) : mOut(out)
+        {
+        }
+
+        void BeginObject() override
+        {
+            StartDocument();
+            mOut.Put(char(0xBF));
+            mDepth++;
+        }
+
+        void EndObject() override
+        {
+            mOut.Put(char(0xFF));
+            mDepth--;
+        }
+
+        void BeginArray() override
+        {
+            StartDocument();
+            mOut.Put(char(0x9F));
+            mDepth++;
+        }
+
+        void EndArray() override
+        {
+            mOut.Put(char(0xFF));
+            mDepth--;
+        }
+
+    protected:
+        void WriteKey(std::string_view key) override
+        {
+            WriteHead(3, key.size());
+            mOut.Write(key);
+        }
+
+        void WriteString(std::string_view value) override
+        {
+            StartDocument();
+            WriteHead(3, value.size());
+            mOut.Write(value);
+        }
+
+        void WriteBool(bool value) override
+        {
+            StartDocument();
+            mOut.Put(char(value ? 0xF5 : 0xF4));
+        }
+
+        void WriteNull() override
+        {
+            StartDocument();
+            mOut.Put(char(0xF6));
+        }
+
+        void WriteNumber(std::string_view text) override
+        {
+            StartDocument();
+
+            int64_t value = 0;
+            auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+            if (result.ec == std::errc{} && result.ptr == text.data() + text.size())
+            {
+                if (value >= 0)
+                    WriteHead(0, uint64_t(value));
+                else
+                    WriteHead(1, uint64_t(-(value + 1)));
+
+                return;
+            }
+
+            double number = std::strtod(std::string{text}.c_str(), nullptr);
+            uint64_t bits;
+            static_assert(sizeof(bits) == sizeof(number));
+            std::memcpy(&bits, &number, sizeof(bits));
+
+            mOut.Put(char(0xFB));
+            WriteBigEndian(bits, 8);
+        }
+
+    private:
+        void StartDocument()
+        {
+            if (mDepth == 0)
+                mOut.Write("\xD9\xD9\xF7");
+        }
+
+        // Major type and argument in the shortest form
+        void WriteHead(uint8_t major, uint64_t value)
+        {
+            uint8_t type = uint8_t(major << 5);
+            if (value < 24)
+            {
+                mOut.Put(char(type | value));
+            }
+            else if (value <= 0xFF)
+            {
+                mOut.Put(char(type | 24));
+                WriteBigEndian(value, 1);
+            }
+            else if (value <= 0xFFFF)
+            {
+                mOut.Put(char(type | 25));
+                WriteBigEndian(value, 2);
+            }
+            else if (value <= 0xFFFFFFFF)
+            {
+                mOut.Put(char(type | 26));
+                WriteBigEndian(value, 4);
+            }
+            else
+            {
+                mOut.Put(char(type | 27));
+                WriteBigEndian(value, 8);
+            }
+        }
+
+        void WriteBigEndian(uint64_t value, size_t size)
+        {
+            for (size_t i = size; i != 0; i--)
+                mOut.Put(char((value >> ((i - 1) * 8)) & 0xFF));
+        }
+
+        OutputBuffer &mOut;
+        size_t mDepth = 0;
+    };
+
+    // Block-style YAML with two-space indentation. Lines are written as soon as their content is known, the only
+    // lookahead is whether a container turns out empty, which is then written inline as {} or [].
+    class YamlEmitter : public Emitter
+    {
+    public:
+        YamlEmitter(OutputBuffer &out) : mOut(out)
+        {
+        }
+
+        void BeginObject() override
+        {
+            Begin(true);
+        }
+
+        void EndObject() override
+        {
+            End("{}");
+        }
+
+        void BeginArray() override
+        {
+            Begin(false);
+        }
+
+        void EndArray() override
+        {
+            End("[]");
+        }
+
+    protected:
+        void WriteKey(std::string_view key) override
+        {
+            StartLine(mFrames.back());
+            WriteScalar(key);
+            mOut.Put(':');
+            mAfterKey = true;
+        }
+
+        void WriteString(std::string_view value) override
+        {
+            WriteValue(value, true);
+        }
+
+        void WriteBool(bool value) override
+        {
+            WriteValue(value ? "true" : "false", false);
+        }
+
+        void WriteNull() override
+        {
+            WriteValue("null", false);
+        }
+
+        void WriteNumber(std::string_view text) override
+        {
+            WriteValue(text, false);
+        }
+
+    private:
+        enum class Intro : uint8_t
+        {
+            Root,
+            MapValue,
+            SeqItem,
+        };
+
+        struct Frame
+        {
+            bool map;
+            Intro intro;
+            size_t indent;
+            size_t count = 0;
+
+            // The first line of a sequence item shares the line with its "- "
+            bool inlineNext = false;
+        };
+
+        void Begin(bool map)
+        {
+            if (mFrames.empty())
+            {
+                mFrames.push_back({map, Intro::Root, 0});
+                return;
+            }
+
+            auto &parent = mFrames.back();
+            if (parent.map)
+            {
+                // "key:" is already out, the line break waits until the container has something in it
+                mAfterKey = false;
+                mFrames.push_back({map, Intro::MapValue, parent.indent + 2});
+                return;
+            }
+
+            StartLine(parent);
+            mOut.Write("- ");
+            mFrames.push_back({map, Intro::SeqItem, parent.indent + 2, 0, true});
+        }
+
+        void End(std::string_view empty)
+        {
+            auto frame = mFrames.back();
+            mFrames.pop_back();
+
+            if (frame.count != 0)
+                return;
+
+            if (frame.intro == Intro::MapValue)
+                mOut.Put(' ');
+            mOut.Write(empty);
+            mOut.Put('\n');
+        }
+
+        void StartLine(Frame &frame)
+        {
+            if (frame.count++ == 0 && frame.intro == Intro::MapValue)
+                mOut.Put('\n');
+
+            if (frame.inlineNext)
+            {
+                frame.inlineNext = false;
+                return;
+            }
+
+            for (size_t i = 0; i != frame.indent; i++)
+                mOut.Put(' ');
+        }
+
+        void WriteValue(std::string_view value, bool isString)
+        {
+            if (mFrames.empty())
+            {
+                WriteText(value, isString);
+                mOut.Put('\n');
+                return;
+            }
+
+            if (mAfterKey)
+            {
+                mAfterKey = false;
+                mOut.Put(' ');
+            }
+            else
+            {
+                StartLine(mFrames.back());
+                mOut.Write("- ");
+            }
+
+            WriteText(value, isString);
+            mOut.Put('\n');
+        }
+
+        void WriteText(std::string_view value, bool isString)
+        {
+            if (isString)
+                WriteScalar(value);
+            else
+                mOut.Write(value);
+        }
+
+        // Strings a YAML reader would take for something else, or that do not survive a plain scalar
+        static bool NeedsQuotes(std::string_view text)
+        {
+            if (text.empty() || text.front() == ' ' || text.back() == ' ' || text.back() == ':')
+                return true;
+
+            if (std::string_view{"-+?:,[]{}#&*!|>'\"%@`."}.find(text.front()) != std::string_view::npos)
+                return true;
+
+            // Numbers, versions and dates all start with a digit, plain they would not read back as strings
+            if (text.front() >= '0' && text.front() <= '9')
+                return true;
+
+            if (text.find(": ") != std::string_view::npos || text.find(" #") != std::string_view::npos)
+                return true;
+
+            for (char c : text)
+            {
+                if ((unsigned char)c < 0x20 || c == 0x7F)
+                    return true;
+            }
+
+            // "<<" is the merge key and "=" the value key, readers reject both as plain scalars
+            constexpr std::string_view reserved[] = {"true", "false", "null", "yes", "no", "on",
+                                                     "off",  "y",     "n",    "~",   "<<", "="};
+            for (auto word : reserved)
+            {
+                if (text.size() != word.size())
+                    continue;
+
+                bool same = true;
+                for (size_t i = 0; i != word.size() && same; i++)
+                    same = char(text[i] | 0x20) == word[i];
+
+                if (same)
+                    return true;
+            }
+
+            return false;
+        }
+
+        void WriteScalar(std::string_view text)
+        {
+            if (!NeedsQuotes(text))
+                return mOut.Write(text);
+
+            mOut.Put('"');
+            for (char c : text)
+            {
+                switch (c)
+                {
+                case '"':
+                    mOut.Write("\\\"");
+                    break;
+                case '\\':
+                    mOut.Write("\\\\");
+                    break;
+                case '\n':
+                    mOut.Write("\\n");
+                    break;
+                case '\r':
+                    mOut.Write("\\r");
+                    break;
+                case '\t':
+                    mOut.Write("\\t");
+                    break;
+                default:
+                    if ((unsigned char)c < 0x20 || c == 0x7F)
+                    {
+                        constexpr char hex[] = "0123456789ABCDEF";
+                        char escape[] = {'\\', 'x', hex[(c >> 4) & 0xF], hex[c & 0xF]};
+                        mOut.Write(std::string_view{escape, sizeof(escape)});
+                    }
+                    else
+                    {
+                        mOut.Put(c);
+                    }
+                }
+            }
+            mOut.Put('"');
+        }
+
+        OutputBuffer &mOut;
+        std::vector<Frame> mFrames;
+        bool mAfterKey = false;
+    };
+
+    // Builds a ulib::json from the events, for callers that still want a value to hold on to
+    class JsonDomEmitter : public Emitter
+    {
+    public:
+        void BeginObject() override
+        {
+            auto &slot = Slot();
+            slot = ulib::json::object();
+            mStack.push_back({&slot, true});
+        }
+
+        void EndObject() override
+        {
+            mStack.pop_back();
+        }
+
+        void BeginArray() override
+        {
+            auto &slot = Slot();
+            slot = ulib::json::array();
+            mStack.push_back({&slot, false});
+        }
+
+        void EndArray() override
+        {
+            mStack.pop_back();
+        }
+
+        ulib::json Take()
+        {
+            return std::move(mRoot);
+        }
+
+    protected:
+        void WriteKey(std::string_view key) override
+        {
+            mKey = key;
+        }
+
+        void WriteString(std::string_view value) override
+        {
+            Slot() = ulib::string_view{value.data(), value.size()};
+        }
+
+        void WriteBool(bool value) override
+        {
+            Slot() = value;
+        }
+
+        void WriteNull() override
+        {
+            Slot() = ulib::json{};
+        }
+
+        void WriteNumber(std::string_view text) override
+        {
+            int64_t value = 0;
+            auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+            if (result.ec == std::errc{} && result.ptr == text.data() + text.size())
+                Slot() = value;
+            else
+                Slot() = std::strtod(std::string{text}.c_str(), nullptr);
+        }
+
+    private:
+        ulib::json &Slot()
+        {
+            if (mStack.empty())
+                return mRoot;
+
+            auto [container, isObject] = mStack.back();
+            if (isObject)
+                return (*container)[ulib::string_view{mKey.data(), mKey.size()}];
+
+            return container->push_back();
+        }
+
+        ulib::json mRoot;
+        std::vector<std::pair<ulib::json *, bool>> mStack;
+        std::string mKey;
+    };
+
+    namespace detail
+    {
+        inline bool emit_json_value(JsonScanner &scanner, Emitter &emitter)
+        {
+            bool ok = true;
+            switch (scanner.PeekValue())
+            {
+            case '{':
+                emitter.BeginObject();
+                ok = scanner.ForEachMember([&](std::string_view key) {
+                    emitter.Key(key);
+                    return ok = emit_json_value(scanner, emitter);
+                }) && ok;
+                emitter.EndObject();
+                return ok;
+            case '[':
+                emitter.BeginArray();
+                ok = scanner.ForEachElement([&] { return ok = emit_json_value(scanner, emitter); }) && ok;
+                emitter.EndArray();
+                return ok;
+            case '"': {
+                std::string value;
+                if (!scanner.ReadString(&value))
+                    return false;
+
+                emitter.Value(value);
+                return true;
+            }
+            default: {
+                std::string_view text;
+                if (!scanner.ReadScalarText(text))
+                    return false;
+
+                if (text == "true" || text == "false")
+                    emitter.Value(text == "true");
+                else if (text == "null")
+                    emitter.Null();
+                else
+                    emitter.Number(text);
+                return true;
+            }
+            }
+        }
+    } // namespace detail
+
+    // Replays a JSON document, such as the reply of `vcwin serve`, through an emitter
+    inline void emit_json_text(std::string_view text, Emitter &emitter)
+    {
+        detail::JsonScanner scanner{text};
+        if (!detail::emit_json_value(scanner, emitter) || !scanner.AtEnd())
+            throw ulib::RuntimeError{"Malformed JSON document"};
+    }
+} // namespace vcwin
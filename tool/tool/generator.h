@@ -0,0 +1,164 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace vcwin
+{
+    // Lazily produced sequence for range-for. The body of the coroutine only runs as far as the consumer iterates,
+    // so breaking out of the loop early skips all the work behind the remaining elements.
+    template <class T>
+    class Generator
+    {
+    public:
+        using value_type = std::remove_cvref_t<T>;
+
+        struct promise_type
+        {
+            const value_type *value = nullptr;
+            std::exception_ptr error;
+
+            Generator get_return_object() noexcept
+            {
+                return Generator{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            std::suspend_always initial_suspend() const noexcept
+            {
+                return {};
+            }
+
+            std::suspend_always final_suspend() const noexcept
+            {
+                return {};
+            }
+
+            // The yielded object lives until the coroutine is resumed, so pointing at it is enough
+            std::suspend_always yield_value(const value_type &val) noexcept
+            {
+                value = std::addressof(val);
+                return {};
+            }
+
+            void return_void() const noexcept
+            {
+            }
+
+            void unhandled_exception() noexcept
+            {
+                error = std::current_exception();
+            }
+
+            // co_await is meaningless inside a generator
+            void await_transform() = delete;
+        };
+
+        class iterator
+        {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = Generator::value_type;
+            using reference = const value_type &;
+            using pointer = const value_type *;
+
+            iterator() = default;
+            explicit iterator(std::coroutine_handle<promise_type> handle) : mHandle(handle)
+            {
+            }
+
+            iterator &operator++()
+            {
+                mHandle.resume();
+                if (mHandle.done())
+                    Rethrow();
+
+                return *this;
+            }
+
+            void operator++(int)
+            {
+                ++*this;
+            }
+
+            reference operator*() const
+            {
+                return *mHandle.promise().value;
+            }
+
+            pointer operator->() const
+            {
+                return mHandle.promise().value;
+            }
+
+            friend bool operator==(const iterator &it, std::default_sentinel_t)
+            {
+                return !it.mHandle || it.mHandle.done();
+            }
+
+        private:
+            void Rethrow()
+            {
+                if (auto error = std::exchange(mHandle.promise().error, nullptr))
+                    std::rethrow_exception(error);
+            }
+
+            std::coroutine_handle<promise_type> mHandle;
+        };
+
+        Generator() = default;
+
+        Generator(Generator &&other) noexcept : mHandle(std::exchange(other.mHandle, nullptr))
+        {
+        }
+
+        Generator &operator=(Generator &&other) noexcept
+        {
+            if (this != &other)
+            {
+                if (mHandle)
+                    mHandle.destroy();
+
+                mHandle = std::exchange(other.mHandle, nullptr);
+            }
+
+            return *this;
+        }
+
+        Generator(const Generator &) = delete;
+        Generator &operator=(const Generator &) = delete;
+
+        ~Generator()
+        {
+            if (mHandle)
+                mHandle.destroy();
+        }
+
+        // Runs the coroutine up to its first element
+        iterator begin()
+        {
+            if (!mHandle)
+                return iterator{};
+
+            iterator it{mHandle};
+            ++it;
+            return it;
+        }
+
+        std::default_sentinel_t end() const noexcept
+        {
+            return {};
+        }
+
+    private:
+        explicit Generator(std::coroutine_handle<promise_type> handle) : mHandle(handle)
+        {
+        }
+
+        std::coroutine_handle<promise_type> mHandle;
+    };
+} // namespace vcwin
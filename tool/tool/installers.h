@@ -1,117 +1,462 @@
 #pragma once
 
-#include <3rdparty/WinReg.hpp>
+#include "component.h"
+#include "component_index.h"
+#include "generator.h"
+#include "parallel.h"
+#include "registry.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
 #include <ulib/string.h>
 
 namespace vcwin
 {
-    struct WindowsComponent
+    enum class ComponentSource
     {
-        ulib::string DisplayName;
-        ulib::string DisplayVersion;
-        ulib::string UninstallString;
-        bool SystemComponent;
-        ulib::string guid;
+        Uninstall = 0,
+        Installer = 1,
     };
 
-    inline ulib::list<WindowsComponent> list_uninstall_components()
+    // Decides from DisplayName alone whether the rest of a component is worth reading.
+    // Installer scans call it from several worker threads at once.
+    using ComponentNameFilter = std::function<bool(ulib::string_view displayName)>;
+
+    struct ComponentScanOptions
     {
-        ulib::list<WindowsComponent> result;
-        ulib::list<ulib::wstring> keyPaths = {// L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall",
-                                              L"SOFTWARE\\WOW6432Node\\Microsoft\\Windows\\CurrentVersion\\Uninstall"};
-        for (auto &keyPath : keyPaths)
+        // Sees only DisplayName; the remaining values are read just for entries it accepts
+        ComponentNameFilter filter;
+
+        // Identifies `filter` in the index, entries recorded under another tag are not reused
+        ulib::string filterTag;
+
+        // Optional persistent index that lets unchanged keys be skipped
+        ComponentIndex *index = nullptr;
+
+        // How long an indexed root with unchanged subkeys is taken as it is before its entries are compared one by
+        // one again, see ComponentIndex. Zero compares them on every scan.
+        std::chrono::seconds entryCheckInterval = std::chrono::minutes{10};
+
+        // Owns the strings of the returned components and has to outlive them.
+        // Ignored with an index, whose own arena also holds the components it reuses.
+        StringArena *arena = nullptr;
+    };
+
+    // Receives every scanned component whose DisplayName passes `match`
+    struct ComponentClassifier
+    {
+        ulib::string name;
+        ComponentNameFilter match;
+        std::function<void(ComponentSource, const WindowsComponent &)> accept;
+    };
+
+    namespace detail
+    {
+        inline std::optional<WindowsComponent> read_component(const RegistryKey &node, const std::wstring &guid,
+                                                              const ComponentNameFilter &filter, StringArena &arena)
         {
-            winreg::RegKey unode;
-            unode.Create(HKEY_LOCAL_MACHINE, keyPath, KEY_READ | KEY_WOW64_32KEY | KEY_ENUMERATE_SUB_KEYS);
+            auto dn = node.TryGetString(L"DisplayName");
+            if (!dn)
+                return std::nullopt;
+
+            ulib::string displayName = ulib::u8(*dn);
+            if (filter && !filter(displayName))
+                return std::nullopt;
+
+            // The values every component has come in one batched read. SystemComponent is missing from most entries
+            // and a batch with a missing value falls apart into one query per value, so it is read on its own.
+            static const std::vector<std::wstring> detailNames = {L"DisplayVersion", L"UninstallString"};
+
+            std::vector<RegistryValue> details;
+            node.ReadValues(detailNames, details);
+
+            auto &dv = details[0];
+            auto &us = details[1];
+
+            if (dv.type != RegistryValueType::String)
+                return std::nullopt;
+
+            auto sc = node.TryGetDword(L"SystemComponent");
 
-            auto subKeys = unode.EnumSubKeys();
+            WindowsComponent component;
+            component.DisplayName = arena.Intern(displayName);
+            component.DisplayVersion = arena.Intern(ulib::u8(dv.text));
+            component.UninstallString = us.type == RegistryValueType::String ? arena.Intern(ulib::u8(us.text)) : "";
+            component.SystemComponent = sc.value_or(0) != 0;
+            component.guid = arena.Intern(ulib::u8(guid));
 
-            for (auto &sk : subKeys)
+            return component;
+        }
+
+        // A root key (Uninstall, or a SID's Products key) whose subkeys are components
+        struct ComponentRootScan
+        {
+            ComponentRootScan(std::wstring name, std::unique_ptr<RegistryKey> key)
+                : name(std::move(name)), key(std::move(key))
             {
-                winreg::RegKey sknode;
-                sknode.Create(HKEY_LOCAL_MACHINE, keyPath + L"\\" + sk, KEY_READ | KEY_WOW64_32KEY);
+            }
+
+            std::wstring name;
+            std::unique_ptr<RegistryKey> key;
+
+            RegistryKeyInfo info;
+            // Indexed state of the root, only if it was indexed under the same filter
+            std::shared_ptr<const ComponentIndex::Root> cached;
+            bool sameSubKeys = false;
+            // Taken from the index as it is, not an entry is opened
+            bool reused = false;
+            ulib::list<ComponentIndex::Entry> entries;
+        };
+
+        // Reads the components under every root, reusing the indexed entries whose keys did not change.
+        // `valuesSubKey` names the subkey of an entry that holds its values, or is empty if they sit on the entry.
+        inline ulib::list<WindowsComponent> scan_component_roots(ulib::list<ComponentRootScan> &roots,
+                                                                 const std::wstring &valuesSubKey,
+                                                                 const ComponentScanOptions &options, bool parallel)
+        {
+            ComponentIndex *index = options.index;
+
+            StringArena *arena = index ? index->GetArena().get() : options.arena;
+            if (!arena)
+                throw ulib::RuntimeError{"Component scan needs a string arena"};
 
-                auto dn = sknode.TryGetStringValue(L"DisplayName");
-                auto dv = sknode.TryGetStringValue(L"DisplayVersion");
-                auto us = sknode.TryGetStringValue(L"UninstallString");
-                auto sc = sknode.TryGetDwordValue(L"SystemComponent");
+            auto now = uint64_t(std::chrono::duration_cast<std::chrono::seconds>(
+                                    std::chrono::system_clock::now().time_since_epoch())
+                                    .count());
 
-                if (dn && dv)
+            // Roots are independent keys, so they are validated and enumerated concurrently
+            auto enumRoot = [&](size_t r) {
+                auto &root = roots[r];
+
+                if (index)
                 {
-                    WindowsComponent component;
-                    component.DisplayName = ulib::u8(dn.GetValue());
-                    component.DisplayVersion = ulib::u8(dv.GetValue());
-                    component.UninstallString = us ? ulib::u8(us.GetValue()) : "";
-                    component.SystemComponent = bool(sc ? sc.GetValue() : 0);
-                    component.guid = ulib::u8(sk);
+                    root.info = root.key->QueryInfo();
+                    root.cached = index->FindRoot(root.name);
+                    if (root.cached && root.cached->filterTag != options.filterTag)
+                        root.cached = nullptr;
 
-                    result.push_back(std::move(component));
+                    root.sameSubKeys = root.cached && root.cached->HasSameSubKeys(root.info);
+                    root.reused = root.sameSubKeys && now - root.cached->checkedAt <
+                                                          uint64_t(options.entryCheckInterval.count());
+                }
+
+                if (root.reused)
+                {
+                    root.entries = root.cached->entries;
+                    return;
+                }
+
+                if (root.sameSubKeys)
+                {
+                    for (auto &entry : root.cached->entries)
+                        root.entries.push_back(ComponentIndex::Entry{entry.key, 0, {}});
+
+                    return;
+                }
+
+                for (auto &name : root.key->EnumSubKeys())
+                    root.entries.push_back(ComponentIndex::Entry{std::move(name), 0, {}});
+            };
+
+            if (parallel)
+            {
+                parallel_for(roots.size(), enumRoot);
+            }
+            else
+            {
+                for (size_t r = 0; r != roots.size(); r++)
+                    enumRoot(r);
+            }
+
+            // (root, entry) pairs of the roots not taken from the index as they are
+            ulib::list<std::pair<size_t, size_t>> work;
+
+            for (size_t r = 0; r != roots.size(); r++)
+            {
+                if (roots[r].reused)
+                    continue;
+
+                for (size_t e = 0; e != roots[r].entries.size(); e++)
+                    work.push_back({r, e});
+            }
+
+            auto readEntry = [&](size_t i) {
+                auto &root = roots[work[i].first];
+                auto &entry = root.entries[work[i].second];
+
+                auto node = root.key->OpenSubKey(entry.key);
+                if (node && !valuesSubKey.empty())
+                    node = node->OpenSubKey(valuesSubKey);
+
+                if (index)
+                {
+                    if (node)
+                        entry.lastWriteTime = node->QueryInfo().lastWriteTime;
+
+                    // Values rewritten in place bump only the key that holds them, never the root, so this
+                    // comparison is what catches them
+                    auto old = root.cached ? root.cached->Find(entry.key) : nullptr;
+                    if (old && old->lastWriteTime != 0 && old->lastWriteTime == entry.lastWriteTime)
+                    {
+                        entry.component = old->component;
+                        return;
+                    }
+                }
+
+                if (!node)
+                    return;
+
+                try
+                {
+                    entry.component = read_component(*node, entry.key, options.filter, *arena);
+                }
+                catch (...)
+                {
+                    // An entry that cannot be read is left out, as the enumerate_* generators do
+                }
+            };
+
+            // Every entry writes only to its own slot, so the result order does not depend on scheduling
+            if (parallel)
+            {
+                parallel_for(work.size(), readEntry);
+            }
+            else
+            {
+                for (size_t i = 0; i != work.size(); i++)
+                    readEntry(i);
+            }
+
+            ulib::list<WindowsComponent> result;
+            for (size_t r = 0; r != roots.size(); r++)
+            {
+                auto &root = roots[r];
+                for (auto &entry : root.entries)
+                {
+                    if (entry.component)
+                        result.push_back(*entry.component);
                 }
 
-                sknode.Close();
+                // A root taken from the index leaves it, and so the file, untouched. One whose entries were compared
+                // is stored even if none changed, to record when that was.
+                if (index && !root.reused)
+                {
+                    ComponentIndex::Root stored;
+                    stored.filterTag = options.filterTag;
+                    stored.subKeyCount = root.info.subKeyCount;
+                    stored.lastWriteTime = root.info.lastWriteTime;
+                    stored.entries = std::move(root.entries);
+                    stored.checkedAt = now;
+
+                    index->StoreRoot(root.name, std::move(stored));
+                }
+            }
+
+            return result;
+        }
+
+        // Key names are case-insensitive, so are the GUIDs
+        inline std::string guid_key(ulib::string_view guid)
+        {
+            std::string key{guid.data(), guid.size()};
+            std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
+
+            return key;
+        }
+
+        // Keeps the first component of every GUID
+        inline ulib::list<WindowsComponent> dedupe_components(ulib::list<WindowsComponent> components)
+        {
+            std::unordered_set<std::string> seen;
+            ulib::list<WindowsComponent> result;
+
+            for (auto &component : components)
+            {
+                if (seen.insert(guid_key(component.guid)).second)
+                    result.push_back(std::move(component));
             }
 
-            unode.Close();
+            return result;
         }
 
-        return result;
+        struct UninstallRoot
+        {
+            std::wstring name;
+            RegistryRoot root;
+            std::wstring path;
+            RegistryView view;
+        };
+
+        // In precedence order: a GUID registered in several roots is reported from the first one
+        inline ulib::list<UninstallRoot> uninstall_roots()
+        {
+            std::wstring path = L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall";
+            std::wstring wowPath = L"SOFTWARE\\WOW6432Node\\Microsoft\\Windows\\CurrentVersion\\Uninstall";
+
+            return {
+                {L"HKLM\\" + path, RegistryRoot::LocalMachine, path, RegistryView::Wow64_64},
+                {L"HKLM\\" + wowPath, RegistryRoot::LocalMachine, wowPath, RegistryView::Wow64_32},
+                {L"HKCU\\" + path, RegistryRoot::CurrentUser, path, RegistryView::Default},
+            };
+        }
+
+        inline const std::wstring &installer_user_data_path()
+        {
+            static const std::wstring path = L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Installer\\UserData";
+            return path;
+        }
+    } // namespace detail
+
+    inline ulib::list<WindowsComponent> list_uninstall_components(const ComponentScanOptions &options = {},
+                                                                  const RegistryBackend &registry = default_registry())
+    {
+        ulib::list<detail::ComponentRootScan> roots;
+        for (auto &uroot : detail::uninstall_roots())
+        {
+            if (auto unode = registry.OpenKey(uroot.root, uroot.path, uroot.view))
+                roots.push_back({uroot.name, std::move(unode)});
+        }
+
+        return detail::dedupe_components(detail::scan_component_roots(roots, L"", options, true));
     }
 
-    inline ulib::list<WindowsComponent> list_installer_components()
+    inline ulib::list<WindowsComponent> list_installer_components(const ComponentScanOptions &options = {},
+                                                                  const RegistryBackend &registry = default_registry())
     {
-        ulib::list<WindowsComponent> result;
+        auto &path = detail::installer_user_data_path();
 
-        ulib::wstring path = L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Installer\\UserData";
+        auto unode = registry.OpenKey(RegistryRoot::LocalMachine, path);
+        if (!unode)
+            return {};
 
-        winreg::RegKey unode;
-        unode.Create(HKEY_LOCAL_MACHINE, path, KEY_READ | KEY_ENUMERATE_SUB_KEYS);
-        auto sids = unode.EnumSubKeys();
-        unode.Close();
+        // The Products keys stay open so each worker opens its GUID relative to them,
+        // and the per-GUID reads of all SIDs are spread across one pool
+        ulib::list<detail::ComponentRootScan> roots;
 
-        for (auto &sid : sids)
-        {
-            auto products = path + L"\\" + sid + L"\\Products";
+        unode->ForEachSubKey([&](const std::wstring &sid) {
+            auto sidNode = unode->OpenSubKey(sid);
+            auto snode = sidNode ? sidNode->OpenSubKey(L"Products") : nullptr;
+            if (snode)
+                roots.push_back({L"HKLM\\" + path + L"\\" + sid + L"\\Products", std::move(snode)});
+        });
 
-            winreg::RegKey snode;
-            snode.Create(HKEY_LOCAL_MACHINE, products, KEY_READ | KEY_ENUMERATE_SUB_KEYS);
-            auto guids = snode.EnumSubKeys();
-            snode.Close();
+        return detail::scan_component_roots(roots, L"InstallProperties", options, true);
+    }
 
-            for (auto &guid : guids)
+    // Lazy counterpart of list_uninstall_components(): a component's keys are opened only when the consumer
+    // advances to it, so a search that stops at the first match leaves the rest of the registry untouched.
+    // Subkey names of a root are listed up front, values are not. `arena` and `registry` must outlive the generator.
+    inline Generator<WindowsComponent> enumerate_uninstall_components(ComponentNameFilter filter, StringArena &arena,
+                                                                      const RegistryBackend &registry =
+                                                                          default_registry())
+    {
+        std::unordered_set<std::string> seen;
+
+        for (auto &uroot : detail::uninstall_roots())
+        {
+            auto unode = registry.OpenKey(uroot.root, uroot.path, uroot.view);
+            if (!unode)
+                continue;
+
+            for (auto &guid : unode->EnumSubKeys())
             {
-                winreg::RegKey gnode;
-                gnode.Create(HKEY_LOCAL_MACHINE, products + L"\\" + guid + L"\\InstallProperties",
-                             KEY_READ | KEY_ENUMERATE_SUB_KEYS);
+                std::optional<WindowsComponent> component;
 
                 try
                 {
-                    auto dn = gnode.TryGetStringValue(L"DisplayName");
-                    auto dv = gnode.TryGetStringValue(L"DisplayVersion");
-                    auto us = gnode.TryGetStringValue(L"UninstallString");
-                    auto sc = gnode.TryGetDwordValue(L"SystemComponent");
+                    if (auto node = unode->OpenSubKey(guid))
+                        component = detail::read_component(*node, guid, filter, arena);
+                }
+                catch (...)
+                {
+                }
 
-                    if (dn && dv)
-                    {
-                        WindowsComponent component;
-                        component.DisplayName = ulib::u8(dn.GetValue());
-                        component.DisplayVersion = ulib::u8(dv.GetValue());
-                        component.UninstallString = us ? ulib::u8(us.GetValue()) : "";
-                        component.SystemComponent = bool(sc ? sc.GetValue() : 0);
-                        component.guid = ulib::u8(guid);
-
-                        result.push_back(std::move(component));
-                    }
+                if (component && seen.insert(detail::guid_key(component->guid)).second)
+                    co_yield *component;
+            }
+        }
+    }
+
+    // Lazy counterpart of list_installer_components()
+    inline Generator<WindowsComponent> enumerate_installer_components(ComponentNameFilter filter, StringArena &arena,
+                                                                      const RegistryBackend &registry =
+                                                                          default_registry())
+    {
+        auto unode = registry.OpenKey(RegistryRoot::LocalMachine, detail::installer_user_data_path());
+        if (!unode)
+            co_return;
+
+        for (auto &sid : unode->EnumSubKeys())
+        {
+            auto sidNode = unode->OpenSubKey(sid);
+            auto snode = sidNode ? sidNode->OpenSubKey(L"Products") : nullptr;
+            if (!snode)
+                continue;
+
+            for (auto &guid : snode->EnumSubKeys())
+            {
+                std::optional<WindowsComponent> component;
+
+                try
+                {
+                    auto node = snode->OpenSubKey(guid);
+                    if (node)
+                        node = node->OpenSubKey(L"InstallProperties");
+                    if (node)
+                        component = detail::read_component(*node, guid, filter, arena);
                 }
-                catch (const std::exception& ex)
+                catch (...)
                 {
-                    printf("ex: %s\n", ex.what());
                 }
 
-                gnode.Close();
+                if (component)
+                    co_yield *component;
             }
         }
+    }
+
+    // Walks Uninstall and Installer\UserData once each and hands every component to all matching classifiers,
+    // so several consumers can share one pass over the registry instead of rescanning it per filter.
+    // Component strings live in `arena`, or in the index arena when an index is given.
+    inline void scan_components(const ulib::list<ComponentClassifier> &classifiers, StringArena &arena,
+                                const RegistryBackend &registry = default_registry(), ComponentIndex *index = nullptr)
+    {
+        ComponentScanOptions options;
+        options.index = index;
+        options.arena = &arena;
+
+        // Entries no classifier wants are dropped after reading DisplayName only
+        options.filter = [&](ulib::string_view displayName) {
+            for (auto &classifier : classifiers)
+            {
+                if (classifier.match(displayName))
+                    return true;
+            }
+
+            return false;
+        };
+
+        for (auto &classifier : classifiers)
+            options.filterTag.append(classifier.name + ";");
+
+        auto dispatch = [&](ComponentSource source, const ulib::list<WindowsComponent> &components) {
+            for (auto &component : components)
+            {
+                for (auto &classifier : classifiers)
+                {
+                    if (classifier.match(component.DisplayName))
+                        classifier.accept(source, component);
+                }
+            }
+        };
 
-        return result;
+        dispatch(ComponentSource::Uninstall, list_uninstall_components(options, registry));
+        dispatch(ComponentSource::Installer, list_installer_components(options, registry));
     }
 
 } // namespace vcwin
\ No newline at end of file
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace vcwin
+{
+    namespace detail
+    {
+        // Forward-only reader over a JSON document in memory. Nothing is materialized: values the caller does not
+        // ask for are skipped byte by byte, which keeps large documents such as VS state.json files (the package
+        // lists run into hundreds of kilobytes) cheap. Every method returns false on malformed input.
+        class JsonScanner
+        {
+        public:
+            JsonScanner(std::string_view text) : mText(text)
+            {
+            }
+
+            // Calls fn(key) for each member of the object at the cursor. fn has to consume the value, either by
+            // reading it or with SkipValue(). Returning false from fn stops early.
+            template <class Fn>
+            bool ForEachMember(Fn &&fn)
+            {
+                if (!Consume('{'))
+                    return false;
+
+                if (Consume('}'))
+                    return true;
+
+                std::string key;
+                do
+                {
+                    if (!ReadString(&key) || !Consume(':'))
+                        return false;
+
+                    if (!fn(std::string_view{key}))
+                        return true;
+                } while (Consume(','));
+
+                return Consume('}');
+            }
+
+            // Calls fn() for each element of the array at the cursor, fn has to consume the element. Returning
+            // false from fn stops early.
+            template <class Fn>
+            bool ForEachElement(Fn &&fn)
+            {
+                if (!Consume('['))
+                    return false;
+
+                if (Consume(']'))
+                    return true;
+
+                do
+                {
+                    if (!fn())
+                        return true;
+                } while (Consume(','));
+
+                return Consume(']');
+            }
+
+            // First character of the next value: '{', '[', '"', or the start of a number or literal
+            char PeekValue()
+            {
+                SkipSpace();
+                return Peek();
+            }
+
+            // Number or literal as written, true/false/null and numbers are not interpreted here
+            bool ReadScalarText(std::string_view &out)
+            {
+                SkipSpace();
+
+                size_t begin = mPos;
+                while (mPos != mText.size() && !IsDelimiter(mText[mPos]))
+                    mPos++;
+
+                out = mText.substr(begin, mPos - begin);
+                return !out.empty();
+            }
+
+            // True when only whitespace is left
+            bool AtEnd()
+            {
+                SkipSpace();
+                return mPos == mText.size();
+            }
+
+            // Reads a string value, unescaped. Any other kind of value is skipped and leaves out untouched.
+            bool ReadStringValue(std::string &out)
+            {
+                SkipSpace();
+                if (Peek() != '"')
+                    return SkipValue();
+
+                return ReadString(&out);
+            }
+
+            bool SkipValue()
+            {
+                SkipSpace();
+                if (mPos == mText.size())
+                    return false;
+
+                char c = mText[mPos];
+                if (c == '"')
+                    return ReadString(nullptr);
+
+                if (c != '{' && c != '[')
+                {
+                    // Numbers and literals run up to the next delimiter
+                    size_t begin = mPos;
+                    while (mPos != mText.size() && !IsDelimiter(mText[mPos]))
+                        mPos++;
+
+                    return mPos != begin;
+                }
+
+                // Containers are skipped by depth, only strings need care since they may hold brackets
+                size_t depth = 0;
+                while (mPos != mText.size())
+                {
+                    c = mText[mPos];
+                    if (c == '"')
+                    {
+                        if (!ReadString(nullptr))
+                            return false;
+
+                        continue;
+                    }
+
+                    mPos++;
+                    if (c == '{' || c == '[')
+                        depth++;
+                    else if ((c == '}' || c == ']') && --depth == 0)
+                        return true;
+                }
+
+                return false;
+            }
+
+            // With out == nullptr the string is only stepped over
+            bool ReadString(std::string *out)
+            {
+                if (!Consume('"'))
+                    return false;
+
+                if (out)
+                    out->clear();
+
+                while (mPos != mText.size())
+                {
+                    // Plain runs are copied in one go
+                    size_t begin = mPos;
+                    while (mPos != mText.size() && mText[mPos] != '"' && mText[mPos] != '\\')
+                        mPos++;
+
+                    if (out)
+                        out->append(mText.data() + begin, mPos - begin);
+
+                    if (mPos == mText.size())
+                        return false;
+
+                    if (mText[mPos++] == '"')
+                        return true;
+
+                    if (mPos == mText.size())
+                        return false;
+
+                    if (!ReadEscape(out))
+                        return false;
+                }
+
+                return false;
+            }
+
+        private:
+            static bool IsDelimiter(char c)
+            {
+                return c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n';
+            }
+
+            char Peek() const
+            {
+                return mPos == mText.size() ? '\0' : mText[mPos];
+            }
+
+            void SkipSpace()
+            {
+                while (mPos != mText.size() && (mText[mPos] == ' ' || mText[mPos] == '\t' || mText[mPos] == '\r' ||
+                                                mText[mPos] == '\n'))
+                    mPos++;
+            }
+
+            bool Consume(char c)
+            {
+                SkipSpace();
+                if (Peek() != c)
+                    return false;
+
+                mPos++;
+                return true;
+            }
+
+            bool ReadHex4(uint32_t &value)
+            {
+                if (mText.size() - mPos < 4)
+                    return false;
+
+                value = 0;
+                for (size_t end = mPos + 4; mPos != end; mPos++)
+                {
+                    char c = mText[mPos];
+                    value <<= 4;
+                    if (c >= '0' && c <= '9')
+                        value |= uint32_t(c - '0');
+                    else if (c >= 'a' && c <= 'f')
+                        value |= uint32_t(c - 'a' + 10);
+                    else if (c >= 'A' && c <= 'F')
+                        value |= uint32_t(c - 'A' + 10);
+                    else
+                        return false;
+                }
+
+                return true;
+            }
+
+            static void AppendUtf8(std::string &out, uint32_t cp)
+            {
+                if (cp < 0x80)
+                {
+                    out += char(cp);
+                }
+                else if (cp < 0x800)
+                {
+                    out += char(0xC0 | (cp >> 6));
+                    out += char(0x80 | (cp & 0x3F));
+                }
+                else if (cp < 0x10000)
+                {
+                    out += char(0xE0 | (cp >> 12));
+                    out += char(0x80 | ((cp >> 6) & 0x3F));
+                    out += char(0x80 | (cp & 0x3F));
+                }
+                else
+                {
+                    out += char(0xF0 | (cp >> 18));
+                    out += char(0x80 | ((cp >> 12) & 0x3F));
+                    out += char(0x80 | ((cp >> 6) & 0x3F));
+                    out += char(0x80 | (cp & 0x3F));
+                }
+            }
+
+            // The escape sequence after a backslash
+            bool ReadEscape(std::string *out)
+            {
+                char esc = mText[mPos++];
+                char plain = 0;
+                switch (esc)
+                {
+                case '"':
+                case '\\':
+                case '/':
+                    plain = esc;
+                    break;
+                case 'b':
+                    plain = '\b';
+                    break;
+                case 'f':
+                    plain = '\f';
+                    break;
+                case 'n':
+                    plain = '\n';
+                    break;
+                case 'r':
+                    plain = '\r';
+                    break;
+                case 't':
+                    plain = '\t';
+                    break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!ReadHex4(cp))
+                        return false;
+
+                    // A high surrogate is only meaningful with the low one right after it
+                    if (cp >= 0xD800 && cp < 0xDC00 && mText.substr(mPos, 2) == "\\u")
+                    {
+                        mPos += 2;
+
+                        uint32_t low;
+                        if (!ReadHex4(low) || low < 0xDC00 || low >= 0xE000)
+                            return false;
+
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+
+                    if (out)
+                        AppendUtf8(*out, cp);
+                    return true;
+                }
+                default:
+                    return false;
+                }
+
+                if (out)
+                    *out += plain;
+
+                return true;
+            }
+
+            std::string_view mText;
+            size_t mPos = 0;
+        };
+    } // namespace detail
+} // namespace vcwin
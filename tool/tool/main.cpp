@@ -3,8 +3,18 @@
 // #include <httplib.h>
 #include "download_file.h"
 
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
 #include <filesystem>
+#include <fstream>
+#include <functional>
+#include <io.h>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
 
 #include <3rdparty/WinReg.hpp>
 #include <Windows.h>
@@ -15,10 +25,20 @@
 #include <ulib/format.h>
 #include <ulib/runtimeerror.h>
 #include <ulib/strutility.h>
-#include <ulib/yaml.h>
 
 #include "dxsdk.h"
+#include "batch.h"
+#include "component_index.h"
+#include "dev_environment.h"
+#include "emitter.h"
 #include "installers.h"
+#include "parallel.h"
+#include "projection.h"
+#include "query.h"
+#include "registry.h"
+#include "resident.h"
+#include "snapshot.h"
+#include "state_document.h"
 #include "vctools.h"
 #include "winsdk.h"
 
@@ -70,23 +90,46 @@ namespace tool
     {
         Yaml = 0,
         Json = 1,
+        Ndjson = 2,
+        Cbor = 3,
     };
 
     class ToolState
     {
     public:
-        void print(const ulib::json &value)
+        // Writes one document in the selected format, fn(vcwin::Emitter &) produces it
+        template <class Fn>
+        void emit(Fn &&fn)
         {
+            vcwin::OutputBuffer out{stdout};
             if (mFormat == FormatType::Json)
             {
-                fmt::print("{}\n", value.dump());
+                vcwin::JsonEmitter emitter{out};
+                fn(emitter);
+            }
+            else if (mFormat == FormatType::Ndjson)
+            {
+                vcwin::NdjsonEmitter emitter{out};
+                fn(emitter);
+            }
+            else if (mFormat == FormatType::Cbor)
+            {
+                vcwin::CborEmitter emitter{out};
+                fn(emitter);
             }
             else
             {
-                fmt::print("{}\n", ulib::yaml::parse(value.dump()).dump());
+                vcwin::YamlEmitter emitter{out};
+                fn(emitter);
             }
         }
 
+        void print(const ulib::json &value)
+        {
+            auto text = value.dump();
+            emit([&](vcwin::Emitter &emitter) { vcwin::emit_json_text(text, emitter); });
+        }
+
         void print_error(ulib::string_view error)
         {
             ulib::json value;
@@ -100,15 +143,26 @@ namespace tool
             ulib::json help;
 
             auto &commands = help["commands"];
-            commands.push_back() = "state";
+            commands.push_back() = "state [--resident] [--timings] [--query <path>...] "
+                                   "(e.g. winsdk.WdkProductVersion10, /environment/INCLUDE)";
+            commands.push_back() = "serve [--stop]";
+            commands.push_back() = "snapshot <file>";
+            commands.push_back() = "env [--host <arch>] [--arch <arch>] [--toolset <version>] [--sdk <version>] "
+                                   "[--compare <recorded set output>]";
+            commands.push_back() = "query <constraints...> (e.g. \">=10.0.19041 wdk kmdf>=1.33\")";
             commands.push_back() = "install <package name> <package version>";
             commands.push_back() = "uninstall/remove <package name> <package version> [--show-string] [--full]";
             commands.push_back() = "search [<package name>] [<package version>]";
             commands.push_back() = "list <package name>";
             commands.push_back() = "get <package name>";
+            commands.push_back() = "batch [<file>] (one command per line, from stdin without a file)";
 
             auto &flags = help["flags"];
-            flags["--format"] = "yaml/json";
+            flags["--format"] = "yaml/json/ndjson/cbor, ndjson streams one record per line from state, list and "
+                                "search, cbor is read back with cbor_reader.h";
+            flags["--registry"] = "<snapshot.reg/json> read the registry from a snapshot instead of this machine";
+            flags["--snapshot"] = "<file> read state, list and get results from a binary snapshot instead of probing";
+            flags["--no-index"] = "ignore the component index and rescan the registry";
 
             print(help);
         }
@@ -124,7 +178,7 @@ namespace tool
             ulib::string productName = mArgs[1];
             if (productName == "wdk")
             {
-                vcwin::WindowsSDK wsdk;
+                auto &wsdk = WindowsSDK();
                 if (auto productVersion = wsdk.GetWDKProductVersion10())
                 {
                     fmt::print("WDKProductVersion10: {}\n", *productVersion);
@@ -133,7 +187,7 @@ namespace tool
 
             if (productName == "sdk")
             {
-                vcwin::WindowsSDK wsdk;
+                auto &wsdk = WindowsSDK();
                 if (auto w10sdk = wsdk.GetWindows10SdkInfo())
                 {
                     fmt::print("Name: {}\nVersion: {}\nDirectory: {}\n", w10sdk->name, w10sdk->version,
@@ -146,17 +200,273 @@ namespace tool
 
         int ExecuteState()
         {
-            vcwin::VCTools vcTools;
-            vcwin::WindowsSDK winsdk;
-            vcwin::DirectXSdk dxsdk;
+            // --query selects parts of the document up front, probes that feed none of them are not run
+            std::optional<vcwin::Projection> projection;
+            auto queryPaths = detail::parse_any_arg_option(mArgs, "--query");
+            if (queryPaths.size() > 0)
+            {
+                try
+                {
+                    projection = vcwin::Projection::Parse(queryPaths);
+                }
+                catch (const std::exception &ex)
+                {
+                    return print_error(ex.what()), 1;
+                }
+            }
+
+            // Writes the document, or just the selected values of it
+            auto write = [&](auto &&document) {
+                if (!projection)
+                    return emit(document), 0;
+
+                bool found = false;
+                emit([&](vcwin::Emitter &emitter) {
+                    vcwin::ProjectionEmitter selected{emitter, *projection};
+                    document(selected);
+                    found = selected.Finish();
+                });
+
+                if (found)
+                    return 0;
+
+                if (projection->GetPaths().size() == 1)
+                    print_error(ulib::format("Nothing at {}", projection->GetPaths().front().text));
+                return 1;
+            };
+
+            // Falls back to probing in this process when no `vcwin serve` is running
+            if (mArgs.contains("--resident"))
+            {
+                if (auto reply = vcwin::query_resident(mArgs.contains("--timings") ? "state --timings" : "state"))
+                    return write([&](vcwin::Emitter &emitter) { vcwin::emit_json_text(*reply, emitter); });
+            }
+
+            auto wanted = [&](const char *member) { return !projection || projection->Selects(member); };
+            bool wantEnvironment = wanted("environment");
+
+            // The probes only share the registry backend and the component index, both safe to read from several
+            // threads. VCTools mostly waits on vswhere.exe, so the whole command takes about as long as that probe.
+            // The document is written out once all of them are done, NDJSON records as soon as each probe has them.
+            const vcwin::VCTools *vcTools = nullptr;
+            vcwin::WindowsSDK *winsdk = nullptr;
+            const vcwin::DirectXSdk *dxsdk = nullptr;
+
+            // A projection is one small result, it is not broken up into records
+            std::optional<vcwin::NdjsonWriter> records;
+            if (mFormat == FormatType::Ndjson && !projection)
+                records.emplace(stdout);
+
+            // Each probe with the timing it reports
+            vcwin::StateTimings timings;
+            using Duration = std::chrono::steady_clock::duration;
+            std::pair<Duration vcwin::StateTimings::*, std::function<void()>> probes[] = {
+                {&vcwin::StateTimings::vctools,
+                 [&] {
+                     if (!wanted("vctools") && !wantEnvironment)
+                         return;
+
+                     vcTools = &VCTools();
+                     if (records)
+                         RecordVCTools(*records, *vcTools);
+                 }},
+                {&vcwin::StateTimings::winsdk,
+                 [&] {
+                     // With a projection the sections are probed as the document asks for them
+                     winsdk = &WindowsSDK();
+                     if (projection)
+                         return;
+
+                     if (records)
+                         RecordComponents(*records, *winsdk, {});
+
+                     winsdk->ProbeAll();
+                     if (records)
+                         RecordWindowsSDK(*records, *winsdk);
+                 }},
+                {&vcwin::StateTimings::dxsdk,
+                 [&] {
+                     if (!wanted("dxsdk"))
+                         return;
+
+                     dxsdk = &DirectXSdk();
+                     if (records)
+                         records->Record([&](vcwin::Emitter &emitter) { RecordModel(emitter, "dxsdk", *dxsdk); });
+                 }},
+            };
+
+            constexpr size_t probeCount = std::size(probes);
+
+            auto begin = std::chrono::steady_clock::now();
+            vcwin::parallel_for(
+                probeCount,
+                [&](size_t i) {
+                    auto probeBegin = std::chrono::steady_clock::now();
+                    probes[i].second();
+                    timings.*probes[i].first = std::chrono::steady_clock::now() - probeBegin;
+                },
+                probeCount);
+            timings.total = std::chrono::steady_clock::now() - begin;
+
+            vcwin::StateEnvironment environment;
+            if (wantEnvironment)
+                environment = vcwin::StateEnvironment::Make(*vcTools, *winsdk);
+
+            if (records)
+            {
+                records->Record([&](vcwin::Emitter &emitter) { RecordModel(emitter, "environment", environment); });
+                if (mArgs.contains("--timings"))
+                    records->Record([&](vcwin::Emitter &emitter) { RecordModel(emitter, "timings_ms", timings); });
+
+                return 0;
+            }
+
+            vcwin::StateDocument document{vcTools, winsdk, dxsdk, &environment};
+            if (mArgs.contains("--timings"))
+                document.timings = &timings;
+
+            return write([&](vcwin::Emitter &emitter) { document.Emit(emitter); });
+        }
+
+        int ExecuteQuery()
+        {
+            // Everything up to the first flag is the query, so constraints may be passed as one or several args
+            ulib::string text;
+            for (size_t i = 1; i < mArgs.size() && !mArgs[i].starts_with("--"); i++)
+            {
+                text += mArgs[i];
+                text += " ";
+            }
+
+            vcwin::SDKQuery query;
+            try
+            {
+                query = vcwin::SDKQuery::Parse(text);
+            }
+            catch (const std::exception &ex)
+            {
+                return print_error(ex.what()), 1;
+            }
+
+            auto result = vcwin::resolve_sdk_query(WindowsSDK(), query);
+            if (!result.sdk)
+                return print_error("No SDK matches the query"), 1;
+
+            print(result.ToJson());
+            return 0;
+        }
+
+        int ExecuteEnv()
+        {
+            vcwin::DevEnvironmentOptions options;
+
+            auto option = [&](ulib::string_view name, ulib::string &out) {
+                auto values = detail::parse_any_arg_option(mArgs, name);
+                if (values.size() > 0)
+                    out = values.front();
+            };
+
+            option("--host", options.host);
+            option("--arch", options.target);
+            option("--toolset", options.toolsetVersion);
+            option("--sdk", options.sdkVersion);
+
+            auto compare = detail::parse_any_arg_option(mArgs, "--compare");
+
+            // Like vcvarsall the toolchain goes in front of the current PATH, except when checking against a
+            // recording, which holds a PATH from another session
+            ulib::string inheritedPath;
+            if (compare.size() == 0)
+            {
+                if (auto path = ulib::getenv(u8"PATH"))
+                    inheritedPath = ulib::str(*path);
+            }
+
+            vcwin::DevEnvironment env;
+            try
+            {
+                env = vcwin::make_dev_environment(VCTools(), WindowsSDK(), options,
+                                                  std::string_view{inheritedPath.data(), inheritedPath.size()});
+            }
+            catch (const std::exception &ex)
+            {
+                return print_error(ex.what()), 1;
+            }
+
+            if (compare.size() == 0)
+                return emit([&](vcwin::Emitter &emitter) { env.Emit(emitter); }), 0;
+
+            auto recorded = futile::open(fs::path{ulib::sstr(compare.front())}, "r").read();
+            auto mismatches =
+                vcwin::compare_dev_environment(env, std::string_view{recorded.data(), recorded.size()});
 
             ulib::json value;
-            value["vctools"] = vcTools.ToJson();
-            value["winsdk"] = winsdk.ToJson();
-            value["dxsdk"] = dxsdk.ToJson();
+            auto &jmismatches = value["mismatches"];
+            jmismatches = ulib::json::object();
+            for (auto &mismatch : mismatches)
+            {
+                auto &jmismatch = jmismatches[mismatch.name];
+                jmismatch["computed"] = mismatch.computed;
+                jmismatch["recorded"] = mismatch.recorded;
+            }
 
             print(value);
+            return mismatches.size() == 0 ? 0 : 1;
+        }
+
+        int ExecuteSnapshot()
+        {
+            if (mArgs.size() < 2)
+            {
+                print_error("Expected 1 args");
+                return 1;
+            }
+
+            vcwin::StateSnapshot::Write(fs::path{ulib::sstr(mArgs[1])}, VCTools(), WindowsSDK(), DirectXSdk());
+            return 0;
+        }
+
+        int ExecuteServe()
+        {
+            if (mArgs.contains("--stop"))
+            {
+                auto reply = vcwin::query_resident("stop");
+                if (!reply)
+                    return print_error("vcwin serve is not running"), 1;
+                if (*reply != "{}")
+                    return print_error(ulib::format("vcwin serve did not stop: {}", *reply)), 1;
+
+                return 0;
+            }
+
+            vcwin::ResidentState state{Registry(), Index()};
+            auto watches = vcwin::default_resident_watches();
+
+            // A snapshot never changes, its watcher only runs the refreshes clients ask for
+            std::unique_ptr<vcwin::RegistryChangeSource> source;
+            if (mRegistrySnapshot)
+                source = std::make_unique<vcwin::FakeRegistryChangeSource>();
+            else
+                source = std::make_unique<vcwin::LiveRegistryChangeSource>(watches);
+
+            std::thread watcher{[&] { state.Watch(*source, watches); }};
 
+            auto stopWatcher = [&] {
+                source->Stop();
+                watcher.join();
+            };
+
+            try
+            {
+                vcwin::serve_resident_pipe(state);
+            }
+            catch (...)
+            {
+                stopWatcher();
+                throw;
+            }
+
+            stopWatcher();
             return 0;
         }
 
@@ -169,9 +479,12 @@ namespace tool
             }
 
             auto productName = mArgs[1];
+            if (mFormat == FormatType::Ndjson)
+                return ExecuteListRecords(productName);
+
             if (productName == "wdk")
             {
-                vcwin::WindowsSDK winsdk;
+                auto &winsdk = WindowsSDK();
 
                 for (auto &sdk : winsdk.GetSDKs())
                 {
@@ -182,7 +495,7 @@ namespace tool
                     {
                         fmt::print(" - {}. Components: {}. Uninstaller: {}\n",
                                    sdk.wdkUninstallComponents.front().DisplayVersion, sdk.wdkUninstallComponents.size(),
-                                   uninstaller ? uninstaller->DisplayName : "null");
+                                   uninstaller ? uninstaller->DisplayName : ulib::string_view{"null"});
                     }
                     else
                     {
@@ -196,7 +509,7 @@ namespace tool
             }
             else if (productName == "sdk")
             {
-                vcwin::WindowsSDK winsdk;
+                auto &winsdk = WindowsSDK();
 
                 for (auto &sdk : winsdk.GetSDKs())
                 {
@@ -216,10 +529,62 @@ namespace tool
             return 0;
         }
 
+        // --format ndjson: one record per component of the product while the registry scan runs, then one per SDK
+        int ExecuteListRecords(ulib::string_view productName)
+        {
+            if (productName != "wdk" && productName != "sdk")
+                return 0;
+
+            vcwin::NdjsonWriter records{stdout};
+
+            auto &winsdk = WindowsSDK();
+            RecordComponents(records, winsdk, productName);
+
+            for (auto &sdk : winsdk.GetSDKs())
+            {
+                bool wdk = productName == "wdk";
+                auto &components = wdk ? sdk.wdkUninstallComponents : sdk.sdkUninstallComponents;
+
+                // Same selection as the text listing
+                if (wdk && components.size() == 0 && !sdk.hasWDKInOptions)
+                    continue;
+
+                records.Record([&](vcwin::Emitter &emitter) {
+                    emitter.BeginObject();
+                    emitter.Field("type", "sdk");
+                    vcwin::emit_sdk_item_fields(emitter, sdk, false);
+
+                    emitter.Key("version");
+                    if (components.size() > 0)
+                        emitter.Value(components.front().DisplayVersion);
+                    else
+                        emitter.Null();
+
+                    emitter.Field("components", components.size());
+
+                    if (wdk)
+                    {
+                        auto uninstaller = sdk.FindWdkUninstaller();
+                        emitter.Key("uninstaller");
+                        if (uninstaller)
+                            emitter.Value(uninstaller->DisplayName);
+                        else
+                            emitter.Null();
+                    }
+
+                    emitter.EndObject();
+                });
+            }
+
+            return 0;
+        }
+
         int ExecuteSearch()
         {
-            vcwin::PackageLibrary lib;
-            auto localPackages = lib.GetLocal();
+            auto &localPackages = PackageLibrary().GetLocal();
+
+            if (mFormat == FormatType::Ndjson)
+                return ExecuteSearchRecords(localPackages);
 
             if (mArgs.size() > 1)
             {
@@ -256,6 +621,111 @@ namespace tool
             return 0;
         }
 
+        // --format ndjson: one record per package version, {"type":"package","name","version","link"}
+        int ExecuteSearchRecords(const ulib::json &packages)
+        {
+            auto arg = [&](size_t i) {
+                return i < mArgs.size() ? std::string_view{mArgs[i].data(), mArgs[i].size()} : std::string_view{};
+            };
+
+            auto name = arg(1);
+            auto version = arg(2);
+
+            vcwin::NdjsonWriter records{stdout};
+            size_t found = 0;
+
+            auto emitVersions = [&](ulib::string_view package, const ulib::json &versions) {
+                for (auto &item : versions.items())
+                {
+                    auto &packageVersion = item.name();
+                    if (!version.empty() && std::string_view{packageVersion.data(), packageVersion.size()} != version)
+                        continue;
+
+                    found++;
+                    records.Record([&](vcwin::Emitter &emitter) {
+                        emitter.BeginObject();
+                        emitter.Field("type", "package");
+                        emitter.Field("name", package);
+                        emitter.Field("version", packageVersion);
+                        emitter.Field("link", item.value().get<ulib::string>());
+                        emitter.EndObject();
+                    });
+                }
+            };
+
+            if (!name.empty())
+            {
+                if (auto versions = packages.search(mArgs[1]))
+                    emitVersions(mArgs[1], *versions);
+            }
+            else
+            {
+                for (auto &item : packages.items())
+                    emitVersions(item.name(), item.value());
+            }
+
+            if (found == 0 && !name.empty())
+                return print_error("Package not found"), 1;
+
+            return 0;
+        }
+
+        // One command per line of a file, or of stdin without one, all run against the same models, so the whole
+        // batch costs one probe pass. Empty lines and lines starting with # are skipped. Every command writes its
+        // own result, as YAML each one is a document of its own. --registry, --snapshot and --no-index apply to the
+        // whole batch, --format may also be given per command.
+        int ExecuteBatch()
+        {
+            std::ifstream file;
+            if (mArgs.size() > 1 && !mArgs[1].starts_with("--"))
+            {
+                file.open(fs::path{ulib::sstr(mArgs[1])});
+                if (!file)
+                    return print_error("Failed to open the batch file"), 1;
+            }
+
+            std::istream &input = file.is_open() ? file : std::cin;
+
+            auto batchArgs = mArgs;
+            auto batchFormat = mFormat;
+
+            bool succeeded = vcwin::run_batch(
+                input,
+                [&](const std::vector<std::string> &args, std::string_view line) {
+                    mArgs.clear();
+                    for (auto &arg : args)
+                        mArgs.push_back(ulib::string_view{arg.data(), arg.size()});
+
+                    mFormat = batchFormat;
+                    SelectFormat();
+
+                    if (mFormat == FormatType::Yaml)
+                        fmt::print("--- # {}\n", line);
+
+                    int code = 1;
+                    try
+                    {
+                        if (mArgs[0] == "batch" || mArgs[0] == "serve")
+                            print_error(ulib::format("{} cannot run in a batch", mArgs[0]));
+                        else
+                            code = ExecuteCommand();
+                    }
+                    catch (const std::exception &ex)
+                    {
+                        print_error(ex.what());
+                    }
+
+                    RestoreStdoutMode();
+                    return code;
+                },
+                [this] { ResetModels(); });
+
+            mArgs = batchArgs;
+            mFormat = batchFormat;
+
+            return succeeded ? 0 : 1;
+        }
+
         int ExecuteInstall()
         {
             if (mArgs.size() < 3)
@@ -269,7 +739,7 @@ namespace tool
 
             if (packageName == "wdk" || packageName == "dxsdk")
             {
-                vcwin::PackageLibrary lib;
+                auto &lib = PackageLibrary();
                 if (auto link = lib.FindPackage(packageName, version))
                 {
                     ulib::u8string path = ulib::format(u8"{}_{}.exe", packageName, version);
@@ -297,7 +767,7 @@ namespace tool
             }
             else if (packageName == "sdk")
             {
-                vcwin::PackageLibrary lib;
+                auto &lib = PackageLibrary();
                 if (auto component = lib.FindPackage(packageName, version))
                 {
                     vcwin::VSInstaller installer;
@@ -333,36 +803,31 @@ namespace tool
 
             if (packageName == "wdk")
             {
-                vcwin::WindowsSDK wsdk;
-                if (auto sdk = wsdk.FindSDKByWDKVersion(version))
+                // Only the first matching uninstaller is needed, so the registry is searched lazily
+                vcwin::StringArena arena;
+                if (auto uninstaller = vcwin::WindowsSDK::FindWdkUninstaller(version, arena, Registry()))
                 {
-                    if (auto uninstaller = sdk->FindWdkUninstaller())
+                    if (mArgs.contains("--show-string"))
                     {
-                        if (uninstaller->DisplayVersion == version)
-                        {
-                            if (mArgs.contains("--show-string"))
-                            {
-                                fmt::print("{}\n", uninstaller->UninstallString);
-                                return 0;
-                            }
+                        fmt::print("{}\n", uninstaller->UninstallString);
+                        return 0;
+                    }
 
-                            ulib::u8string exec = ulib::u8(uninstaller->UninstallString + " /q");
-                            fmt::print(" -> {}\n", exec);
+                    ulib::u8string exec = ulib::u8(ulib::string{uninstaller->UninstallString} + " /q");
+                    fmt::print(" -> {}\n", exec);
 
-                            int code = ulib::process{exec}.wait();
-                            fmt::print("Uninstaller exited with code: {}\n", code);
+                    int code = ulib::process{exec}.wait();
+                    fmt::print("Uninstaller exited with code: {}\n", code);
 
-                            if (code != 0)
-                                return code;
+                    if (code != 0)
+                        return code;
 
-                            uninstalled++;
-                        }
-                    }
+                    uninstalled++;
                 }
 
                 if (mArgs.contains("--full"))
                 {
-                    wsdk = vcwin::WindowsSDK{};
+                    vcwin::WindowsSDK wsdk{Registry(), Index()};
                     if (auto sdk = wsdk.FindSDKByWDKVersion(version))
                     {
                         for (auto &component : sdk->wdkUninstallComponents)
@@ -381,7 +846,7 @@ namespace tool
             }
             else if (packageName == "sdk")
             {
-                vcwin::PackageLibrary lib;
+                auto &lib = PackageLibrary();
                 if (auto component = lib.FindPackage(packageName, version))
                 {
                     vcwin::VSInstaller installer;
@@ -422,9 +887,69 @@ namespace tool
             mPathToThis = argv[0];
             mArgs = ulib::list<ulib::string_view>{argv + 1, argv + argc};
 
-            if (detail::parse_any_arg_option(mArgs, "--format").contains("json"))
+            SelectFormat();
+
+            auto registrySnapshot = detail::parse_any_arg_option(mArgs, "--registry");
+            if (registrySnapshot.size() > 0)
+                mRegistrySnapshot = vcwin::SnapshotRegistry::Load(fs::path{ulib::sstr(registrySnapshot.front())});
+
+            auto stateSnapshot = detail::parse_any_arg_option(mArgs, "--snapshot");
+            if (stateSnapshot.size() > 0)
+                mStateSnapshot = vcwin::StateSnapshot::Open(fs::path{ulib::sstr(stateSnapshot.front())});
+
+            mNoIndex = mArgs.contains("--no-index");
+
+            int code = ExecuteCommand();
+            RestoreStdoutMode();
+
+            try
+            {
+                if (mComponentIndex)
+                    mComponentIndex->Save();
+            }
+            catch (...)
+            {
+                // The index is only a cache, failing to persist it must not fail the command
+            }
+
+            return code;
+        }
+
+    private:
+        // Picks up --format from the args, keeps the current format without one
+        void SelectFormat()
+        {
+            auto format = detail::parse_any_arg_option(mArgs, "--format");
+            if (format.contains("yaml"))
+                mFormat = FormatType::Yaml;
+            else if (format.contains("json"))
                 mFormat = FormatType::Json;
+            else if (format.contains("ndjson"))
+                mFormat = FormatType::Ndjson;
+            else if (format.contains("cbor"))
+                mFormat = FormatType::Cbor;
+
+            // Text mode would turn every 0x0A byte of the binary output into CR LF
+            if (mFormat == FormatType::Cbor && mStdoutMode == -1)
+            {
+                std::fflush(stdout);
+                mStdoutMode = _setmode(_fileno(stdout), _O_BINARY);
+            }
+        }
+
+        // Puts stdout back into the mode SelectFormat found it in, so the next command of a batch writes text again
+        void RestoreStdoutMode()
+        {
+            if (mStdoutMode == -1)
+                return;
 
+            std::fflush(stdout);
+            _setmode(_fileno(stdout), mStdoutMode);
+            mStdoutMode = -1;
+        }
+
+        int ExecuteCommand()
+        {
             if (mArgs.size() >= 1)
             {
                 if (mArgs[0] == "help" || mArgs[0] == "--help" || mArgs[0] == "-h" || mArgs[0] == "/?")
@@ -433,6 +958,18 @@ namespace tool
                 if (mArgs[0] == "state")
                     return ExecuteState();
 
+                if (mArgs[0] == "serve")
+                    return ExecuteServe();
+
+                if (mArgs[0] == "snapshot")
+                    return ExecuteSnapshot();
+
+                if (mArgs[0] == "query")
+                    return ExecuteQuery();
+
+                if (mArgs[0] == "env")
+                    return ExecuteEnv();
+
                 if (mArgs[0] == "install")
                     return ExecuteInstall();
 
@@ -447,15 +984,232 @@ namespace tool
 
                 if (mArgs[0] == "get")
                     return ExecuteGet();
+
+                if (mArgs[0] == "batch")
+                    return ExecuteBatch();
             }
 
             return print_help(), 0;
         }
 
-    private:
+        // {"type": <type>, <type>: <value>} for records that carry one whole model
+        template <class Model>
+        static void RecordModel(vcwin::Emitter &emitter, const char *type, const Model &model)
+        {
+            emitter.BeginObject();
+            emitter.Field("type", type);
+            emitter.Key(type);
+            if constexpr (std::is_invocable_v<const Model &, vcwin::Emitter &>)
+                model(emitter);
+            else
+                model.Emit(emitter);
+            emitter.EndObject();
+        }
+
+        static void RecordVCTools(vcwin::NdjsonWriter &records, const vcwin::VCTools &vcTools)
+        {
+            records.Record([&](vcwin::Emitter &emitter) {
+                emitter.BeginObject();
+                emitter.Field("type", "vctools");
+                emitter.Field("vs_path", vcTools.GetVSPath());
+                emitter.Field("vswhere_path", vcTools.GetVswherePath());
+                emitter.Field("vc_tools_default_version", vcTools.GetVCToolsDefaultVersion());
+                emitter.EndObject();
+            });
+
+            for (auto &installation : vcTools.GetInstallations())
+            {
+                records.Record([&](vcwin::Emitter &emitter) {
+                    emitter.BeginObject();
+                    emitter.Field("type", "vs_instance");
+                    vcwin::emit_installation_fields(emitter, installation);
+                    emitter.EndObject();
+                });
+            }
+        }
+
+        static void RecordComponent(vcwin::NdjsonWriter &records, ulib::string_view kind,
+                                    vcwin::ComponentSource source, const vcwin::WindowsComponent &component)
+        {
+            records.Record([&](vcwin::Emitter &emitter) {
+                emitter.BeginObject();
+                emitter.Field("type", "component");
+                emitter.Field("kind", kind);
+                emitter.Field("source", source == vcwin::ComponentSource::Uninstall ? "uninstall" : "installer");
+                emitter.Field("DisplayName", component.DisplayName);
+                vcwin::emit_component_fields(emitter, component);
+                emitter.EndObject();
+            });
+        }
+
+        // Component records of `kind`, or of both kinds when empty. Probing the items reports them as the scan
+        // finds them, items that are already there, probed earlier or loaded from a snapshot, are replayed.
+        static void RecordComponents(vcwin::NdjsonWriter &records, vcwin::WindowsSDK &winsdk, ulib::string_view kind)
+        {
+            if (!winsdk.HasItems())
+            {
+                winsdk.SetComponentObserver([&records, kind](ulib::string_view componentKind,
+                                                             vcwin::ComponentSource source,
+                                                             const vcwin::WindowsComponent &component) {
+                    if (kind.empty() || componentKind == kind)
+                        RecordComponent(records, componentKind, source, component);
+                });
+
+                winsdk.GetSDKs();
+                winsdk.SetComponentObserver({});
+                return;
+            }
+
+            auto replay = [&](ulib::string_view componentKind, vcwin::ComponentSource source,
+                              const ulib::list<vcwin::WindowsComponent> &components) {
+                if (kind.empty() || componentKind == kind)
+                {
+                    for (auto &component : components)
+                        RecordComponent(records, componentKind, source, component);
+                }
+            };
+
+            for (auto &sdk : winsdk.GetSDKs())
+            {
+                replay("sdk", vcwin::ComponentSource::Uninstall, sdk.sdkUninstallComponents);
+                replay("sdk", vcwin::ComponentSource::Installer, sdk.sdkInstallerComponents);
+                replay("wdk", vcwin::ComponentSource::Uninstall, sdk.wdkUninstallComponents);
+                replay("wdk", vcwin::ComponentSource::Installer, sdk.wdkInstallerComponents);
+            }
+        }
+
+        // The SDK items without their components, which have their own records, and the kit-wide values
+        static void RecordWindowsSDK(vcwin::NdjsonWriter &records, const vcwin::WindowsSDK &winsdk)
+        {
+            for (auto &sdk : winsdk.GetSDKs())
+            {
+                records.Record([&](vcwin::Emitter &emitter) {
+                    emitter.BeginObject();
+                    emitter.Field("type", "sdk");
+                    vcwin::emit_sdk_item_fields(emitter, sdk, false);
+                    emitter.EndObject();
+                });
+            }
+
+            records.Record([&](vcwin::Emitter &emitter) {
+                auto info = winsdk.GetWindows10SdkInfo();
+
+                emitter.BeginObject();
+                emitter.Field("type", "winsdk");
+                emitter.Field("v10_source", winsdk.GetWindows10SdkInfoSource());
+
+                emitter.Key("v10");
+                emitter.BeginObject();
+                if (info)
+                {
+                    emitter.Field("InstallationFolder", info->directory);
+                    emitter.Field("ProductVersion", info->version);
+                    emitter.Field("ProductName", info->name);
+                }
+                emitter.EndObject();
+
+                emitter.Field("WdkProductVersion10", winsdk.GetWDKProductVersion10());
+                emitter.Field("WdkProductVersion10_source", winsdk.GetWDKProductVersion10Source());
+                emitter.Field("kmdf_source", winsdk.GetKMDFVersionsSource());
+
+                emitter.Key("kmdf");
+                emitter.BeginArray();
+                for (auto &kmdf : winsdk.GetKMDFVersions())
+                    emitter.Value(kmdf);
+                emitter.EndArray();
+
+                emitter.EndObject();
+            });
+        }
+
+        const vcwin::RegistryBackend &Registry() const
+        {
+            if (mRegistrySnapshot)
+                return *mRegistrySnapshot;
+
+            return vcwin::default_registry();
+        }
+
+        // Loaded by the first command that scans, commands that never scan neither read nor write the file
+        vcwin::ComponentIndex *Index() const
+        {
+            std::call_once(mComponentIndexLoaded, [this] {
+                // Snapshots have no meaningful key timestamps, so they are always scanned in full
+                if (mRegistrySnapshot || mNoIndex)
+                    return;
+
+                try
+                {
+                    mComponentIndex = std::make_unique<vcwin::ComponentIndex>(vcwin::ComponentIndex::DefaultPath());
+                }
+                catch (...)
+                {
+                }
+            });
+
+            return mComponentIndex.get();
+        }
+
+        // The probes of `state` fill the models from several threads, each from its own
+        const vcwin::VCTools &VCTools()
+        {
+            return mModels.GetVCTools();
+        }
+
+        vcwin::WindowsSDK &WindowsSDK()
+        {
+            return mModels.GetWindowsSDK();
+        }
+
+        const vcwin::DirectXSdk &DirectXSdk()
+        {
+            return mModels.GetDirectXSdk();
+        }
+
+        vcwin::PackageLibrary &PackageLibrary()
+        {
+            if (!mPackageLibrary)
+                mPackageLibrary = std::make_unique<vcwin::PackageLibrary>();
+
+            return *mPackageLibrary;
+        }
+
+        // Installs and uninstalls change what the models describe
+        void ResetModels()
+        {
+            mModels.Reset();
+            mPackageLibrary.reset();
+        }
+
+        // With --snapshot the models come from the snapshot file instead of probing this machine
+        vcwin::VCTools MakeVCTools() const
+        {
+            return mStateSnapshot ? mStateSnapshot->LoadVCTools() : vcwin::VCTools{};
+        }
+
+        vcwin::WindowsSDK MakeWindowsSDK() const
+        {
+            return mStateSnapshot ? mStateSnapshot->LoadWindowsSDK() : vcwin::WindowsSDK{Registry(), Index()};
+        }
+
+        vcwin::DirectXSdk MakeDirectXSdk() const
+        {
+            return mStateSnapshot ? mStateSnapshot->LoadDirectXSdk() : vcwin::DirectXSdk{Registry()};
+        }
+
         FormatType mFormat;
+        int mStdoutMode = -1;
         ulib::list<ulib::string_view> mArgs;
         fs::path mPathToThis;
+        std::unique_ptr<vcwin::SnapshotRegistry> mRegistrySnapshot;
+        bool mNoIndex = false;
+        mutable std::once_flag mComponentIndexLoaded;
+        mutable std::unique_ptr<vcwin::ComponentIndex> mComponentIndex;
+        std::shared_ptr<const vcwin::StateSnapshot> mStateSnapshot;
+
+        vcwin::ModelCache mModels{[this] { return MakeVCTools(); }, [this] { return MakeWindowsSDK(); },
+                                  [this] { return MakeDirectXSdk(); }};
+        std::unique_ptr<vcwin::PackageLibrary> mPackageLibrary;
     };
 
     // void perform_state(const ulib::list<ulib::string_view> &args)
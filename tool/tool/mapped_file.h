@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <ulib/format.h>
+#include <ulib/runtimeerror.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vcwin
+{
+    namespace fs = std::filesystem;
+
+    // Read-only memory map of a whole file
+    class MappedFile
+    {
+    public:
+        MappedFile(const fs::path &path)
+        {
+#ifdef _WIN32
+            mFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (mFile == INVALID_HANDLE_VALUE)
+                throw ulib::RuntimeError{ulib::format("Failed to open {}, error: {}", path.string(), GetLastError())};
+
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(mFile, &size))
+            {
+                Close();
+                throw ulib::RuntimeError{ulib::format("Failed to get size of {}", path.string())};
+            }
+
+            mSize = size_t(size.QuadPart);
+            if (mSize == 0)
+                return;
+
+            mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mMapping)
+                mData = static_cast<const char *>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+#else
+            mFile = ::open(path.c_str(), O_RDONLY);
+            if (mFile < 0)
+                throw ulib::RuntimeError{ulib::format("Failed to open {}", path.string())};
+
+            struct stat st;
+            if (::fstat(mFile, &st) != 0)
+            {
+                Close();
+                throw ulib::RuntimeError{ulib::format("Failed to get size of {}", path.string())};
+            }
+
+            mSize = size_t(st.st_size);
+            if (mSize == 0)
+                return;
+
+            void *data = ::mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFile, 0);
+            if (data != MAP_FAILED)
+                mData = static_cast<const char *>(data);
+#endif
+
+            if (!mData)
+            {
+                Close();
+                throw ulib::RuntimeError{ulib::format("Failed to map {}", path.string())};
+            }
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile()
+        {
+            Close();
+        }
+
+        const char *data() const
+        {
+            return mData;
+        }
+
+        size_t size() const
+        {
+            return mSize;
+        }
+
+    private:
+        void Close()
+        {
+#ifdef _WIN32
+            if (mData)
+                UnmapViewOfFile(mData);
+            if (mMapping)
+                CloseHandle(mMapping);
+            if (mFile != INVALID_HANDLE_VALUE)
+                CloseHandle(mFile);
+
+            mMapping = nullptr;
+            mFile = INVALID_HANDLE_VALUE;
+#else
+            if (mData)
+                ::munmap(const_cast<char *>(mData), mSize);
+            if (mFile >= 0)
+                ::close(mFile);
+
+            mFile = -1;
+#endif
+            mData = nullptr;
+        }
+
+#ifdef _WIN32
+        HANDLE mFile = INVALID_HANDLE_VALUE;
+        HANDLE mMapping = nullptr;
+#else
+        int mFile = -1;
+#endif
+        const char *mData = nullptr;
+        size_t mSize = 0;
+    };
+} // namespace vcwin
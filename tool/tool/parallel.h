@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vcwin
+{
+    namespace detail
+    {
+        inline size_t default_worker_count()
+        {
+            size_t hw = std::thread::hardware_concurrency();
+            return std::clamp<size_t>(hw, 1, 16);
+        }
+    } // namespace detail
+
+    // Calls fn(i) for every i in [0, count) on a bounded pool of workers.
+    // Items are handed out through a shared counter, so callers that write into slot i get results in a
+    // deterministic order regardless of scheduling. The first exception thrown by fn is rethrown here.
+    template <class Fn>
+    void parallel_for(size_t count, Fn &&fn, size_t maxWorkers = 0)
+    {
+        if (count == 0)
+            return;
+
+        size_t workers = std::min(maxWorkers ? maxWorkers : detail::default_worker_count(), count);
+        if (workers <= 1)
+        {
+            for (size_t i = 0; i != count; i++)
+                fn(i);
+
+            return;
+        }
+
+        std::atomic<size_t> next{0};
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        auto work = [&]() {
+            for (size_t i = next++; i < count; i = next++)
+            {
+                try
+                {
+                    fn(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard lock{errorMutex};
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(workers - 1);
+        for (size_t i = 1; i != workers; i++)
+            threads.emplace_back(work);
+
+        work();
+
+        for (auto &thread : threads)
+            thread.join();
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+} // namespace vcwin
@@ -0,0 +1,320 @@
+#pragma once
+
+#include "emitter.h"
+#include <algorithm>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ulib/runtimeerror.h>
+#include <ulib/string.h>
+
+namespace vcwin
+{
+    // A value inside a document, as the JSON pointer "/winsdk/WdkProductVersion10" or the dotted
+    // "winsdk.WdkProductVersion10". Array elements are selected by index, "winsdk.SDKs.0.windows_version".
+    struct DocumentPath
+    {
+        ulib::string text;
+        std::vector<std::string> segments;
+
+        static DocumentPath Parse(ulib::string_view text)
+        {
+            DocumentPath path;
+            path.text = text;
+
+            std::string_view rest{text.data(), text.size()};
+            bool pointer = rest.starts_with('/');
+            if (pointer)
+                rest.remove_prefix(1);
+
+            char separator = pointer ? '/' : '.';
+            while (!rest.empty())
+            {
+                auto end = rest.find(separator);
+                auto segment = rest.substr(0, end);
+                rest = end == std::string_view::npos ? std::string_view{} : rest.substr(end + 1);
+
+                if (segment.empty())
+                    throw ulib::RuntimeError{ulib::format("Empty segment in path: {}", text)};
+
+                std::string unescaped;
+                for (size_t i = 0; i != segment.size(); i++)
+                {
+                    // JSON pointer escapes, ~1 is '/' and ~0 is '~'
+                    if (pointer && segment[i] == '~' && i + 1 != segment.size() &&
+                        (segment[i + 1] == '0' || segment[i + 1] == '1'))
+                    {
+                        unescaped += segment[++i] == '1' ? '/' : '~';
+                        continue;
+                    }
+
+                    unescaped += segment[i];
+                }
+
+                path.segments.push_back(std::move(unescaped));
+            }
+
+            if (path.segments.empty())
+                throw ulib::RuntimeError{ulib::format("Empty path: {}", text)};
+
+            return path;
+        }
+    };
+
+    // Paths selected from a document. Known before anything is written, so whoever produces the document can ask
+    // which of its parts are needed and skip the work for the rest.
+    class Projection
+    {
+    public:
+        static Projection Parse(const ulib::list<ulib::string_view> &texts)
+        {
+            Projection projection;
+            for (auto &text : texts)
+                projection.mPaths.push_back(DocumentPath::Parse(text));
+
+            return projection;
+        }
+
+        const std::vector<DocumentPath> &GetPaths() const
+        {
+            return mPaths;
+        }
+
+        // Whether a selected path runs through the top-level member `key`
+        bool Selects(std::string_view key) const
+        {
+            for (auto &path : mPaths)
+            {
+                if (path.segments.front() == key)
+                    return true;
+            }
+
+            return false;
+        }
+
+    private:
+        std::vector<DocumentPath> mPaths;
+    };
+
+    // Passes on only the selected values of the document written into it. With one path the value alone is
+    // written, with several an object keyed by the path texts. Finish() completes the output.
+    class ProjectionEmitter : public Emitter
+    {
+    public:
+        ProjectionEmitter(Emitter &target, const Projection &projection)
+            : mTarget(target), mPaths(projection.GetPaths()), mFound(mPaths.size(), false)
+        {
+        }
+
+        void BeginObject() override
+        {
+            BeginContainer(true);
+        }
+
+        void EndObject() override
+        {
+            EndContainer(true);
+        }
+
+        void BeginArray() override
+        {
+            BeginContainer(false);
+        }
+
+        void EndArray() override
+        {
+            EndContainer(false);
+        }
+
+        bool Wants(std::string_view key) const override
+        {
+            if (mForwarding != 0)
+                return true;
+
+            // The member would sit at the depth of the innermost open object
+            size_t depth = mFrames.size();
+            if (depth == 0 || !mFrames.back().object)
+                return true;
+
+            for (auto &path : mPaths)
+            {
+                if (path.segments.size() < depth || path.segments[depth - 1] != key)
+                    continue;
+
+                if (PrefixMatches(path, depth - 1))
+                    return true;
+            }
+
+            return false;
+        }
+
+        // Writes what is left of a multi-path result, paths that matched nothing come out as null. Returns false
+        // if a path matched nothing, in which case a single-path projection has written nothing at all.
+        bool Finish()
+        {
+            bool all = std::find(mFound.begin(), mFound.end(), false) == mFound.end();
+            if (mPaths.size() == 1)
+                return all;
+
+            OpenResult();
+            for (size_t i = 0; i != mPaths.size(); i++)
+            {
+                if (!mFound[i])
+                {
+                    mTarget.Key(mPaths[i].text);
+                    mTarget.Null();
+                }
+            }
+            mTarget.EndObject();
+
+            return all;
+        }
+
+    protected:
+        void WriteKey(std::string_view key) override
+        {
+            mFrames.back().key = key;
+            if (mForwarding != 0)
+                mTarget.Key(key);
+        }
+
+        void WriteString(std::string_view value) override
+        {
+            if (StartValue())
+                mTarget.Value(value);
+            EndValue();
+        }
+
+        void WriteBool(bool value) override
+        {
+            if (StartValue())
+                mTarget.Value(value);
+            EndValue();
+        }
+
+        void WriteNull() override
+        {
+            if (StartValue())
+                mTarget.Null();
+            EndValue();
+        }
+
+        void WriteNumber(std::string_view text) override
+        {
+            if (StartValue())
+                mTarget.Number(text);
+            EndValue();
+        }
+
+    private:
+        struct Frame
+        {
+            bool object;
+            std::string key;
+            size_t index = 0;
+        };
+
+        static bool SegmentMatches(const Frame &frame, std::string_view segment)
+        {
+            if (frame.object)
+                return frame.key == segment;
+
+            size_t index = 0;
+            auto result = std::from_chars(segment.data(), segment.data() + segment.size(), index);
+            return result.ec == std::errc{} && result.ptr == segment.data() + segment.size() && index == frame.index;
+        }
+
+        // The first `count` segments of `path` are where the open frames currently are
+        bool PrefixMatches(const DocumentPath &path, size_t count) const
+        {
+            for (size_t i = 0; i != count; i++)
+            {
+                if (!SegmentMatches(mFrames[i], path.segments[i]))
+                    return false;
+            }
+
+            return true;
+        }
+
+        // Called as a value begins, true when it is to be passed on
+        bool StartValue()
+        {
+            if (mForwarding != 0)
+                return true;
+
+            size_t depth = mFrames.size();
+            for (size_t i = 0; i != mPaths.size(); i++)
+            {
+                if (mFound[i] || mPaths[i].segments.size() != depth || !PrefixMatches(mPaths[i], depth))
+                    continue;
+
+                mFound[i] = true;
+                if (mPaths.size() != 1)
+                {
+                    OpenResult();
+                    mTarget.Key(mPaths[i].text);
+                }
+
+                return true;
+            }
+
+            return false;
+        }
+
+        // Called as a value ends, moves the enclosing array on to its next element
+        void EndValue()
+        {
+            if (!mFrames.empty() && !mFrames.back().object)
+                mFrames.back().index++;
+        }
+
+        void BeginContainer(bool object)
+        {
+            if (StartValue())
+            {
+                mForwarding++;
+                if (object)
+                    mTarget.BeginObject();
+                else
+                    mTarget.BeginArray();
+            }
+
+            mFrames.push_back({object, {}, 0});
+        }
+
+        void EndContainer(bool object)
+        {
+            mFrames.pop_back();
+
+            if (mForwarding != 0)
+            {
+                mForwarding--;
+                if (object)
+                    mTarget.EndObject();
+                else
+                    mTarget.EndArray();
+            }
+
+            EndValue();
+        }
+
+        void OpenResult()
+        {
+            if (mResultOpen)
+                return;
+
+            mResultOpen = true;
+            mTarget.BeginObject();
+        }
+
+        Emitter &mTarget;
+        const std::vector<DocumentPath> &mPaths;
+        std::vector<bool> mFound;
+        std::vector<Frame> mFrames;
+
+        // Depth of the selected container being passed on, 0 outside of one
+        size_t mForwarding = 0;
+        bool mResultOpen = false;
+    };
+} // namespace vcwin
@@ -0,0 +1,274 @@
+#pragma once
+
+#include "winsdk.h"
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <ulib/json.h>
+#include <ulib/runtimeerror.h>
+#include <ulib/string.h>
+
+namespace vcwin
+{
+    enum class VersionOp
+    {
+        Less,
+        LessEqual,
+        Equal,
+        GreaterEqual,
+        Greater,
+    };
+
+    struct VersionConstraint
+    {
+        VersionOp op;
+        uint64_t key;
+
+        bool Matches(uint64_t value) const
+        {
+            switch (op)
+            {
+            case VersionOp::Less:
+                return value < key;
+            case VersionOp::LessEqual:
+                return value <= key;
+            case VersionOp::Equal:
+                return value == key;
+            case VersionOp::GreaterEqual:
+                return value >= key;
+            case VersionOp::Greater:
+                return value > key;
+            }
+
+            return false;
+        }
+    };
+
+    namespace detail
+    {
+        // KMDF versions are "major.minor", packed like wversion keys so they compare as integers
+        constexpr std::optional<uint32_t> parse_kmdf_version(std::string_view ver)
+        {
+            auto dot = ver.find('.');
+            if (dot == std::string_view::npos || dot == 0 || dot + 1 == ver.size())
+                return std::nullopt;
+
+            uint32_t parts[2] = {};
+            for (size_t i = 0, part = 0; i != ver.size(); i++)
+            {
+                if (i == dot)
+                {
+                    part++;
+                    continue;
+                }
+
+                if (ver[i] < '0' || ver[i] > '9')
+                    return std::nullopt;
+
+                parts[part] = parts[part] * 10 + uint32_t(ver[i] - '0');
+                if (parts[part] > 0xFFFF)
+                    return std::nullopt;
+            }
+
+            return (parts[0] << 16) | parts[1];
+        }
+
+        static_assert(parse_kmdf_version("1.33") == ((1u << 16) | 33));
+        static_assert(*parse_kmdf_version("1.9") < *parse_kmdf_version("1.33"));
+        static_assert(!parse_kmdf_version("1") && !parse_kmdf_version("1.") && !parse_kmdf_version("1.x"));
+
+        // Splits "<op><version>" into the operator and the rest, a bare version means equality
+        inline VersionOp split_version_op(std::string_view &term)
+        {
+            constexpr std::pair<std::string_view, VersionOp> ops[] = {
+                {">=", VersionOp::GreaterEqual}, {"<=", VersionOp::LessEqual}, {">", VersionOp::Greater},
+                {"<", VersionOp::Less},          {"==", VersionOp::Equal},     {"=", VersionOp::Equal},
+            };
+
+            for (auto &[text, op] : ops)
+            {
+                if (term.starts_with(text))
+                {
+                    term.remove_prefix(text.size());
+                    return op;
+                }
+            }
+
+            return VersionOp::Equal;
+        }
+    } // namespace detail
+
+    // Constraints on an installed SDK, resolved to the newest SDK that satisfies all of them.
+    //
+    // Text form, terms separated by spaces or commas:
+    //   >=10.0.19041 <10.0.26100   SDK build bounds, also <=, >, = or a bare version
+    //   wdk                        a WDK for the same build is installed
+    //   kmdf, kmdf>=1.31, kmdf=1.33 KMDF headers of the kit, optionally of a given version
+    struct SDKQuery
+    {
+        ulib::list<VersionConstraint> build;
+        bool requireWDK = false;
+        bool requireKMDF = false;
+        ulib::list<VersionConstraint> kmdf;
+
+        static SDKQuery Parse(ulib::string_view text)
+        {
+            SDKQuery query;
+
+            std::string_view rest{text.data(), text.size()};
+            while (!rest.empty())
+            {
+                auto end = rest.find_first_of(" ,");
+                auto term = rest.substr(0, end);
+                rest = end == std::string_view::npos ? std::string_view{} : rest.substr(end + 1);
+
+                if (term.empty())
+                    continue;
+
+                if (term == "wdk")
+                {
+                    query.requireWDK = true;
+                }
+                else if (term.starts_with("kmdf"))
+                {
+                    query.requireKMDF = true;
+
+                    term.remove_prefix(4);
+                    if (term.empty())
+                        continue;
+
+                    auto op = detail::split_version_op(term);
+                    auto ver = detail::parse_kmdf_version(term);
+                    if (!ver)
+                        throw ulib::RuntimeError{ulib::format("Invalid KMDF version: {}", term)};
+
+                    query.kmdf.push_back({op, *ver});
+                }
+                else
+                {
+                    if (term.starts_with("sdk"))
+                        term.remove_prefix(3);
+
+                    auto op = detail::split_version_op(term);
+                    auto key = wversion::parse_key(term);
+                    if (!key)
+                        throw ulib::RuntimeError{ulib::format("Invalid SDK version: {}", term)};
+
+                    query.build.push_back({op, wversion::build_id(*key)});
+                }
+            }
+
+            return query;
+        }
+    };
+
+    struct SDKQueryResult
+    {
+        const WindowsSDKItem *sdk = nullptr;
+
+        // KMDF versions of the kit that satisfied the query, newest first
+        ulib::list<ulib::string> kmdfVersions;
+
+        ulib::json ToJson() const
+        {
+            ulib::json val = ulib::json::object();
+            if (!sdk)
+                return val;
+
+            val["windows_version"] = sdk->windowsBuildVersion;
+            val["in_InstalledRoots"] = sdk->inInstalledRoots;
+            val["has_wdk_in_options"] = sdk->hasWDKInOptions;
+
+            if (sdk->sdkUninstallComponents.size() > 0)
+                val["sdk_version"] = sdk->sdkUninstallComponents.front().DisplayVersion;
+
+            if (auto uninstaller = sdk->FindWdkUninstaller())
+            {
+                val["wdk_version"] = uninstaller->DisplayVersion;
+                val["wdk_uninstall_string"] = uninstaller->UninstallString;
+            }
+
+            auto &jkmdf = val["kmdf"];
+            jkmdf = ulib::json::array();
+            for (auto &kmdf : kmdfVersions)
+                jkmdf.push_back() = kmdf;
+
+            return val;
+        }
+    };
+
+    // Walks the build-sorted SDK index from the newest build inside the bounds downwards and returns the first
+    // item that passes the remaining checks, so the same model and query always give the same answer.
+    inline SDKQueryResult resolve_sdk_query(const WindowsSDK &winsdk, const SDKQuery &query)
+    {
+        SDKQueryResult result;
+
+        // KMDF headers live in the kit root, shared by all SDK builds
+        if (query.requireKMDF)
+        {
+            ulib::list<std::pair<uint32_t, ulib::string>> kmdf;
+            for (auto &ver : winsdk.GetKMDFVersions())
+            {
+                auto key = detail::parse_kmdf_version(std::string_view{ver.data(), ver.size()});
+                if (!key)
+                    continue;
+
+                bool matches = std::all_of(query.kmdf.begin(), query.kmdf.end(),
+                                           [&](const VersionConstraint &c) { return c.Matches(*key); });
+                if (matches)
+                    kmdf.push_back({*key, ver});
+            }
+
+            if (kmdf.size() == 0)
+                return result;
+
+            std::sort(kmdf.begin(), kmdf.end(), [](auto &left, auto &right) { return left.first > right.first; });
+            for (auto &entry : kmdf)
+                result.kmdfVersions.push_back(entry.second);
+        }
+
+        auto &order = winsdk.GetSDKsByBuild();
+
+        // Narrow the scan to the bounds first, the per-item checks below then only see candidates
+        uint64_t low = 0;
+        uint64_t high = UINT64_MAX;
+        for (auto &c : query.build)
+        {
+            if (c.op == VersionOp::GreaterEqual || c.op == VersionOp::Equal)
+                low = std::max(low, c.key);
+            if (c.op == VersionOp::LessEqual || c.op == VersionOp::Equal)
+                high = std::min(high, c.key);
+        }
+
+        auto first = std::lower_bound(order.begin(), order.end(), low,
+                                      [](auto &entry, uint64_t key) { return entry.first < key; });
+        auto last = std::upper_bound(order.begin(), order.end(), high,
+                                     [](uint64_t key, auto &entry) { return key < entry.first; });
+
+        for (auto it = last; it != first;)
+        {
+            --it;
+
+            bool inBounds = std::all_of(query.build.begin(), query.build.end(),
+                                        [&](const VersionConstraint &c) { return c.Matches(it->first); });
+            if (!inBounds)
+                continue;
+
+            auto &sdk = winsdk.GetSDKs()[it->second];
+
+            bool hasSDK = sdk.inInstalledRoots || sdk.sdkUninstallComponents.size() > 0;
+            if (!hasSDK)
+                continue;
+
+            bool hasWDK = sdk.wdkUninstallComponents.size() > 0 || sdk.hasWDKInOptions;
+            if (query.requireWDK && !hasWDK)
+                continue;
+
+            result.sdk = &sdk;
+            return result;
+        }
+
+        return result;
+    }
+} // namespace vcwin
@@ -0,0 +1,805 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cwchar>
+#include <cwctype>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <3rdparty/WinReg.hpp>
+#endif
+
+#include <ulib/format.h>
+#include <ulib/json.h>
+#include <ulib/runtimeerror.h>
+#include <ulib/string.h>
+
+namespace vcwin
+{
+    namespace fs = std::filesystem;
+
+    enum class RegistryRoot
+    {
+        LocalMachine = 0,
+        CurrentUser = 1,
+    };
+
+    enum class RegistryView
+    {
+        Default = 0,
+        // KEY_WOW64_32KEY: SOFTWARE\X resolves to SOFTWARE\WOW6432Node\X
+        Wow64_32 = 1,
+        Wow64_64 = 2,
+    };
+
+    // Same numbering as the Win32 REG_* constants
+    enum class RegistryValueType : uint32_t
+    {
+        None = 0,
+        String = 1,
+        ExpandString = 2,
+        Binary = 3,
+        Dword = 4,
+        MultiString = 7,
+        Qword = 11,
+    };
+
+    struct RegistryValue
+    {
+        RegistryValueType type = RegistryValueType::None;
+        std::wstring text;
+        uint64_t number = 0;
+    };
+
+    struct RegistryKeyInfo
+    {
+        uint32_t subKeyCount = 0;
+        uint32_t valueCount = 0;
+        // FILETIME as a 64-bit number; 0 if the backend does not know it
+        uint64_t lastWriteTime = 0;
+    };
+
+    // A key opened for reading. Implementations must be safe to use from several threads at once
+    // as long as each thread works on its own key objects.
+    class RegistryKey
+    {
+    public:
+        virtual ~RegistryKey() = default;
+
+        virtual RegistryKeyInfo QueryInfo() const = 0;
+
+        // Returns nullptr if the subkey does not exist or cannot be opened
+        virtual std::unique_ptr<RegistryKey> OpenSubKey(const std::wstring &name) const = 0;
+
+        virtual std::vector<std::wstring> EnumSubKeys() const = 0;
+
+        // Visits subkey names without materializing the whole list. The name reference is only valid during the call.
+        virtual void ForEachSubKey(const std::function<void(const std::wstring &)> &fn) const
+        {
+            for (auto &name : EnumSubKeys())
+                fn(name);
+        }
+
+        // Value names with their types
+        virtual std::vector<std::pair<std::wstring, RegistryValueType>> EnumValues() const = 0;
+
+        virtual std::optional<std::wstring> TryGetString(const std::wstring &name) const = 0;
+        virtual std::optional<uint32_t> TryGetDword(const std::wstring &name) const = 0;
+
+        // Reads the values named in `names` into `values` (same order) in as few calls as the backend allows.
+        // Missing values, and values of types other than string and DWORD, come back with type None.
+        virtual void ReadValues(const std::vector<std::wstring> &names, std::vector<RegistryValue> &values) const
+        {
+            values.assign(names.size(), RegistryValue{});
+
+            for (size_t i = 0; i != names.size(); i++)
+            {
+                if (auto text = TryGetString(names[i]))
+                    values[i] = RegistryValue{RegistryValueType::String, std::move(*text), 0};
+                else if (auto number = TryGetDword(names[i]))
+                    values[i] = RegistryValue{RegistryValueType::Dword, {}, *number};
+            }
+        }
+
+        std::wstring GetString(const std::wstring &name) const
+        {
+            if (auto value = TryGetString(name))
+                return *value;
+
+            throw ulib::RuntimeError{ulib::format("Registry value '{}' not found", ulib::u8(name))};
+        }
+    };
+
+    class RegistryBackend
+    {
+    public:
+        virtual ~RegistryBackend() = default;
+
+        // Returns nullptr if the key does not exist or cannot be opened
+        virtual std::unique_ptr<RegistryKey> OpenKey(RegistryRoot root, const std::wstring &path,
+                                                     RegistryView view = RegistryView::Default) const = 0;
+    };
+
+#ifdef _WIN32
+    class LiveRegistryKey : public RegistryKey
+    {
+    public:
+        LiveRegistryKey(REGSAM access, winreg::RegKey key) : mAccess(access), mKey(std::move(key))
+        {
+        }
+
+        RegistryKeyInfo QueryInfo() const override
+        {
+            RegistryKeyInfo info;
+
+            auto result = mKey.TryQueryInfoKey();
+            if (!result)
+                return info;
+
+            auto &key = result.GetValue();
+            info.subKeyCount = key.NumberOfSubKeys;
+            info.valueCount = key.NumberOfValues;
+            info.lastWriteTime =
+                (uint64_t(key.LastWriteTime.dwHighDateTime) << 32) | uint64_t(key.LastWriteTime.dwLowDateTime);
+
+            return info;
+        }
+
+        // Opened relative to this handle, so the kernel only resolves `name` instead of the full path from the hive
+        std::unique_ptr<RegistryKey> OpenSubKey(const std::wstring &name) const override
+        {
+            winreg::RegKey key;
+            if (key.TryOpen(mKey.Get(), name, mAccess).Failed())
+                return nullptr;
+
+            return std::make_unique<LiveRegistryKey>(mAccess, std::move(key));
+        }
+
+        std::vector<std::wstring> EnumSubKeys() const override
+        {
+            return mKey.EnumSubKeys();
+        }
+
+        void ForEachSubKey(const std::function<void(const std::wstring &)> &fn) const override
+        {
+            DWORD maxNameLength = 0;
+            if (::RegQueryInfoKeyW(mKey.Get(), nullptr, nullptr, nullptr, nullptr, &maxNameLength, nullptr, nullptr,
+                                   nullptr, nullptr, nullptr, nullptr) != ERROR_SUCCESS)
+                return;
+
+            // One buffer for every name; RegEnumKeyExW writes straight into it
+            std::wstring name;
+            name.reserve(maxNameLength + 1);
+
+            for (DWORD index = 0;; index++)
+            {
+                name.resize(maxNameLength + 1);
+                DWORD nameLength = maxNameLength + 1;
+
+                LSTATUS retCode = ::RegEnumKeyExW(mKey.Get(), index, name.data(), &nameLength, nullptr, nullptr,
+                                                  nullptr, nullptr);
+                if (retCode != ERROR_SUCCESS)
+                    break;
+
+                name.resize(nameLength);
+                fn(name);
+            }
+        }
+
+        std::vector<std::pair<std::wstring, RegistryValueType>> EnumValues() const override
+        {
+            std::vector<std::pair<std::wstring, RegistryValueType>> result;
+            for (auto &value : mKey.EnumValues())
+                result.push_back({value.first, RegistryValueType(value.second)});
+
+            return result;
+        }
+
+        std::optional<std::wstring> TryGetString(const std::wstring &name) const override
+        {
+            auto value = mKey.TryGetStringValue(name);
+            if (!value)
+                return std::nullopt;
+
+            return value.GetValue();
+        }
+
+        std::optional<uint32_t> TryGetDword(const std::wstring &name) const override
+        {
+            auto value = mKey.TryGetDwordValue(name);
+            if (!value)
+                return std::nullopt;
+
+            return value.GetValue();
+        }
+
+        void ReadValues(const std::vector<std::wstring> &names, std::vector<RegistryValue> &values) const override
+        {
+            // Scans read the same few names from thousands of keys, so each thread keeps its batch and buffer
+            thread_local std::unique_ptr<winreg::RegValueBatch> batch;
+
+            bool sameNames = batch && batch->Size() == names.size();
+            for (size_t i = 0; sameNames && i != names.size(); i++)
+                sameNames = batch->Name(i) == names[i];
+
+            if (!sameNames)
+                batch = std::make_unique<winreg::RegValueBatch>(names);
+
+            values.assign(names.size(), RegistryValue{});
+            if (mKey.TryGetValues(*batch).Failed())
+                return;
+
+            for (size_t i = 0; i != names.size(); i++)
+            {
+                if (!batch->Found(i))
+                    continue;
+
+                // A REG_DWORD with fewer than four data bytes is left missing, like any other unreadable value
+                DWORD type = batch->Type(i);
+                if (type == REG_SZ)
+                    values[i] = RegistryValue{RegistryValueType::String, batch->GetString(i), 0};
+                else if (auto number = batch->GetDword(i))
+                    values[i] = RegistryValue{RegistryValueType::Dword, {}, *number};
+            }
+        }
+
+    private:
+        REGSAM mAccess;
+        winreg::RegKey mKey;
+    };
+
+    // Reads the registry of the machine vcwin runs on
+    class LiveRegistry : public RegistryBackend
+    {
+    public:
+        std::unique_ptr<RegistryKey> OpenKey(RegistryRoot root, const std::wstring &path,
+                                             RegistryView view = RegistryView::Default) const override
+        {
+            HKEY hroot = root == RegistryRoot::CurrentUser ? HKEY_CURRENT_USER : HKEY_LOCAL_MACHINE;
+
+            REGSAM access = KEY_READ;
+            if (view == RegistryView::Wow64_32)
+                access |= KEY_WOW64_32KEY;
+            else if (view == RegistryView::Wow64_64)
+                access |= KEY_WOW64_64KEY;
+
+            winreg::RegKey key;
+            if (key.TryOpen(hroot, path, access).Failed())
+                return nullptr;
+
+            return std::make_unique<LiveRegistryKey>(access, std::move(key));
+        }
+    };
+#endif
+
+    namespace detail
+    {
+        struct RegistryNameLess
+        {
+            bool operator()(const std::wstring &a, const std::wstring &b) const
+            {
+                return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [](wchar_t l, wchar_t r) {
+                    return std::towlower(l) < std::towlower(r);
+                });
+            }
+        };
+
+        inline std::wstring utf16le_to_wstring(const char *data, size_t size)
+        {
+            std::wstring result;
+            result.reserve(size / 2);
+
+            for (size_t i = 0; i + 1 < size; i += 2)
+            {
+                uint32_t unit = uint8_t(data[i]) | (uint32_t(uint8_t(data[i + 1])) << 8);
+
+                // wchar_t is 32-bit outside of Windows, so surrogate pairs have to be combined there
+                if constexpr (sizeof(wchar_t) == 4)
+                {
+                    if (unit >= 0xD800 && unit < 0xDC00 && i + 3 < size)
+                    {
+                        uint32_t low = uint8_t(data[i + 2]) | (uint32_t(uint8_t(data[i + 3])) << 8);
+                        if (low >= 0xDC00 && low < 0xE000)
+                        {
+                            unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                            i += 2;
+                        }
+                    }
+                }
+
+                result.push_back(wchar_t(unit));
+            }
+
+            return result;
+        }
+
+        inline std::wstring trim(std::wstring_view str)
+        {
+            size_t b = str.find_first_not_of(L" \t\r\n");
+            if (b == std::wstring_view::npos)
+                return {};
+
+            size_t e = str.find_last_not_of(L" \t\r\n");
+            return std::wstring{str.substr(b, e - b + 1)};
+        }
+
+        // Parses a "quoted \"string\"" starting at `pos`, leaves `pos` after the closing quote
+        inline std::wstring parse_reg_quoted(const std::wstring &line, size_t &pos)
+        {
+            std::wstring result;
+            for (pos++; pos < line.size(); pos++)
+            {
+                wchar_t ch = line[pos];
+                if (ch == L'"')
+                {
+                    pos++;
+                    break;
+                }
+
+                if (ch == L'\\' && pos + 1 < line.size())
+                    ch = line[++pos];
+
+                result.push_back(ch);
+            }
+
+            return result;
+        }
+
+        inline std::vector<uint8_t> parse_reg_hex(std::wstring_view hex)
+        {
+            std::vector<uint8_t> bytes;
+            uint32_t current = 0;
+            int digits = 0;
+
+            for (wchar_t ch : hex)
+            {
+                int v = -1;
+                if (ch >= L'0' && ch <= L'9')
+                    v = ch - L'0';
+                else if (ch >= L'a' && ch <= L'f')
+                    v = ch - L'a' + 10;
+                else if (ch >= L'A' && ch <= L'F')
+                    v = ch - L'A' + 10;
+
+                if (v >= 0)
+                {
+                    current = current * 16 + v;
+                    if (++digits == 2)
+                    {
+                        bytes.push_back(uint8_t(current));
+                        current = 0;
+                        digits = 0;
+                    }
+                }
+            }
+
+            return bytes;
+        }
+    } // namespace detail
+
+    // In-memory registry, filled programmatically or loaded from a regedit `.reg` export or a JSON snapshot.
+    // Lets the probes run (and be timed) without a live Windows registry.
+    class SnapshotRegistry : public RegistryBackend
+    {
+    public:
+        using Value = RegistryValue;
+
+        struct Node
+        {
+            std::map<std::wstring, Node, detail::RegistryNameLess> children;
+            std::vector<std::pair<std::wstring, Value>> values;
+            uint64_t lastWriteTime = 0;
+
+            const Value *FindValue(const std::wstring &name) const
+            {
+                detail::RegistryNameLess less;
+                for (auto &value : values)
+                {
+                    if (!less(value.first, name) && !less(name, value.first))
+                        return &value.second;
+                }
+
+                return nullptr;
+            }
+        };
+
+        class Key : public RegistryKey
+        {
+        public:
+            explicit Key(const Node *node) : mNode(node)
+            {
+            }
+
+            RegistryKeyInfo QueryInfo() const override
+            {
+                return {uint32_t(mNode->children.size()), uint32_t(mNode->values.size()), mNode->lastWriteTime};
+            }
+
+            std::unique_ptr<RegistryKey> OpenSubKey(const std::wstring &name) const override
+            {
+                const Node *node = mNode;
+                for (auto &part : SplitPath(name))
+                {
+                    auto it = node->children.find(part);
+                    if (it == node->children.end())
+                        return nullptr;
+
+                    node = &it->second;
+                }
+
+                return std::make_unique<Key>(node);
+            }
+
+            std::vector<std::wstring> EnumSubKeys() const override
+            {
+                std::vector<std::wstring> result;
+                result.reserve(mNode->children.size());
+
+                for (auto &child : mNode->children)
+                    result.push_back(child.first);
+
+                return result;
+            }
+
+            std::vector<std::pair<std::wstring, RegistryValueType>> EnumValues() const override
+            {
+                std::vector<std::pair<std::wstring, RegistryValueType>> result;
+                for (auto &value : mNode->values)
+                    result.push_back({value.first, value.second.type});
+
+                return result;
+            }
+
+            std::optional<std::wstring> TryGetString(const std::wstring &name) const override
+            {
+                auto value = mNode->FindValue(name);
+                if (!value || value->type != RegistryValueType::String)
+                    return std::nullopt;
+
+                return value->text;
+            }
+
+            std::optional<uint32_t> TryGetDword(const std::wstring &name) const override
+            {
+                auto value = mNode->FindValue(name);
+                if (!value || value->type != RegistryValueType::Dword)
+                    return std::nullopt;
+
+                return uint32_t(value->number);
+            }
+
+            void ReadValues(const std::vector<std::wstring> &names, std::vector<RegistryValue> &values) const override
+            {
+                values.assign(names.size(), RegistryValue{});
+
+                for (size_t i = 0; i != names.size(); i++)
+                {
+                    auto value = mNode->FindValue(names[i]);
+                    if (value && (value->type == RegistryValueType::String || value->type == RegistryValueType::Dword))
+                        values[i] = *value;
+                }
+            }
+
+        private:
+            const Node *mNode;
+        };
+
+        std::unique_ptr<RegistryKey> OpenKey(RegistryRoot root, const std::wstring &path,
+                                             RegistryView view = RegistryView::Default) const override
+        {
+            return Key{&mRoots[size_t(root)]}.OpenSubKey(ResolveView(path, view));
+        }
+
+        Node &MakeKey(RegistryRoot root, const std::wstring &path)
+        {
+            Node *node = &mRoots[size_t(root)];
+            for (auto &part : SplitPath(path))
+                node = &node->children[part];
+
+            return *node;
+        }
+
+        void SetValue(RegistryRoot root, const std::wstring &path, const std::wstring &name, Value value)
+        {
+            SetValue(MakeKey(root, path), name, std::move(value));
+        }
+
+        void SetString(RegistryRoot root, const std::wstring &path, const std::wstring &name, std::wstring text)
+        {
+            SetValue(root, path, name, Value{RegistryValueType::String, std::move(text), 0});
+        }
+
+        void SetDword(RegistryRoot root, const std::wstring &path, const std::wstring &name, uint32_t number)
+        {
+            SetValue(root, path, name, Value{RegistryValueType::Dword, {}, number});
+        }
+
+        // Picks the format from the extension: `.reg` for regedit exports, anything else is read as JSON
+        static std::unique_ptr<SnapshotRegistry> Load(const fs::path &path)
+        {
+            std::ifstream file{path, std::ios::binary};
+            if (!file)
+                throw ulib::RuntimeError{
+                    ulib::format("Failed to open registry snapshot: {}", ulib::u8(path.u8string()))};
+
+            std::string data{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+
+            auto registry = std::make_unique<SnapshotRegistry>();
+            if (path.extension() == ".reg")
+                registry->LoadRegExport(data);
+            else
+                registry->LoadJson(ulib::json::parse(data));
+
+            return registry;
+        }
+
+        // Format produced by `regedit /e` (UTF-16LE with BOM) or `reg export`; UTF-8 input is accepted too
+        void LoadRegExport(const std::string &data)
+        {
+            std::wstring text;
+            if (data.size() >= 2 && uint8_t(data[0]) == 0xFF && uint8_t(data[1]) == 0xFE)
+                text = detail::utf16le_to_wstring(data.data() + 2, data.size() - 2);
+            else
+                text = ulib::wstr(ulib::string{data});
+
+            Node *current = nullptr;
+            std::wstring pending;
+
+            size_t pos = 0;
+            while (pos < text.size())
+            {
+                size_t eol = text.find(L'\n', pos);
+                if (eol == std::wstring::npos)
+                    eol = text.size();
+
+                std::wstring line = detail::trim(std::wstring_view{text}.substr(pos, eol - pos));
+                pos = eol + 1;
+
+                // Binary values are wrapped over several lines ending with a backslash
+                if (!line.empty() && line.back() == L'\\' &&
+                    (!pending.empty() || line.find(L"=hex") != std::wstring::npos))
+                {
+                    line.pop_back();
+                    pending += line;
+                    continue;
+                }
+
+                if (!pending.empty())
+                {
+                    line = pending + line;
+                    pending.clear();
+                }
+
+                if (line.empty() || line.front() == L';')
+                    continue;
+
+                if (line.front() == L'[')
+                {
+                    current = nullptr;
+
+                    // [-HKEY_...] deletes a key, there is nothing to load for it
+                    if (line.size() > 2 && line[1] != L'-' && line.back() == L']')
+                    {
+                        auto fullPath = line.substr(1, line.size() - 2);
+                        if (auto root = SplitRoot(fullPath))
+                            current = &MakeKey(root->first, root->second);
+                    }
+
+                    continue;
+                }
+
+                if (!current)
+                    continue;
+
+                std::wstring name;
+                size_t valuePos = 0;
+
+                if (line.front() == L'@')
+                    valuePos = 1;
+                else if (line.front() == L'"')
+                    name = detail::parse_reg_quoted(line, valuePos);
+                else
+                    continue;
+
+                if (valuePos >= line.size() || line[valuePos] != L'=')
+                    continue;
+
+                SetValue(*current, name, ParseRegValue(std::wstring_view{line}.substr(valuePos + 1)));
+            }
+        }
+
+        // {"keys": [{"path": "HKEY_LOCAL_MACHINE\\SOFTWARE\\...", "last_write": 0, "values": [{"name": "DisplayName",
+        // "type": "sz", "data": "..."}, {"name": "SystemComponent", "type": "dword", "data": 1}]}]}
+        // `last_write` is optional; .reg exports carry no timestamps at all.
+        void LoadJson(ulib::json snapshot)
+        {
+            auto keys = snapshot.search("keys");
+            if (!keys)
+                throw ulib::RuntimeError{"Registry snapshot has no 'keys' array"};
+
+            for (size_t i = 0; i != keys->size(); i++)
+            {
+                auto &jkey = (*keys)[i];
+
+                std::wstring fullPath = ulib::wstr(jkey["path"].get<ulib::string>());
+                auto root = SplitRoot(fullPath);
+                if (!root)
+                    throw ulib::RuntimeError{ulib::format("Unknown registry root in: {}", ulib::u8(fullPath))};
+
+                Node &node = MakeKey(root->first, root->second);
+
+                if (auto lastWrite = jkey.search("last_write"))
+                    node.lastWriteTime = lastWrite->get<uint64_t>();
+
+                auto values = jkey.search("values");
+                if (!values)
+                    continue;
+
+                for (size_t j = 0; j != values->size(); j++)
+                {
+                    auto &jvalue = (*values)[j];
+
+                    std::wstring name = ulib::wstr(jvalue["name"].get<ulib::string>());
+                    ulib::string type = jvalue["type"].get<ulib::string>();
+
+                    Value value;
+                    if (type == "sz" || type == "expand_sz")
+                    {
+                        value.type = type == "sz" ? RegistryValueType::String : RegistryValueType::ExpandString;
+                        value.text = ulib::wstr(jvalue["data"].get<ulib::string>());
+                    }
+                    else if (type == "dword" || type == "qword")
+                    {
+                        value.type = type == "dword" ? RegistryValueType::Dword : RegistryValueType::Qword;
+                        value.number = jvalue["data"].get<uint64_t>();
+                    }
+                    else
+                    {
+                        value.type = RegistryValueType::Binary;
+                    }
+
+                    SetValue(node, name, std::move(value));
+                }
+            }
+        }
+
+    private:
+        static void SetValue(Node &node, const std::wstring &name, Value value)
+        {
+            detail::RegistryNameLess less;
+            for (auto &existing : node.values)
+            {
+                if (!less(existing.first, name) && !less(name, existing.first))
+                {
+                    existing.second = std::move(value);
+                    return;
+                }
+            }
+
+            node.values.push_back({name, std::move(value)});
+        }
+
+        static Value ParseRegValue(std::wstring_view data)
+        {
+            Value value;
+
+            if (data.starts_with(L"\""))
+            {
+                size_t pos = 0;
+                value.type = RegistryValueType::String;
+                value.text = detail::parse_reg_quoted(std::wstring{data}, pos);
+            }
+            else if (data.starts_with(L"dword:"))
+            {
+                value.type = RegistryValueType::Dword;
+                value.number = std::wcstoul(std::wstring{data.substr(6)}.c_str(), nullptr, 16);
+            }
+            else if (data.starts_with(L"hex(b):"))
+            {
+                auto bytes = detail::parse_reg_hex(data.substr(7));
+                value.type = RegistryValueType::Qword;
+                for (size_t i = 0; i != bytes.size() && i != 8; i++)
+                    value.number |= uint64_t(bytes[i]) << (8 * i);
+            }
+            else if (data.starts_with(L"hex(2):"))
+            {
+                auto bytes = detail::parse_reg_hex(data.substr(7));
+                value.type = RegistryValueType::ExpandString;
+                value.text = detail::utf16le_to_wstring(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+                while (!value.text.empty() && value.text.back() == L'\0')
+                    value.text.pop_back();
+            }
+            else if (data.starts_with(L"hex(7):"))
+            {
+                value.type = RegistryValueType::MultiString;
+            }
+            else
+            {
+                value.type = RegistryValueType::Binary;
+            }
+
+            return value;
+        }
+
+        static std::vector<std::wstring> SplitPath(std::wstring_view path)
+        {
+            std::vector<std::wstring> parts;
+
+            size_t pos = 0;
+            while (pos <= path.size())
+            {
+                size_t end = path.find(L'\\', pos);
+                if (end == std::wstring_view::npos)
+                    end = path.size();
+
+                if (end != pos)
+                    parts.emplace_back(path.substr(pos, end - pos));
+
+                pos = end + 1;
+            }
+
+            return parts;
+        }
+
+        static std::optional<std::pair<RegistryRoot, std::wstring>> SplitRoot(const std::wstring &fullPath)
+        {
+            size_t sep = fullPath.find(L'\\');
+            std::wstring root = fullPath.substr(0, sep);
+            std::wstring rest = sep == std::wstring::npos ? std::wstring{} : fullPath.substr(sep + 1);
+
+            if (root == L"HKEY_LOCAL_MACHINE" || root == L"HKLM")
+                return std::pair{RegistryRoot::LocalMachine, rest};
+
+            if (root == L"HKEY_CURRENT_USER" || root == L"HKCU")
+                return std::pair{RegistryRoot::CurrentUser, rest};
+
+            return std::nullopt;
+        }
+
+        // The snapshot stores the 32-bit view under its physical WOW6432Node location, the way regedit exports it
+        static std::wstring ResolveView(const std::wstring &path, RegistryView view)
+        {
+            constexpr std::wstring_view software = L"SOFTWARE\\";
+            constexpr std::wstring_view wow = L"WOW6432Node\\";
+
+            if (view != RegistryView::Wow64_32 || path.size() < software.size())
+                return path;
+
+            detail::RegistryNameLess less;
+            std::wstring head = path.substr(0, software.size());
+            if (less(head, std::wstring{software}) || less(std::wstring{software}, head))
+                return path;
+
+            std::wstring tail = path.substr(software.size());
+            if (tail.size() >= wow.size())
+            {
+                std::wstring tailHead = tail.substr(0, wow.size());
+                if (!less(tailHead, std::wstring{wow}) && !less(std::wstring{wow}, tailHead))
+                    return path;
+            }
+
+            return std::wstring{software} + std::wstring{wow} + tail;
+        }
+
+        Node mRoots[2];
+    };
+
+    // The backend probes use when none is given explicitly: the live registry on Windows, an empty one elsewhere
+    inline const RegistryBackend &default_registry()
+    {
+#ifdef _WIN32
+        static LiveRegistry registry;
+#else
+        static SnapshotRegistry registry;
+#endif
+        return registry;
+    }
+} // namespace vcwin
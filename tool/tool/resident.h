@@ -0,0 +1,855 @@
+#pragma once
+
+#include "component_index.h"
+#include "dxsdk.h"
+#include "parallel.h"
+#include "registry.h"
+#include "state_document.h"
+#include "vctools.h"
+#include "vs_instances.h"
+#include "winsdk.h"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include <ulib/json.h>
+#include <ulib/string.h>
+
+#ifdef _WIN32
+#include <3rdparty/WinReg.hpp>
+#include <Windows.h>
+#endif
+
+namespace vcwin
+{
+    // Probe results a resident vcwin keeps in memory
+    enum class ResidentSection
+    {
+        VCTools = 0,
+        WindowsSDK = 1,
+        DirectX = 2,
+    };
+
+    inline constexpr size_t kResidentSectionCount = 3;
+
+    // A registry key whose subtree feeds one resident section
+    struct RegistryWatch
+    {
+        RegistryRoot root;
+        std::wstring path;
+        RegistryView view;
+        ResidentSection section;
+    };
+
+    inline ulib::list<RegistryWatch> default_registry_watches()
+    {
+        return {
+            {RegistryRoot::LocalMachine, L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall",
+             RegistryView::Wow64_64, ResidentSection::WindowsSDK},
+            {RegistryRoot::LocalMachine, L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall",
+             RegistryView::Wow64_32, ResidentSection::WindowsSDK},
+            {RegistryRoot::CurrentUser, L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall",
+             RegistryView::Default, ResidentSection::WindowsSDK},
+            {RegistryRoot::LocalMachine, L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Installer\\UserData",
+             RegistryView::Default, ResidentSection::WindowsSDK},
+            {RegistryRoot::LocalMachine, L"SOFTWARE\\Microsoft\\Windows Kits", RegistryView::Wow64_32,
+             ResidentSection::WindowsSDK},
+            {RegistryRoot::LocalMachine, L"SOFTWARE\\Microsoft\\DirectX", RegistryView::Wow64_32,
+             ResidentSection::DirectX},
+        };
+    }
+
+    // A directory tree whose files feed one resident section
+    struct DirectoryWatch
+    {
+        std::filesystem::path path;
+        ResidentSection section;
+    };
+
+    // Everything a change source follows. Watch numbers count the keys first, then the directories.
+    struct ResidentWatches
+    {
+        ulib::list<RegistryWatch> keys;
+        ulib::list<DirectoryWatch> directories;
+
+        std::optional<ResidentSection> SectionOf(size_t watch) const
+        {
+            if (watch < keys.size())
+                return keys[watch].section;
+            if (watch - keys.size() < directories.size())
+                return directories[watch - keys.size()].section;
+
+            return std::nullopt;
+        }
+    };
+
+    // The registry watches, plus the Visual Studio instances directory for VCTools: instances live in files only
+    inline ResidentWatches default_resident_watches()
+    {
+        ResidentWatches watches;
+        watches.keys = default_registry_watches();
+
+        try
+        {
+            watches.directories.push_back(DirectoryWatch{default_vs_instances_dir(), ResidentSection::VCTools});
+        }
+        catch (...)
+        {
+        }
+
+        return watches;
+    }
+
+    // Watch number that stands for every section, see RegistryChangeSource::Post
+    inline constexpr size_t kAllWatches = size_t(-1);
+
+    // Reports which watch saw a change, by its number in the ResidentWatches the source was created for
+    class RegistryChangeSource
+    {
+    public:
+        virtual ~RegistryChangeSource() = default;
+
+        // Blocks until a watched key changes, the timeout expires or the source is stopped.
+        // Returns nullopt in the last two cases.
+        virtual std::optional<size_t> WaitForChange(std::optional<std::chrono::milliseconds> timeout = {}) = 0;
+
+        // Queues a change the source cannot see by itself, such as a client asking for a refresh (kAllWatches)
+        virtual void Post(size_t watch) = 0;
+
+        virtual void Stop() = 0;
+        virtual bool IsStopped() const = 0;
+    };
+
+    // Change feed driven by the caller, for running the resident mode against a snapshot registry
+    class FakeRegistryChangeSource : public RegistryChangeSource
+    {
+    public:
+        void Post(size_t watch) override
+        {
+            {
+                std::lock_guard lock{mMutex};
+                mEvents.push_back(watch);
+            }
+
+            mCondition.notify_one();
+        }
+
+        std::optional<size_t> WaitForChange(std::optional<std::chrono::milliseconds> timeout = {}) override
+        {
+            std::unique_lock lock{mMutex};
+
+            auto ready = [&] { return mStopped || !mEvents.empty(); };
+            if (timeout)
+                mCondition.wait_for(lock, *timeout, ready);
+            else
+                mCondition.wait(lock, ready);
+
+            if (mStopped || mEvents.empty())
+                return std::nullopt;
+
+            size_t watch = mEvents.front();
+            mEvents.pop_front();
+            return watch;
+        }
+
+        void Stop() override
+        {
+            {
+                std::lock_guard lock{mMutex};
+                mStopped = true;
+            }
+
+            mCondition.notify_all();
+        }
+
+        bool IsStopped() const override
+        {
+            std::lock_guard lock{mMutex};
+            return mStopped;
+        }
+
+    private:
+        mutable std::mutex mMutex;
+        std::condition_variable mCondition;
+        std::deque<size_t> mEvents;
+        bool mStopped = false;
+    };
+
+#ifdef _WIN32
+#ifndef REG_NOTIFY_THREAD_AGNOSTIC
+#define REG_NOTIFY_THREAD_AGNOSTIC 0x10000000L
+#endif
+
+    // RegNotifyChangeKeyValue on every watched key and a change notification on every watched directory. A key or
+    // directory that does not exist yet is replaced by a watch on its parent for new children, and the real one is
+    // picked up as soon as it appears.
+    class LiveRegistryChangeSource : public RegistryChangeSource
+    {
+    public:
+        LiveRegistryChangeSource(const ResidentWatches &watches)
+        {
+            mStopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+            mPostEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+            if (!mStopEvent || !mPostEvent)
+                throw ulib::RuntimeError{"Failed to create registry watch events"};
+
+            for (auto &watch : watches.keys)
+            {
+                auto &slot = mSlots.emplace_back(std::make_unique<Slot>());
+                slot->watch = watch;
+                slot->event = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+                Arm(*slot);
+            }
+
+            for (auto &watch : watches.directories)
+            {
+                auto &slot = mDirectories.emplace_back(std::make_unique<DirectorySlot>());
+                slot->watch = watch;
+                Arm(*slot);
+            }
+        }
+
+        LiveRegistryChangeSource(const LiveRegistryChangeSource &) = delete;
+        LiveRegistryChangeSource &operator=(const LiveRegistryChangeSource &) = delete;
+
+        ~LiveRegistryChangeSource()
+        {
+            for (auto &slot : mSlots)
+            {
+                slot->key.Close();
+                if (slot->event)
+                    CloseHandle(slot->event);
+            }
+
+            for (auto &slot : mDirectories)
+            {
+                if (slot->change != INVALID_HANDLE_VALUE)
+                    FindCloseChangeNotification(slot->change);
+            }
+
+            CloseHandle(mPostEvent);
+            CloseHandle(mStopEvent);
+        }
+
+        std::optional<size_t> WaitForChange(std::optional<std::chrono::milliseconds> timeout = {}) override
+        {
+            if (auto posted = TakePosted())
+                return posted;
+
+            while (true)
+            {
+                std::vector<HANDLE> handles{mStopEvent, mPostEvent};
+                std::vector<size_t> owners{0, 0};
+
+                for (size_t i = 0; i != mSlots.size(); i++)
+                {
+                    if (mSlots[i]->key.IsValid() && mSlots[i]->event)
+                    {
+                        handles.push_back(mSlots[i]->event);
+                        owners.push_back(i);
+                    }
+                }
+
+                for (size_t i = 0; i != mDirectories.size(); i++)
+                {
+                    if (mDirectories[i]->change != INVALID_HANDLE_VALUE)
+                    {
+                        handles.push_back(mDirectories[i]->change);
+                        owners.push_back(mSlots.size() + i);
+                    }
+                }
+
+                DWORD wait = timeout ? DWORD(timeout->count()) : INFINITE;
+                DWORD result = WaitForMultipleObjects(DWORD(handles.size()), handles.data(), FALSE, wait);
+
+                if (result == WAIT_TIMEOUT || result == WAIT_OBJECT_0 || result >= WAIT_OBJECT_0 + handles.size())
+                    return std::nullopt;
+
+                // The post event can outlive the queue entry it was set for, that one was taken above
+                if (result == WAIT_OBJECT_0 + 1)
+                {
+                    if (auto posted = TakePosted())
+                        return posted;
+
+                    continue;
+                }
+
+                // Notifications are one-shot, so the key or directory is re-armed before reporting it
+                size_t index = owners[result - WAIT_OBJECT_0];
+                if (index < mSlots.size())
+                    Arm(*mSlots[index]);
+                else
+                    Arm(*mDirectories[index - mSlots.size()]);
+
+                return index;
+            }
+        }
+
+        void Post(size_t watch) override
+        {
+            {
+                std::lock_guard lock{mPostedMutex};
+                mPosted.push_back(watch);
+            }
+
+            SetEvent(mPostEvent);
+        }
+
+        void Stop() override
+        {
+            SetEvent(mStopEvent);
+        }
+
+        bool IsStopped() const override
+        {
+            return WaitForSingleObject(mStopEvent, 0) == WAIT_OBJECT_0;
+        }
+
+    private:
+        struct Slot
+        {
+            RegistryWatch watch;
+            winreg::RegKey key;
+            HANDLE event = nullptr;
+            bool exact = false;
+        };
+
+        struct DirectorySlot
+        {
+            DirectoryWatch watch;
+            HANDLE change = INVALID_HANDLE_VALUE;
+            bool exact = false;
+        };
+
+        std::optional<size_t> TakePosted()
+        {
+            std::lock_guard lock{mPostedMutex};
+            if (mPosted.empty())
+                return std::nullopt;
+
+            size_t watch = mPosted.front();
+            mPosted.pop_front();
+            return watch;
+        }
+
+        static REGSAM ViewAccess(RegistryView view)
+        {
+            if (view == RegistryView::Wow64_32)
+                return KEY_WOW64_32KEY;
+            if (view == RegistryView::Wow64_64)
+                return KEY_WOW64_64KEY;
+
+            return 0;
+        }
+
+        void Arm(Slot &slot)
+        {
+            HKEY hroot = slot.watch.root == RegistryRoot::CurrentUser ? HKEY_CURRENT_USER : HKEY_LOCAL_MACHINE;
+            REGSAM access = KEY_NOTIFY | ViewAccess(slot.watch.view);
+
+            if (!slot.exact)
+            {
+                slot.key.Close();
+
+                if (slot.key.TryOpen(hroot, slot.watch.path, access))
+                {
+                    slot.exact = true;
+                }
+                else
+                {
+                    auto slash = slot.watch.path.rfind(L'\\');
+                    if (slash == std::wstring::npos)
+                        return;
+
+                    if (!slot.key.TryOpen(hroot, slot.watch.path.substr(0, slash), access))
+                        return;
+                }
+            }
+
+            DWORD filter = REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_THREAD_AGNOSTIC;
+            if (slot.exact)
+                filter |= REG_NOTIFY_CHANGE_LAST_SET;
+
+            LSTATUS status = RegNotifyChangeKeyValue(slot.key.Get(), slot.exact, filter, slot.event, TRUE);
+            if (status != ERROR_SUCCESS)
+            {
+                slot.key.Close();
+
+                // The watched key was deleted, watch its parent until it comes back
+                if (slot.exact)
+                {
+                    slot.exact = false;
+                    Arm(slot);
+                }
+            }
+        }
+
+        void Arm(DirectorySlot &slot)
+        {
+            if (slot.change != INVALID_HANDLE_VALUE)
+            {
+                if (slot.exact && FindNextChangeNotification(slot.change))
+                    return;
+
+                // Either the parent saw a new directory or the watched one was deleted, try it again
+                FindCloseChangeNotification(slot.change);
+                slot.change = INVALID_HANDLE_VALUE;
+            }
+
+            slot.change = FindFirstChangeNotificationW(
+                slot.watch.path.c_str(), TRUE,
+                FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE);
+            slot.exact = slot.change != INVALID_HANDLE_VALUE;
+
+            if (!slot.exact)
+                slot.change = FindFirstChangeNotificationW(slot.watch.path.parent_path().c_str(), FALSE,
+                                                           FILE_NOTIFY_CHANGE_DIR_NAME);
+        }
+
+        HANDLE mStopEvent = nullptr;
+        HANDLE mPostEvent = nullptr;
+        std::vector<std::unique_ptr<Slot>> mSlots;
+        std::vector<std::unique_ptr<DirectorySlot>> mDirectories;
+
+        std::mutex mPostedMutex;
+        std::deque<size_t> mPosted;
+    };
+#endif
+
+    // Keeps the models behind `vcwin state` in memory and answers with the same document. Each section is rebuilt only
+    // when something it depends on changes, and with a component index attached a WindowsSDK rebuild only re-reads
+    // the component keys that changed.
+    class ResidentState
+    {
+    public:
+        ResidentState(const RegistryBackend &registry = default_registry(), ComponentIndex *index = nullptr)
+            : mRegistry(registry), mIndex(index)
+        {
+            // Sections are independent, the first state is ready as soon as the slowest probe is
+            parallel_for(
+                kResidentSectionCount, [this](size_t i) { Probe(ResidentSection(i)); }, kResidentSectionCount);
+            UpdateEnvironment();
+        }
+
+        // Probes a section again and swaps it in, clients are served the previous result until then.
+        // Runs on the watcher thread, one refresh at a time.
+        void Refresh(ResidentSection section)
+        {
+            Probe(section);
+            if (section != ResidentSection::DirectX)
+                UpdateEnvironment();
+        }
+
+        // The document `vcwin state` writes, as compact JSON
+        ulib::string State(bool withTimings = false) const
+        {
+            auto begin = std::chrono::steady_clock::now();
+            Models models = GetModels();
+
+            StateTimings timings = models.timings;
+            timings.total = std::chrono::steady_clock::now() - begin;
+
+            StateDocument document{models.vctools.get(), models.winsdk.get(), models.dxsdk.get(),
+                                   models.environment.get()};
+            if (withTimings)
+                document.timings = &timings;
+
+            return Render(document);
+        }
+
+        size_t GetRefreshCount(ResidentSection section) const
+        {
+            std::shared_lock lock{mMutex};
+            return mRefreshCount[size_t(section)];
+        }
+
+        // Answers one client request: state, state --timings, vctools, winsdk, dxsdk or refresh
+        ulib::string Handle(ulib::string_view request)
+        {
+            if (request == "state")
+                return State();
+            if (request == "state --timings")
+                return State(true);
+            if (request == "vctools")
+                return Render(*GetModels().vctools);
+            if (request == "winsdk")
+                return Render(*GetModels().winsdk);
+            if (request == "dxsdk")
+                return Render(*GetModels().dxsdk);
+
+            // Rescans take seconds and the pipe serves one client at a time, so the watcher runs them and this
+            // client gets the current state right away
+            if (request == "refresh")
+            {
+                std::lock_guard lock{mSourceMutex};
+                if (!mSource)
+                    return Error("Nothing is watching for changes to refresh");
+
+                mSource->Post(kAllWatches);
+                return State();
+            }
+
+            return Error(ulib::string{"Unknown request: "} + ulib::string{request});
+        }
+
+        // Applies change notifications until the source is stopped. Installers touch many keys in a row,
+        // so changes are collected until the feed has been quiet for settleTime before anything is rescanned.
+        void Watch(RegistryChangeSource &source, const ResidentWatches &watches,
+                   std::chrono::milliseconds settleTime = std::chrono::milliseconds{500})
+        {
+            {
+                std::lock_guard lock{mSourceMutex};
+                mSource = &source;
+            }
+
+            ApplyChanges(source, watches, settleTime);
+
+            std::lock_guard lock{mSourceMutex};
+            mSource = nullptr;
+        }
+
+    private:
+        struct Models
+        {
+            std::shared_ptr<const VCTools> vctools;
+            std::shared_ptr<const WindowsSDK> winsdk;
+            std::shared_ptr<const DirectXSdk> dxsdk;
+            std::shared_ptr<const StateEnvironment> environment;
+            StateTimings timings;
+        };
+
+        static ulib::string Error(const ulib::string &message)
+        {
+            ulib::json error;
+            error["error"] = message;
+            return error.dump();
+        }
+
+        template <class Model>
+        static ulib::string Render(const Model &model)
+        {
+            std::string text;
+            {
+                OutputBuffer out{text};
+                JsonEmitter emitter{out};
+                model.Emit(emitter);
+            }
+
+            return ulib::string{std::string_view{text}};
+        }
+
+        Models GetModels() const
+        {
+            std::shared_lock lock{mMutex};
+            return mModels;
+        }
+
+        void Probe(ResidentSection section)
+        {
+            auto begin = std::chrono::steady_clock::now();
+
+            std::shared_ptr<const VCTools> vctools;
+            std::shared_ptr<const WindowsSDK> winsdk;
+            std::shared_ptr<const DirectXSdk> dxsdk;
+
+            if (section == ResidentSection::VCTools)
+            {
+                vctools = std::make_shared<const VCTools>();
+            }
+            else if (section == ResidentSection::WindowsSDK)
+            {
+                // Probed in full here, the served model is never written to again
+                auto probed = std::make_shared<WindowsSDK>(mRegistry, mIndex);
+                probed->ProbeAll();
+                winsdk = std::move(probed);
+
+                try
+                {
+                    if (mIndex)
+                        mIndex->Save();
+                }
+                catch (...)
+                {
+                }
+            }
+            else if (section == ResidentSection::DirectX)
+            {
+                dxsdk = std::make_shared<const DirectXSdk>(mRegistry);
+            }
+
+            auto duration = std::chrono::steady_clock::now() - begin;
+
+            std::unique_lock lock{mMutex};
+            if (vctools)
+            {
+                mModels.vctools = std::move(vctools);
+                mModels.timings.vctools = duration;
+            }
+            else if (winsdk)
+            {
+                mModels.winsdk = std::move(winsdk);
+                mModels.timings.winsdk = duration;
+            }
+            else if (dxsdk)
+            {
+                mModels.dxsdk = std::move(dxsdk);
+                mModels.timings.dxsdk = duration;
+            }
+
+            mRefreshCount[size_t(section)]++;
+        }
+
+        void UpdateEnvironment()
+        {
+            Models models = GetModels();
+            auto environment = std::make_shared<const StateEnvironment>(
+                StateEnvironment::Make(*models.vctools, *models.winsdk));
+
+            std::unique_lock lock{mMutex};
+            mModels.environment = std::move(environment);
+        }
+
+        void ApplyChanges(RegistryChangeSource &source, const ResidentWatches &watches,
+                          std::chrono::milliseconds settleTime)
+        {
+            while (auto changed = source.WaitForChange())
+            {
+                std::array<bool, kResidentSectionCount> dirty{};
+
+                auto mark = [&](size_t watch) {
+                    if (watch == kAllWatches)
+                        dirty.fill(true);
+                    else if (auto section = watches.SectionOf(watch))
+                        dirty[size_t(*section)] = true;
+                };
+
+                mark(*changed);
+                while (auto more = source.WaitForChange(settleTime))
+                    mark(*more);
+
+                if (source.IsStopped())
+                    return;
+
+                for (size_t i = 0; i != kResidentSectionCount; i++)
+                {
+                    try
+                    {
+                        if (dirty[i])
+                            Refresh(ResidentSection(i));
+                    }
+                    catch (...)
+                    {
+                        // Keep serving the previous result
+                    }
+                }
+            }
+        }
+
+        const RegistryBackend &mRegistry;
+        ComponentIndex *mIndex;
+
+        mutable std::shared_mutex mMutex;
+        Models mModels;
+        std::array<size_t, kResidentSectionCount> mRefreshCount{};
+
+        std::mutex mSourceMutex;
+        RegistryChangeSource *mSource = nullptr;
+    };
+
+#ifdef _WIN32
+    inline constexpr wchar_t kResidentPipeName[] = L"\\\\.\\pipe\\vcwin";
+
+    namespace detail
+    {
+        inline std::optional<ulib::string> read_pipe_message(HANDLE pipe)
+        {
+            ulib::string message;
+            char buffer[4096];
+
+            while (true)
+            {
+                DWORD read = 0;
+                BOOL ok = ReadFile(pipe, buffer, sizeof(buffer), &read, nullptr);
+                message.append(ulib::string_view{buffer, read});
+
+                if (ok)
+                    return message;
+
+                if (GetLastError() != ERROR_MORE_DATA)
+                    return std::nullopt;
+            }
+        }
+
+        inline bool write_pipe_message(HANDLE pipe, ulib::string_view message)
+        {
+            DWORD written = 0;
+            return WriteFile(pipe, message.data(), DWORD(message.size()), &written, nullptr) &&
+                   written == message.size();
+        }
+
+        inline std::vector<BYTE> token_user_sid(HANDLE token)
+        {
+            DWORD size = 0;
+            GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+
+            std::vector<BYTE> buffer(size);
+            if (size == 0 || !GetTokenInformation(token, TokenUser, buffer.data(), size, &size))
+                return {};
+
+            auto user = reinterpret_cast<const TOKEN_USER *>(buffer.data());
+            auto sid = reinterpret_cast<const BYTE *>(user->User.Sid);
+            return {sid, sid + GetLengthSid(user->User.Sid)};
+        }
+
+        // Whether the connected client runs as the same user as this process
+        inline bool pipe_client_is_own_user(HANDLE pipe)
+        {
+            if (!ImpersonateNamedPipeClient(pipe))
+                return false;
+
+            HANDLE clientToken = nullptr;
+            BOOL opened = OpenThreadToken(GetCurrentThread(), TOKEN_QUERY, TRUE, &clientToken);
+            RevertToSelf();
+
+            if (!opened)
+                return false;
+
+            HANDLE ownToken = nullptr;
+            if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &ownToken))
+            {
+                CloseHandle(clientToken);
+                return false;
+            }
+
+            auto client = token_user_sid(clientToken);
+            auto own = token_user_sid(ownToken);
+
+            CloseHandle(clientToken);
+            CloseHandle(ownToken);
+
+            return !client.empty() && client == own;
+        }
+
+        // The first instance is created with FILE_FLAG_FIRST_PIPE_INSTANCE, so the server fails instead of joining
+        // a pipe of that name another process created first and would answer queries on
+        inline HANDLE create_resident_pipe(const wchar_t *name, bool first)
+        {
+            HANDLE pipe = CreateNamedPipeW(name, PIPE_ACCESS_DUPLEX | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+                                           PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT |
+                                               PIPE_REJECT_REMOTE_CLIENTS,
+                                           PIPE_UNLIMITED_INSTANCES, 1 << 16, 1 << 16, 0, nullptr);
+            if (pipe != INVALID_HANDLE_VALUE)
+                return pipe;
+
+            DWORD error = GetLastError();
+            if (first && error == ERROR_ACCESS_DENIED)
+                throw ulib::RuntimeError{"The vcwin pipe is already taken, is another vcwin serve running?"};
+
+            throw ulib::RuntimeError{ulib::format("Failed to create pipe, error: {}", error)};
+        }
+    } // namespace detail
+
+    // Answers requests on the local named pipe one client at a time until a client of the same user sends "stop".
+    // Replies are served from memory, so a connection is held only for the time of one write. The next instance
+    // is created as soon as a client connects, so there is always one to wait for: a client that finds every
+    // instance busy gets ERROR_PIPE_BUSY and waits, where a missing pipe would send it off to probe on its own.
+    inline void serve_resident_pipe(ResidentState &state, const wchar_t *name = kResidentPipeName)
+    {
+        HANDLE pipe = detail::create_resident_pipe(name, true);
+
+        while (true)
+        {
+            if (!ConnectNamedPipe(pipe, nullptr) && GetLastError() != ERROR_PIPE_CONNECTED)
+            {
+                CloseHandle(pipe);
+                pipe = detail::create_resident_pipe(name, false);
+                continue;
+            }
+
+            HANDLE next = INVALID_HANDLE_VALUE;
+            try
+            {
+                next = detail::create_resident_pipe(name, false);
+            }
+            catch (...)
+            {
+                DisconnectNamedPipe(pipe);
+                CloseHandle(pipe);
+                throw;
+            }
+
+            bool stop = false;
+            if (auto request = detail::read_pipe_message(pipe))
+            {
+                ulib::string reply;
+                if (*request != "stop")
+                {
+                    reply = state.Handle(*request);
+                }
+                else if (detail::pipe_client_is_own_user(pipe))
+                {
+                    stop = true;
+                    reply = "{}";
+                }
+                else
+                {
+                    // Any local user may read the state, only the one running the server may end it
+                    ulib::json error;
+                    error["error"] = "stop is only accepted from the user running vcwin serve";
+                    reply = error.dump();
+                }
+
+                detail::write_pipe_message(pipe, reply);
+                FlushFileBuffers(pipe);
+            }
+
+            DisconnectNamedPipe(pipe);
+            CloseHandle(pipe);
+            pipe = next;
+
+            if (stop)
+            {
+                CloseHandle(pipe);
+                return;
+            }
+        }
+    }
+
+    // Sends one request to a running `vcwin serve`. Returns nullopt if none is listening.
+    inline std::optional<ulib::string> query_resident(ulib::string_view request,
+                                                      const wchar_t *name = kResidentPipeName)
+    {
+        HANDLE pipe = INVALID_HANDLE_VALUE;
+        for (int attempt = 0; attempt != 5; attempt++)
+        {
+            pipe = CreateFileW(name, GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+            if (pipe != INVALID_HANDLE_VALUE)
+                break;
+
+            // Every instance is serving another client, another client may also win the race for the one that
+            // frees up. ERROR_FILE_NOT_FOUND means no server at all.
+            if (GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipeW(name, 1000))
+                return std::nullopt;
+        }
+
+        if (pipe == INVALID_HANDLE_VALUE)
+            return std::nullopt;
+
+        std::optional<ulib::string> reply;
+
+        DWORD mode = PIPE_READMODE_MESSAGE;
+        if (SetNamedPipeHandleState(pipe, &mode, nullptr, nullptr) && detail::write_pipe_message(pipe, request))
+            reply = detail::read_pipe_message(pipe);
+
+        CloseHandle(pipe);
+        return reply;
+    }
+#endif
+} // namespace vcwin
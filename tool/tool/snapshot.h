@@ -0,0 +1,621 @@
+#pragma once
+
+#include "dxsdk.h"
+#include "mapped_file.h"
+#include "vctools.h"
+#include "winsdk.h"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <ulib/runtimeerror.h>
+#include <ulib/string.h>
+
+namespace vcwin
+{
+    namespace fs = std::filesystem;
+
+    // Binary image of the VCTools, WindowsSDK and DirectXSdk models. The file is a fixed-layout header followed by
+    // record arrays and one deduplicated string table. Records refer to strings and to other records by offset, so
+    // a memory-mapped file is used in place: opening only validates the header, and loaded components point
+    // straight into the mapping. Integers are stored in host byte order.
+    class StateSnapshot : public std::enable_shared_from_this<StateSnapshot>
+    {
+    public:
+        static constexpr char kMagic[8] = {'V', 'C', 'W', 'S', 'N', 'A', 'P', '\0'};
+        static constexpr uint32_t kVersion = 2;
+
+        // Marks an absent optional string
+        static constexpr uint32_t kNone = 0xFFFFFFFF;
+
+        // Byte range in the string table
+        struct Str
+        {
+            uint32_t offset = 0;
+            uint32_t size = kNone;
+        };
+
+        // In the header, a byte offset into the file and an element count.
+        // Everywhere else, the first element index and the count within the matching header array.
+        struct Range
+        {
+            uint32_t offset = 0;
+            uint32_t count = 0;
+        };
+
+        struct ComponentRecord
+        {
+            Str displayName;
+            Str displayVersion;
+            Str uninstallString;
+            Str guid;
+            uint32_t systemComponent;
+        };
+
+        struct OptionRecord
+        {
+            Str name;
+            uint32_t value;
+        };
+
+        struct SdkItemRecord
+        {
+            Str windowsBuildVersion;
+            Range wdkUninstallComponents;
+            Range wdkInstallerComponents;
+            Range sdkUninstallComponents;
+            Range sdkInstallerComponents;
+            Range options;
+            uint32_t inInstalledRoots;
+            uint32_t hasWDKInOptions;
+        };
+
+        struct ToolsetRecord
+        {
+            Str version;
+            Str directory;
+
+            // Host and target of each arch, pairs of consecutive entries in the string reference array
+            Range archs;
+        };
+
+        struct InstallationRecord
+        {
+            Str instanceId;
+            Str installationName;
+            Str installationPath;
+            Str installationVersion;
+            Str installDate;
+            Str defaultToolsetVersion;
+            Range toolsets;
+        };
+
+        struct VCToolsRecord
+        {
+            Str vsPath;
+            Str vswherePath;
+            Str vcToolsDefaultVersion;
+            Range installations;
+        };
+
+        struct DirectXRecord
+        {
+            Str version;
+            Str versionSource;
+            Str path;
+            Str pathSource;
+            Str dxsdkDir;
+            Str dxsdkDirSource;
+
+            // Pairs of consecutive entries in the string reference array
+            Range mismatches;
+        };
+
+        struct WindowsSdkRecord
+        {
+            uint32_t hasInfo;
+            Str infoDirectory;
+            Str infoVersion;
+            Str infoName;
+            Str infoSource;
+
+            Str sdkDirectory;
+            Str sdkVersion;
+            Str sdkName;
+
+            Str wdkProductVersion10;
+            Str wdkProductVersion10Source;
+
+            Range kmdfVersions;
+            Str kmdfVersionsSource;
+
+            Range items;
+        };
+
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t headerSize;
+            uint64_t fileSize;
+
+            Range strings;
+            Range strRefs;
+            Range components;
+            Range options;
+            Range sdkItems;
+            Range installations;
+            Range toolsets;
+
+            VCToolsRecord vctools;
+            DirectXRecord dxsdk;
+            WindowsSdkRecord winsdk;
+        };
+
+        static_assert(sizeof(Str) == 8 && sizeof(Range) == 8);
+        static_assert(alignof(Header) <= 8);
+
+        static std::shared_ptr<const StateSnapshot> Open(const fs::path &path)
+        {
+            return std::shared_ptr<const StateSnapshot>(new StateSnapshot(path));
+        }
+
+        static void Write(const fs::path &path, const VCTools &vctools, const WindowsSDK &winsdk,
+                          const DirectXSdk &dxsdk)
+        {
+            Builder builder;
+
+            Header header{};
+            std::memcpy(header.magic, kMagic, sizeof(kMagic));
+            header.version = kVersion;
+            header.headerSize = sizeof(Header);
+
+            header.vctools.vsPath = builder.Add(vctools.mVSPath);
+            header.vctools.vswherePath = builder.Add(vctools.mVswherePath);
+            header.vctools.vcToolsDefaultVersion = builder.Add(vctools.mVCToolsDefaultVersion);
+
+            header.vctools.installations.offset = uint32_t(builder.installations.size());
+            for (auto &installation : vctools.mInstallations)
+            {
+                InstallationRecord irec{};
+                irec.instanceId = builder.Add(installation.instance.instanceId);
+                irec.installationName = builder.Add(installation.instance.installationName);
+                irec.installationPath = builder.Add(installation.instance.installationPath);
+                irec.installationVersion = builder.Add(installation.instance.installationVersion);
+                irec.installDate = builder.Add(installation.instance.installDate);
+                irec.defaultToolsetVersion = builder.Add(installation.defaultToolsetVersion);
+
+                irec.toolsets.offset = uint32_t(builder.toolsets.size());
+                for (auto &toolset : installation.toolsets)
+                {
+                    ToolsetRecord trec{};
+                    trec.version = builder.Add(toolset.version);
+                    trec.directory = builder.Add(toolset.directory);
+
+                    trec.archs.offset = uint32_t(builder.strRefs.size());
+                    for (auto &arch : toolset.archs)
+                    {
+                        builder.strRefs.push_back(builder.Add(arch.host));
+                        builder.strRefs.push_back(builder.Add(arch.target));
+                        trec.archs.count++;
+                    }
+
+                    builder.toolsets.push_back(trec);
+                    irec.toolsets.count++;
+                }
+
+                builder.installations.push_back(irec);
+                header.vctools.installations.count++;
+            }
+
+            auto &dx = header.dxsdk;
+            dx.version = builder.Add(dxsdk.mVersion);
+            dx.versionSource = builder.Add(dxsdk.mVersionSource);
+            dx.path = builder.Add(dxsdk.mPath);
+            dx.pathSource = builder.Add(dxsdk.mPathSource);
+            dx.dxsdkDir = builder.Add(dxsdk.mDXSDK_DIR);
+            dx.dxsdkDirSource = builder.Add(dxsdk.mDXSDK_DIR_Source);
+
+            dx.mismatches.offset = uint32_t(builder.strRefs.size());
+            for (auto &mm : dxsdk.mDXSDK_Mismatches)
+            {
+                builder.strRefs.push_back(builder.Add(mm.first));
+                builder.strRefs.push_back(builder.Add(mm.second));
+                dx.mismatches.count++;
+            }
+
+            winsdk.ProbeAll();
+
+            auto &ws = header.winsdk;
+            if (winsdk.mWindows10SdkInfo)
+            {
+                ws.hasInfo = 1;
+                ws.infoDirectory = builder.Add(winsdk.mWindows10SdkInfo->directory);
+                ws.infoVersion = builder.Add(winsdk.mWindows10SdkInfo->version);
+                ws.infoName = builder.Add(winsdk.mWindows10SdkInfo->name);
+            }
+
+            ws.infoSource = builder.Add(winsdk.mWindows10SdkInfoSource);
+            ws.sdkDirectory = builder.Add(winsdk.mWindowsSDKDirectory);
+            ws.sdkVersion = builder.Add(winsdk.mWindowsSDKVersion);
+            ws.sdkName = builder.Add(winsdk.mWindowsSDKName);
+            ws.wdkProductVersion10 = builder.Add(winsdk.mWDKProductVersion10);
+            ws.wdkProductVersion10Source = builder.Add(winsdk.mWDKProductVersion10Source);
+            ws.kmdfVersionsSource = builder.Add(winsdk.mKMDFVersionsSource);
+
+            ws.kmdfVersions.offset = uint32_t(builder.strRefs.size());
+            for (auto &kmdf : winsdk.mKMDFVersions)
+            {
+                builder.strRefs.push_back(builder.Add(kmdf));
+                ws.kmdfVersions.count++;
+            }
+
+            ws.items.offset = uint32_t(builder.items.size());
+            for (auto &sdk : winsdk.mSDKs)
+            {
+                SdkItemRecord item{};
+                item.windowsBuildVersion = builder.Add(sdk.windowsBuildVersion);
+                item.wdkUninstallComponents = builder.AddComponents(sdk.wdkUninstallComponents);
+                item.wdkInstallerComponents = builder.AddComponents(sdk.wdkInstallerComponents);
+                item.sdkUninstallComponents = builder.AddComponents(sdk.sdkUninstallComponents);
+                item.sdkInstallerComponents = builder.AddComponents(sdk.sdkInstallerComponents);
+                item.inInstalledRoots = sdk.inInstalledRoots;
+                item.hasWDKInOptions = sdk.hasWDKInOptions;
+
+                item.options.offset = uint32_t(builder.options.size());
+                for (auto &opt : sdk.options)
+                {
+                    builder.options.push_back({builder.Add(opt.first), uint32_t(opt.second)});
+                    item.options.count++;
+                }
+
+                builder.items.push_back(item);
+                ws.items.count++;
+            }
+
+            builder.WriteFile(path, header);
+        }
+
+        const Header &GetHeader() const
+        {
+            return *reinterpret_cast<const Header *>(mFile.data());
+        }
+
+        // Absent strings come back empty
+        ulib::string_view GetString(Str str) const
+        {
+            if (str.size == kNone)
+                return {};
+
+            auto &strings = GetHeader().strings;
+            if (str.offset > strings.count || str.size > strings.count - str.offset)
+                throw ulib::RuntimeError{"Snapshot string out of bounds"};
+
+            return ulib::string_view{mFile.data() + strings.offset + str.offset, str.size};
+        }
+
+        std::span<const ComponentRecord> GetComponents(Range range) const
+        {
+            return Slice<ComponentRecord>(GetHeader().components, range);
+        }
+
+        std::span<const SdkItemRecord> GetSdkItems(Range range) const
+        {
+            return Slice<SdkItemRecord>(GetHeader().sdkItems, range);
+        }
+
+        VCTools LoadVCTools() const
+        {
+            auto &rec = GetHeader().vctools;
+
+            VCTools vctools{VCTools::Unprobed{}};
+            vctools.mVSPath = GetPath(rec.vsPath);
+            vctools.mVswherePath = GetPath(rec.vswherePath);
+            vctools.mVCToolsDefaultVersion = GetOptional(rec.vcToolsDefaultVersion);
+
+            auto &header = GetHeader();
+            for (auto &irec : Slice<InstallationRecord>(header.installations, rec.installations))
+            {
+                auto &installation = vctools.mInstallations.emplace_back();
+                installation.instance.instanceId = GetString(irec.instanceId);
+                installation.instance.installationName = GetString(irec.installationName);
+                installation.instance.installationPath = GetPath(irec.installationPath).value_or(fs::path{});
+                installation.instance.installationVersion = GetString(irec.installationVersion);
+                installation.instance.installDate = GetString(irec.installDate);
+                installation.defaultToolsetVersion = GetOptional(irec.defaultToolsetVersion);
+
+                for (auto &trec : Slice<ToolsetRecord>(header.toolsets, irec.toolsets))
+                {
+                    VCToolset toolset;
+                    toolset.version = GetString(trec.version);
+                    toolset.directory = GetPath(trec.directory).value_or(fs::path{});
+                    toolset.installation = vctools.mInstallations.size() - 1;
+
+                    auto refs = SlicePairs(trec.archs);
+                    for (size_t i = 0; i + 1 < refs.size(); i += 2)
+                    {
+                        toolset.archs.push_back(
+                            {ulib::string{GetString(refs[i])}, ulib::string{GetString(refs[i + 1])}});
+                    }
+
+                    installation.toolsets.push_back(std::move(toolset));
+                }
+            }
+
+            vctools.IndexToolsets();
+
+            return vctools;
+        }
+
+        DirectXSdk LoadDirectXSdk() const
+        {
+            auto &rec = GetHeader().dxsdk;
+
+            DirectXSdk dxsdk{DirectXSdk::Unprobed{}};
+            dxsdk.mVersion = GetU8(rec.version);
+            dxsdk.mVersionSource = GetString(rec.versionSource);
+            dxsdk.mPath = GetPath(rec.path);
+            dxsdk.mPathSource = GetString(rec.pathSource);
+            dxsdk.mDXSDK_DIR = GetU8(rec.dxsdkDir);
+            dxsdk.mDXSDK_DIR_Source = GetString(rec.dxsdkDirSource);
+
+            auto refs = SlicePairs(rec.mismatches);
+            for (size_t i = 0; i + 1 < refs.size(); i += 2)
+            {
+                auto first = GetU8(refs[i]);
+                auto second = GetU8(refs[i + 1]);
+                if (!first || !second)
+                    throw ulib::RuntimeError{"Malformed snapshot: DirectX mismatch without a path"};
+
+                dxsdk.mDXSDK_Mismatches.push_back({std::move(*first), std::move(*second)});
+            }
+
+            return dxsdk;
+        }
+
+        // Components keep pointing into the mapping, which stays alive as long as the returned model
+        WindowsSDK LoadWindowsSDK() const
+        {
+            auto &rec = GetHeader().winsdk;
+
+            WindowsSDK winsdk{WindowsSDK::Unprobed{}};
+            winsdk.mComponentStorage = shared_from_this();
+
+            if (rec.hasInfo)
+            {
+                detail::Windows10SdkInfo info;
+                info.directory = GetPath(rec.infoDirectory).value_or(fs::path{});
+                info.version = GetString(rec.infoVersion);
+                info.name = GetString(rec.infoName);
+
+                winsdk.mWindows10SdkInfo = std::move(info);
+            }
+
+            winsdk.mWindows10SdkInfoSource = GetString(rec.infoSource);
+            winsdk.mWindowsSDKDirectory = GetPath(rec.sdkDirectory);
+            winsdk.mWindowsSDKVersion = GetOptional(rec.sdkVersion);
+            winsdk.mWindowsSDKName = GetOptional(rec.sdkName);
+            winsdk.mWDKProductVersion10 = GetOptional(rec.wdkProductVersion10);
+            winsdk.mWDKProductVersion10Source = GetString(rec.wdkProductVersion10Source);
+            winsdk.mKMDFVersionsSource = GetString(rec.kmdfVersionsSource);
+
+            for (auto &kmdf : Slice<Str>(GetHeader().strRefs, rec.kmdfVersions))
+                winsdk.mKMDFVersions.push_back(ulib::string{GetString(kmdf)});
+
+            for (auto &irec : GetSdkItems(rec.items))
+            {
+                auto &item = winsdk.MakeSDKItem(GetString(irec.windowsBuildVersion));
+                item.wdkUninstallComponents = LoadComponents(irec.wdkUninstallComponents);
+                item.wdkInstallerComponents = LoadComponents(irec.wdkInstallerComponents);
+                item.sdkUninstallComponents = LoadComponents(irec.sdkUninstallComponents);
+                item.sdkInstallerComponents = LoadComponents(irec.sdkInstallerComponents);
+                item.inInstalledRoots = irec.inInstalledRoots != 0;
+                item.hasWDKInOptions = irec.hasWDKInOptions != 0;
+
+                for (auto &orec : Slice<OptionRecord>(GetHeader().options, irec.options))
+                    item.options.push_back({ulib::string{GetString(orec.name)}, orec.value != 0});
+            }
+
+            return winsdk;
+        }
+
+    private:
+        StateSnapshot(const fs::path &path) : mFile(path)
+        {
+            if (mFile.size() < sizeof(Header))
+                throw ulib::RuntimeError{"Snapshot is truncated"};
+
+            auto &header = GetHeader();
+            if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0)
+                throw ulib::RuntimeError{"Not a vcwin snapshot"};
+            if (header.version != kVersion || header.headerSize != sizeof(Header))
+                throw ulib::RuntimeError{"Unsupported snapshot version"};
+            if (header.fileSize != mFile.size())
+                throw ulib::RuntimeError{"Snapshot is truncated"};
+
+            CheckRegion(header.strings, 1);
+            CheckRegion(header.strRefs, sizeof(Str));
+            CheckRegion(header.components, sizeof(ComponentRecord));
+            CheckRegion(header.options, sizeof(OptionRecord));
+            CheckRegion(header.sdkItems, sizeof(SdkItemRecord));
+            CheckRegion(header.installations, sizeof(InstallationRecord));
+            CheckRegion(header.toolsets, sizeof(ToolsetRecord));
+        }
+
+        void CheckRegion(const Range &region, size_t elementSize) const
+        {
+            uint64_t end = uint64_t(region.offset) + uint64_t(region.count) * elementSize;
+            if (region.offset % alignof(uint32_t) != 0 || end > mFile.size())
+                throw ulib::RuntimeError{"Snapshot region out of bounds"};
+        }
+
+        template <class T>
+        std::span<const T> Slice(const Range &region, Range range) const
+        {
+            if (range.offset > region.count || range.count > region.count - range.offset)
+                throw ulib::RuntimeError{"Snapshot record range out of bounds"};
+
+            auto base = reinterpret_cast<const T *>(mFile.data() + region.offset);
+            return {base + range.offset, range.count};
+        }
+
+        // `pairs.count` pairs of consecutive entries in the string reference array
+        std::span<const Str> SlicePairs(Range pairs) const
+        {
+            if (pairs.count > GetHeader().strRefs.count / 2)
+                throw ulib::RuntimeError{"Snapshot record range out of bounds"};
+
+            return Slice<Str>(GetHeader().strRefs, {pairs.offset, pairs.count * 2});
+        }
+
+        std::optional<ulib::string> GetOptional(Str str) const
+        {
+            if (str.size == kNone)
+                return std::nullopt;
+
+            return ulib::string{GetString(str)};
+        }
+
+        std::optional<ulib::u8string> GetU8(Str str) const
+        {
+            if (str.size == kNone)
+                return std::nullopt;
+
+            auto view = GetString(str);
+            return ulib::u8string{reinterpret_cast<const char8_t *>(view.data()), view.size()};
+        }
+
+        std::optional<fs::path> GetPath(Str str) const
+        {
+            if (str.size == kNone)
+                return std::nullopt;
+
+            auto view = GetString(str);
+            return fs::path{std::u8string_view{reinterpret_cast<const char8_t *>(view.data()), view.size()}};
+        }
+
+        ulib::list<WindowsComponent> LoadComponents(Range range) const
+        {
+            ulib::list<WindowsComponent> components;
+
+            for (auto &crec : GetComponents(range))
+            {
+                WindowsComponent component;
+                component.DisplayName = GetString(crec.displayName);
+                component.DisplayVersion = GetString(crec.displayVersion);
+                component.UninstallString = GetString(crec.uninstallString);
+                component.SystemComponent = crec.systemComponent != 0;
+                component.guid = GetString(crec.guid);
+
+                components.push_back(component);
+            }
+
+            return components;
+        }
+
+        struct Builder
+        {
+            std::string strings;
+            std::unordered_map<std::string, Str> stored;
+
+            std::vector<Str> strRefs;
+            std::vector<ComponentRecord> components;
+            std::vector<OptionRecord> options;
+            std::vector<SdkItemRecord> items;
+            std::vector<InstallationRecord> installations;
+            std::vector<ToolsetRecord> toolsets;
+
+            Str Add(std::string_view str)
+            {
+                auto [it, inserted] = stored.try_emplace(std::string{str});
+                if (inserted)
+                {
+                    it->second = {uint32_t(strings.size()), uint32_t(str.size())};
+                    strings.append(str);
+                }
+
+                return it->second;
+            }
+
+            Str Add(const ulib::string &str)
+            {
+                return Add(std::string_view{str.data(), str.size()});
+            }
+
+            Str Add(ulib::string_view str)
+            {
+                return Add(std::string_view{str.data(), str.size()});
+            }
+
+            Str Add(const ulib::u8string &str)
+            {
+                return Add(std::string_view{reinterpret_cast<const char *>(str.data()), str.size()});
+            }
+
+            Str Add(const fs::path &path)
+            {
+                auto u8 = path.u8string();
+                return Add(std::string_view{reinterpret_cast<const char *>(u8.data()), u8.size()});
+            }
+
+            template <class T>
+            Str Add(const std::optional<T> &value)
+            {
+                return value ? Add(*value) : Str{};
+            }
+
+            Range AddComponents(const ulib::list<WindowsComponent> &list)
+            {
+                Range range{uint32_t(components.size()), 0};
+                for (auto &component : list)
+                {
+                    components.push_back({Add(component.DisplayName), Add(component.DisplayVersion),
+                                          Add(component.UninstallString), Add(component.guid),
+                                          uint32_t(component.SystemComponent)});
+                    range.count++;
+                }
+
+                return range;
+            }
+
+            void WriteFile(const fs::path &path, Header header) const
+            {
+                std::string image(sizeof(Header), '\0');
+
+                auto place = [&](Range &region, const void *data, size_t count, size_t elementSize) {
+                    image.resize((image.size() + 7) / 8 * 8, '\0');
+                    region = {uint32_t(image.size()), uint32_t(count)};
+                    image.append(static_cast<const char *>(data), count * elementSize);
+                };
+
+                place(header.strRefs, strRefs.data(), strRefs.size(), sizeof(Str));
+                place(header.components, components.data(), components.size(), sizeof(ComponentRecord));
+                place(header.options, options.data(), options.size(), sizeof(OptionRecord));
+                place(header.sdkItems, items.data(), items.size(), sizeof(SdkItemRecord));
+                place(header.installations, installations.data(), installations.size(), sizeof(InstallationRecord));
+                place(header.toolsets, toolsets.data(), toolsets.size(), sizeof(ToolsetRecord));
+                place(header.strings, strings.data(), strings.size(), 1);
+
+                if (image.size() > kNone)
+                    throw ulib::RuntimeError{"Snapshot exceeds 4 GiB"};
+
+                header.fileSize = image.size();
+                std::memcpy(image.data(), &header, sizeof(Header));
+
+                std::ofstream stream{path, std::ios::binary | std::ios::trunc};
+                stream.write(image.data(), std::streamsize(image.size()));
+                if (!stream)
+                    throw ulib::RuntimeError{"Failed to write snapshot"};
+            }
+        };
+
+        MappedFile mFile;
+    };
+} // namespace vcwin
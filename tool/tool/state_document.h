@@ -0,0 +1,123 @@
+#pragma once
+
+#include "dev_environment.h"
+#include "dxsdk.h"
+#include "emitter.h"
+#include "vctools.h"
+#include "winsdk.h"
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <ulib/string.h>
+
+namespace vcwin
+{
+    // How long each probe behind a state document took, and how long the command waited for the probes overall.
+    // A resident vcwin answers from memory, its total is the time taken to produce the reply.
+    struct StateTimings
+    {
+        std::chrono::steady_clock::duration vctools{};
+        std::chrono::steady_clock::duration winsdk{};
+        std::chrono::steady_clock::duration dxsdk{};
+        std::chrono::steady_clock::duration total{};
+
+        void Emit(Emitter &emitter) const
+        {
+            auto ms = [](std::chrono::steady_clock::duration d) {
+                return int64_t(std::chrono::duration_cast<std::chrono::milliseconds>(d).count());
+            };
+
+            emitter.BeginObject();
+            emitter.Field("vctools", ms(vctools));
+            emitter.Field("winsdk", ms(winsdk));
+            emitter.Field("dxsdk", ms(dxsdk));
+            emitter.Field("total", ms(total));
+            emitter.EndObject();
+        }
+    };
+
+    // Default x64 toolchain environment of a state document, PATH holds only the toolchain directories, or the
+    // reason it could not be set up
+    struct StateEnvironment
+    {
+        std::optional<DevEnvironment> environment;
+        ulib::string error;
+
+        static StateEnvironment Make(const VCTools &vctools, const WindowsSDK &winsdk)
+        {
+            StateEnvironment result;
+            try
+            {
+                result.environment = make_dev_environment(vctools, winsdk);
+            }
+            catch (const std::exception &ex)
+            {
+                result.error = ex.what();
+            }
+
+            return result;
+        }
+
+        void Emit(Emitter &emitter) const
+        {
+            if (environment)
+            {
+                environment->Emit(emitter);
+                return;
+            }
+
+            emitter.BeginObject();
+            emitter.Field("error", error);
+            emitter.EndObject();
+        }
+    };
+
+    // The document `vcwin state` writes, whether probed in process or served by `vcwin serve`. Members the emitter
+    // does not want are never touched, so the models behind them may be null. Timings are written only when set.
+    struct StateDocument
+    {
+        const VCTools *vctools = nullptr;
+        const WindowsSDK *winsdk = nullptr;
+        const DirectXSdk *dxsdk = nullptr;
+        const StateEnvironment *environment = nullptr;
+        const StateTimings *timings = nullptr;
+
+        void Emit(Emitter &emitter) const
+        {
+            emitter.BeginObject();
+
+            if (emitter.Wants("vctools"))
+            {
+                emitter.Key("vctools");
+                vctools->Emit(emitter);
+            }
+
+            if (emitter.Wants("winsdk"))
+            {
+                emitter.Key("winsdk");
+                winsdk->Emit(emitter);
+            }
+
+            if (emitter.Wants("dxsdk"))
+            {
+                emitter.Key("dxsdk");
+                dxsdk->Emit(emitter);
+            }
+
+            if (emitter.Wants("environment"))
+            {
+                emitter.Key("environment");
+                environment->Emit(emitter);
+            }
+
+            if (timings && emitter.Wants("timings_ms"))
+            {
+                emitter.Key("timings_ms");
+                timings->Emit(emitter);
+            }
+
+            emitter.EndObject();
+        }
+    };
+} // namespace vcwin
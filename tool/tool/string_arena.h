@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include <ulib/string.h>
+
+namespace vcwin
+{
+    // Append-only string storage with interning. Equal strings are stored once, in a few large blocks,
+    // and the returned views stay valid for the lifetime of the arena. Safe to use from several threads.
+    class StringArena
+    {
+    public:
+        static constexpr size_t kBlockSize = 64 * 1024;
+
+        StringArena() = default;
+        StringArena(const StringArena &) = delete;
+        StringArena &operator=(const StringArena &) = delete;
+
+        ulib::string_view Intern(ulib::string_view str)
+        {
+            std::string_view key{str.data(), str.size()};
+            if (key.empty())
+                return {};
+
+            std::lock_guard lock{mMutex};
+
+            auto it = mStrings.find(key);
+            if (it == mStrings.end())
+                it = mStrings.insert(Store(key)).first;
+
+            return ulib::string_view{it->data(), it->size()};
+        }
+
+        size_t GetBlockCount() const
+        {
+            std::lock_guard lock{mMutex};
+            return mBlocks.size();
+        }
+
+        size_t GetStringCount() const
+        {
+            std::lock_guard lock{mMutex};
+            return mStrings.size();
+        }
+
+    private:
+        std::string_view Store(std::string_view str)
+        {
+            char *dst = nullptr;
+
+            // Oversized strings get a block of their own and leave the current block open
+            if (str.size() > kBlockSize / 4)
+            {
+                dst = mBlocks.emplace_back(std::make_unique<char[]>(str.size())).get();
+            }
+            else
+            {
+                if (!mCurrent || kBlockSize - mUsed < str.size())
+                {
+                    mCurrent = mBlocks.emplace_back(std::make_unique<char[]>(kBlockSize)).get();
+                    mUsed = 0;
+                }
+
+                dst = mCurrent + mUsed;
+                mUsed += str.size();
+            }
+
+            std::memcpy(dst, str.data(), str.size());
+            return {dst, str.size()};
+        }
+
+        mutable std::mutex mMutex;
+        std::vector<std::unique_ptr<char[]>> mBlocks;
+        char *mCurrent = nullptr;
+        size_t mUsed = 0;
+        std::unordered_set<std::string_view> mStrings;
+    };
+} // namespace vcwin
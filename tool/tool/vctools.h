@@ -1,8 +1,15 @@
 #pragma once
 
-#include <3rdparty/WinReg.hpp>
+#include "emitter.h"
+#include "parallel.h"
+#include "vs_instances.h"
+#include <algorithm>
 #include <filesystem>
 #include <futile/futile.h>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
 // #include <nlohmann/json.hpp>
 #include <ulib/env.h>
 #include <ulib/json.h>
@@ -22,8 +29,8 @@ namespace vcwin
             if (!std::filesystem::exists(vswhere_exe))
             {
                 // Find the globally available vswhere.exe.
-                std::filesystem::path program_files_x86 = std::getenv("ProgramFiles(x86)");
-                vswhere_exe = program_files_x86 / "Microsoft Visual Studio/Installer/vswhere.exe";
+                if (auto program_files_x86 = ulib::getenv(u8"ProgramFiles(x86)"))
+                    vswhere_exe = fs::path{*program_files_x86} / "Microsoft Visual Studio/Installer/vswhere.exe";
             }
 
             if (!std::filesystem::exists(vswhere_exe))
@@ -35,10 +42,11 @@ namespace vcwin
             return vswhere_exe;
         }
 
-        inline fs::path find_vs_installation_path(const fs::path &vswhere_path)
+        // Every instance vswhere knows about, Build Tools included, the same set read_vs_instances() returns
+        inline ulib::list<VSInstance> find_vs_instances(const fs::path &vswhere_path)
         {
             ulib::process vswhere{vswhere_path,
-                                  {"-latest", "-nocolor", "-utf8", "-format", "json"},
+                                  {"-all", "-products", "*", "-nocolor", "-utf8", "-format", "json"},
                                   ulib::process::die_with_parent | ulib::process::pipe_stdout |
                                       ulib::process::pipe_stderr};
 
@@ -52,14 +60,36 @@ namespace vcwin
             auto vswhere_stuff_text = ulib::u8(vswhere_stuff_u);
 
             auto vswhere_stuff = ulib::json::parse(vswhere_stuff_text);
-            
-            if (vswhere_stuff.size() == 0)
-                throw ulib::RuntimeError{"No Visual Studio installations were found on this computer"};
 
-            const auto &vs_info = vswhere_stuff[0];
-            std::filesystem::path vs_path = vs_info["installationPath"].get<std::string>();
+            ulib::list<VSInstance> instances;
+            for (size_t i = 0; i != vswhere_stuff.size(); i++)
+            {
+                const auto &vs_info = vswhere_stuff[i];
+
+                // -all also lists incomplete instances, read_vs_instances() leaves those out
+                auto complete = vs_info.search("isComplete");
+                if (complete && !complete->template get<bool>())
+                    continue;
+
+                auto field = [&](ulib::string_view key) {
+                    auto value = vs_info.search(key);
+                    return value ? value->template get<std::string>() : std::string{};
+                };
 
-            return vs_path;
+                VSInstance instance;
+                instance.instanceId = field("instanceId");
+                instance.installationName = field("installationName");
+                instance.installationPath = path_from_utf8(field("installationPath"));
+                instance.installationVersion = field("installationVersion");
+                instance.installDate = field("installDate");
+
+                instances.push_back(std::move(instance));
+            }
+
+            if (instances.size() == 0)
+                throw ulib::RuntimeError{"No Visual Studio installations were found on this computer"};
+
+            return instances;
         }
 
         inline ulib::string get_vc_tools_version(const fs::path &vs_path)
@@ -69,57 +99,332 @@ namespace vcwin
 
             return vc_tools_version;
         }
+        // Directories right under dir, sorted so the model does not depend on enumeration order
+        inline std::vector<fs::path> list_subdirectories(const fs::path &dir)
+        {
+            std::vector<fs::path> dirs;
+
+            std::error_code ec;
+            for (auto &entry : fs::directory_iterator{dir, ec})
+            {
+                if (entry.is_directory(ec))
+                    dirs.push_back(entry.path());
+            }
+
+            std::sort(dirs.begin(), dirs.end());
+            return dirs;
+        }
+
+        inline ulib::string filename_of(const fs::path &path)
+        {
+            return ulib::str(path.filename().u8string());
+        }
     } // namespace detail
 
+    // Compilers under bin/Host<host>/<target> of a toolset
+    struct VCToolsetArch
+    {
+        ulib::string host;
+        ulib::string target;
+    };
+
+    // One VC/Tools/MSVC/<version> directory
+    struct VCToolset
+    {
+        ulib::string version;
+        fs::path directory;
+        ulib::list<VCToolsetArch> archs;
+
+        // Index of the owning installation in VCTools::GetInstallations()
+        size_t installation = 0;
+
+        bool HasArch(ulib::string_view host, ulib::string_view target) const
+        {
+            for (auto &arch : archs)
+            {
+                if (arch.host == host && arch.target == target)
+                    return true;
+            }
+
+            return false;
+        }
+    };
+
+    struct VSInstallation
+    {
+        VSInstance instance;
+        std::optional<ulib::string> defaultToolsetVersion;
+
+        // Newest first
+        ulib::list<VCToolset> toolsets;
+    };
+
+    inline void emit_installation_fields(Emitter &emitter, const VSInstallation &installation)
+    {
+        emitter.Field("instance_id", installation.instance.instanceId);
+        emitter.Field("name", installation.instance.installationName);
+        emitter.Field("path", installation.instance.installationPath);
+        emitter.Field("version", installation.instance.installationVersion);
+        emitter.Field("install_date", installation.instance.installDate);
+        emitter.Field("default_toolset", installation.defaultToolsetVersion);
+
+        emitter.Key("toolsets");
+        emitter.BeginArray();
+        for (auto &toolset : installation.toolsets)
+        {
+            emitter.BeginObject();
+            emitter.Field("version", toolset.version);
+            emitter.Field("path", toolset.directory);
+
+            emitter.Key("archs");
+            emitter.BeginArray();
+            for (auto &arch : toolset.archs)
+                emitter.Value(ulib::format("{}/{}", arch.host, arch.target));
+            emitter.EndArray();
+
+            emitter.EndObject();
+        }
+        emitter.EndArray();
+    }
+
     class VCTools
     {
     public:
         VCTools()
         {
+            ulib::list<VSInstance> instances;
+
             try
             {
-                mVswherePath = detail::find_vswhere();
+                // The installer's instance records answer what vswhere would, without a child process
+                instances = read_vs_instances();
+            }
+            catch (...)
+            {
+            }
 
-                if (mVswherePath)
-                    mVSPath = detail::find_vs_installation_path(*mVswherePath);
+            // Reported either way; finding it is an existence check, running it is left to the fallback
+            try
+            {
+                mVswherePath = detail::find_vswhere();
+            }
+            catch (...)
+            {
+            }
 
-                if (mVSPath)
-                    mVCToolsDefaultVersion = detail::get_vc_tools_version(*mVSPath);
+            try
+            {
+                if (instances.size() == 0 && mVswherePath)
+                    instances = detail::find_vs_instances(*mVswherePath);
             }
             catch (...)
             {
             }
+
+            Probe(instances);
         }
 
-        std::optional<fs::path> GetVSPath()
+        // The instances of one _Instances directory and nothing else, e.g. a fixture tree
+        explicit VCTools(const fs::path &instancesDir)
+        {
+            Probe(read_vs_instances(instancesDir));
+        }
+
+        std::optional<fs::path> GetVSPath() const
         {
             return mVSPath;
         };
 
-        std::optional<fs::path> GetVswherePath()
+        std::optional<fs::path> GetVswherePath() const
         {
             return mVswherePath;
         };
 
-        std::optional<ulib::string> GetVCToolsDefaultVersion()
+        std::optional<ulib::string> GetVCToolsDefaultVersion() const
         {
             return mVCToolsDefaultVersion;
         };
 
-        ulib::json ToJson()
+        const std::vector<VSInstallation> &GetInstallations() const
+        {
+            return mInstallations;
+        }
+
+        // Newest toolset across all installations that matches every given filter, empty filters match anything.
+        // A version matches itself and its prefixes at a dot, so "14.38" selects the newest 14.38.x.
+        const VCToolset *FindToolset(ulib::string_view version = {}, ulib::string_view host = {},
+                                     ulib::string_view target = {}) const
         {
-            ulib::json val = ulib::json::object();
+            std::string_view wanted{version.data(), version.size()};
+
+            for (auto &[installation, toolset] : mToolsetIndex)
+            {
+                auto &candidate = mInstallations[installation].toolsets[toolset];
+                std::string_view candidateVersion{candidate.version.data(), candidate.version.size()};
 
-            val["vs_path"] = mVSPath;
-            val["vswhere_path"] = mVSPath;
-            val["vc_tools_default_version"] = mVSPath;
+                if (!wanted.empty() && candidateVersion != wanted &&
+                    !(candidateVersion.starts_with(wanted) && candidateVersion[wanted.size()] == '.'))
+                    continue;
 
-            return val;
+                bool archMatches = false;
+                for (auto &arch : candidate.archs)
+                {
+                    if ((host.empty() || arch.host == host) && (target.empty() || arch.target == target))
+                    {
+                        archMatches = true;
+                        break;
+                    }
+                }
+
+                if (archMatches || (host.empty() && target.empty()))
+                    return &candidate;
+            }
+
+            return nullptr;
+        }
+
+        void Emit(Emitter &emitter) const
+        {
+            emitter.BeginObject();
+            emitter.Field("vs_path", mVSPath);
+            emitter.Field("vswhere_path", mVswherePath);
+            emitter.Field("vc_tools_default_version", mVCToolsDefaultVersion);
+
+            emitter.Key("instances");
+            emitter.BeginArray();
+            for (auto &installation : mInstallations)
+            {
+                emitter.BeginObject();
+                emit_installation_fields(emitter, installation);
+                emitter.EndObject();
+            }
+            emitter.EndArray();
+
+            emitter.EndObject();
+        }
+
+        ulib::json ToJson() const
+        {
+            JsonDomEmitter emitter;
+            Emit(emitter);
+            return emitter.Take();
         }
 
     private:
+        friend class StateSnapshot;
+
+        // Empty model to be filled from a snapshot
+        struct Unprobed
+        {
+        };
+
+        VCTools(Unprobed)
+        {
+        }
+
+        void Probe(const ulib::list<VSInstance> &instances)
+        {
+            ProbeInstallations(instances);
+
+            // The fields below describe the instance `vswhere -latest` would pick
+            if (auto latest = find_latest_vs_instance(instances))
+            {
+                mVSPath = latest->installationPath;
+
+                for (auto &installation : mInstallations)
+                {
+                    if (installation.instance.instanceId == latest->instanceId)
+                        mVCToolsDefaultVersion = installation.defaultToolsetVersion;
+                }
+            }
+        }
+
+        // Instances first, then every toolset of every instance, each level spread over the worker pool
+        void ProbeInstallations(const ulib::list<VSInstance> &instances)
+        {
+            mInstallations.resize(instances.size());
+
+            parallel_for(instances.size(), [&](size_t i) {
+                auto &installation = mInstallations[i];
+                installation.instance = instances[i];
+
+                try
+                {
+                    installation.defaultToolsetVersion = detail::get_vc_tools_version(instances[i].installationPath);
+                }
+                catch (...)
+                {
+                }
+
+                for (auto &dir : detail::list_subdirectories(instances[i].installationPath / "VC/Tools/MSVC"))
+                {
+                    VCToolset toolset;
+                    toolset.version = detail::filename_of(dir);
+                    toolset.directory = dir;
+                    toolset.installation = i;
+
+                    installation.toolsets.push_back(std::move(toolset));
+                }
+
+                std::sort(installation.toolsets.begin(), installation.toolsets.end(),
+                          [](const VCToolset &left, const VCToolset &right) {
+                              return detail::version_less(
+                                  std::string_view{right.version.data(), right.version.size()},
+                                  std::string_view{left.version.data(), left.version.size()});
+                          });
+            });
+
+            std::vector<VCToolset *> toolsets;
+            for (auto &installation : mInstallations)
+            {
+                for (auto &toolset : installation.toolsets)
+                    toolsets.push_back(&toolset);
+            }
+
+            parallel_for(toolsets.size(), [&](size_t i) {
+                auto &toolset = *toolsets[i];
+
+                for (auto &hostDir : detail::list_subdirectories(toolset.directory / "bin"))
+                {
+                    auto hostName = detail::filename_of(hostDir);
+                    std::string_view host{hostName.data(), hostName.size()};
+                    if (!host.starts_with("Host"))
+                        continue;
+
+                    for (auto &targetDir : detail::list_subdirectories(hostDir))
+                        toolset.archs.push_back({ulib::string{host.substr(4)}, detail::filename_of(targetDir)});
+                }
+            });
+
+            IndexToolsets();
+        }
+
+        // Orders every toolset newest first, instances in GetInstallations() order among equal versions
+        void IndexToolsets()
+        {
+            mToolsetIndex.clear();
+            for (size_t i = 0; i != mInstallations.size(); i++)
+            {
+                for (size_t j = 0; j != mInstallations[i].toolsets.size(); j++)
+                    mToolsetIndex.push_back({i, j});
+            }
+
+            auto version = [this](const std::pair<size_t, size_t> &entry) {
+                auto &toolset = mInstallations[entry.first].toolsets[entry.second];
+                return std::string_view{toolset.version.data(), toolset.version.size()};
+            };
+
+            std::stable_sort(mToolsetIndex.begin(), mToolsetIndex.end(), [&](auto &left, auto &right) {
+                return detail::version_less(version(right), version(left));
+            });
+        }
+
         std::optional<fs::path> mVSPath;
         std::optional<fs::path> mVswherePath;
         std::optional<ulib::string> mVCToolsDefaultVersion;
+
+        std::vector<VSInstallation> mInstallations;
+        // (installation, toolset) of every toolset, newest first
+        std::vector<std::pair<size_t, size_t>> mToolsetIndex;
     };
-} // namespace vcwin
\ No newline at end of file
+} // namespace vcwin
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "json_scanner.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <ulib/env.h>
+#include <ulib/runtimeerror.h>
+#include <ulib/string.h>
+
+namespace vcwin
+{
+    namespace fs = std::filesystem;
+
+    // One Visual Studio instance as registered by the installer
+    struct VSInstance
+    {
+        // Name of the instance directory, the same id vswhere reports
+        ulib::string instanceId;
+        ulib::string installationName;
+        fs::path installationPath;
+        ulib::string installationVersion;
+        ulib::string installDate;
+
+        // False for an install that was interrupted, failed or still needs a reboot
+        bool isComplete = true;
+    };
+
+    namespace detail
+    {
+        inline fs::path path_from_utf8(std::string_view utf8)
+        {
+            return fs::path{std::u8string{reinterpret_cast<const char8_t *>(utf8.data()), utf8.size()}};
+        }
+
+        // Orders dotted numeric versions part by part, "17.10.0" is newer than "17.9.5"
+        inline bool version_less(std::string_view left, std::string_view right)
+        {
+            auto next = [](std::string_view &ver) {
+                uint64_t value = 0;
+                size_t i = 0;
+                for (; i != ver.size() && ver[i] >= '0' && ver[i] <= '9'; i++)
+                    value = value * 10 + uint64_t(ver[i] - '0');
+
+                ver.remove_prefix(i == ver.size() ? i : i + 1);
+                return value;
+            };
+
+            while (!left.empty() || !right.empty())
+            {
+                uint64_t l = next(left);
+                uint64_t r = next(right);
+                if (l != r)
+                    return l < r;
+            }
+
+            return false;
+        }
+
+        // Reads the few top-level fields vcwin needs from an instance state.json and stops as soon as it has them
+        inline std::optional<VSInstance> read_vs_instance_state(const fs::path &stateFile)
+        {
+            MappedFile file{stateFile};
+            std::string_view text{file.data(), file.size()};
+
+            // The installer writes no BOM, but a state.json saved by an editor may start with one
+            if (text.starts_with("\xEF\xBB\xBF"))
+                text.remove_prefix(3);
+
+            JsonScanner scanner{text};
+
+            std::string name, path, version, date;
+            std::pair<std::string_view, std::string *> fields[] = {
+                {"installationName", &name},
+                {"installationPath", &path},
+                {"installationVersion", &version},
+                {"installDate", &date},
+            };
+
+            // isComplete is false and installState lacks some eComplete flags (4294967295 is all of them) for an
+            // install that did not finish. Instances written before these fields existed count as complete.
+            bool complete = true;
+            std::pair<std::string_view, std::string_view> states[] = {
+                {"isComplete", "true"},
+                {"installState", "4294967295"},
+            };
+
+            size_t found = 0;
+            constexpr size_t wanted = std::size(fields) + std::size(states);
+            bool broken = false;
+            scanner.ForEachMember([&](std::string_view key) {
+                for (auto &[fieldKey, field] : fields)
+                {
+                    if (key == fieldKey)
+                    {
+                        broken = !scanner.ReadStringValue(*field);
+                        return !broken && ++found != wanted;
+                    }
+                }
+
+                for (auto &[stateKey, completeValue] : states)
+                {
+                    if (key == stateKey)
+                    {
+                        char first = scanner.PeekValue();
+                        if (first == '"' || first == '{' || first == '[')
+                        {
+                            broken = !scanner.SkipValue();
+                        }
+                        else
+                        {
+                            std::string_view value;
+                            broken = !scanner.ReadScalarText(value);
+                            complete = complete && value == completeValue;
+                        }
+
+                        return !broken && ++found != wanted;
+                    }
+                }
+
+                return scanner.SkipValue();
+            });
+
+            // A field cut short is worse than none, and without a path the instance is of no use
+            if (broken || path.empty())
+                return std::nullopt;
+
+            VSInstance instance;
+            instance.instanceId = ulib::str(stateFile.parent_path().filename().u8string());
+            instance.installationName = name;
+            instance.installationPath = path_from_utf8(path);
+            instance.installationVersion = version;
+            instance.installDate = date;
+            instance.isComplete = complete;
+
+            return instance;
+        }
+    } // namespace detail
+
+    // %ProgramData%\Microsoft\VisualStudio\Packages\_Instances, where the installer keeps one directory per instance
+    inline fs::path default_vs_instances_dir()
+    {
+        if (auto programData = ulib::getenv(u8"ProgramData"))
+            return fs::path{*programData} / "Microsoft/VisualStudio/Packages/_Instances";
+
+        throw ulib::RuntimeError{"Failed to determine ProgramData env variable"};
+    }
+
+    // Every complete instance with a readable state.json, ordered by instance id. Broken and incomplete instances
+    // are left out, as vswhere leaves them out without -all.
+    inline ulib::list<VSInstance> read_vs_instances(const fs::path &instancesDir = default_vs_instances_dir())
+    {
+        ulib::list<VSInstance> instances;
+
+        std::error_code ec;
+        for (auto &entry : fs::directory_iterator{instancesDir, ec})
+        {
+            try
+            {
+                auto instance = detail::read_vs_instance_state(entry.path() / "state.json");
+                if (instance && instance->isComplete)
+                    instances.push_back(std::move(*instance));
+            }
+            catch (...)
+            {
+            }
+        }
+
+        std::sort(instances.begin(), instances.end(),
+                  [](const VSInstance &left, const VSInstance &right) {
+                      return std::string_view{left.instanceId.data(), left.instanceId.size()} <
+                             std::string_view{right.instanceId.data(), right.instanceId.size()};
+                  });
+
+        return instances;
+    }
+
+    // Same pick as `vswhere -latest`: the highest installation version, the later install among equal versions.
+    // Unlike vswhere without -products, Build Tools instances take part too. Incomplete instances never do.
+    inline std::optional<VSInstance> find_latest_vs_instance(const ulib::list<VSInstance> &instances)
+    {
+        const VSInstance *latest = nullptr;
+        for (auto &instance : instances)
+        {
+            if (!instance.isComplete)
+                continue;
+
+            if (!latest)
+            {
+                latest = &instance;
+                continue;
+            }
+
+            std::string_view version{instance.installationVersion.data(), instance.installationVersion.size()};
+            std::string_view latestVersion{latest->installationVersion.data(), latest->installationVersion.size()};
+            std::string_view date{instance.installDate.data(), instance.installDate.size()};
+            std::string_view latestDate{latest->installDate.data(), latest->installDate.size()};
+
+            // Install dates are ISO 8601, so they order as plain strings
+            if (detail::version_less(latestVersion, version) ||
+                (!detail::version_less(version, latestVersion) && latestDate < date))
+                latest = &instance;
+        }
+
+        if (!latest)
+            return std::nullopt;
+
+        return *latest;
+    }
+} // namespace vcwin
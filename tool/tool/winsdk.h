@@ -1,8 +1,17 @@
 #pragma once
 
+#include "emitter.h"
 #include "installers.h"
-#include <3rdparty/WinReg.hpp>
+#include "registry.h"
+#include <algorithm>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 #include <ulib/env.h>
 #include <ulib/format.h>
 #include <ulib/json.h>
@@ -24,19 +33,18 @@ namespace vcwin
             ulib::string name;
         };
 
-        inline Windows10SdkInfo get_windows10_sdk_info()
+        inline Windows10SdkInfo get_windows10_sdk_info(const RegistryBackend &registry = default_registry())
         {
-            winreg::RegKey winsdk_node;
-
-            winsdk_node.Create(HKEY_LOCAL_MACHINE, L"SOFTWARE\\WOW6432Node\\Microsoft\\Microsoft SDKs\\Windows\\v10.0",
-                               KEY_READ | KEY_WOW64_32KEY);
+            auto winsdk_node = registry.OpenKey(RegistryRoot::LocalMachine,
+                                                L"SOFTWARE\\WOW6432Node\\Microsoft\\Microsoft SDKs\\Windows\\v10.0",
+                                                RegistryView::Wow64_32);
+            if (!winsdk_node)
+                throw ulib::RuntimeError{"Windows 10 SDK registry key not found"};
 
             std::filesystem::path winsdk_directory =
-                ulib::sstr(ulib::u8(winsdk_node.GetStringValue(L"InstallationFolder")));
-            auto winsdk_version = ulib::sstr(ulib::u8(winsdk_node.GetStringValue(L"ProductVersion")));
-            auto winsdk_name = ulib::sstr(ulib::u8(winsdk_node.GetStringValue(L"ProductName")));
-
-            winsdk_node.Close();
+                ulib::sstr(ulib::u8(winsdk_node->GetString(L"InstallationFolder")));
+            auto winsdk_version = ulib::sstr(ulib::u8(winsdk_node->GetString(L"ProductVersion")));
+            auto winsdk_name = ulib::sstr(ulib::u8(winsdk_node->GetString(L"ProductName")));
 
             Windows10SdkInfo info;
             info.directory = winsdk_directory;
@@ -52,29 +60,86 @@ namespace vcwin
     {
         ulib::string source; // 10.0.22621.2428
 
-        uint32 win;   // 10
-        uint32 mark;  // 0 - windows, 1 - software
-        uint32 build; // 22621 os build number
-        uint32 qfe;   // 2428 QFE (Quick Fix Engineering)
+        uint32 win = 0;   // 10
+        uint32 mark = 0;  // 0 - windows, 1 - software
+        uint32 build = 0; // 22621 os build number
+        uint32 qfe = 0;   // 2428 QFE (Quick Fix Engineering)
 
-        static wversion parse(ulib::string_view ver)
+        // Packs the four parts, 16 bits each like a VERSIONINFO, so ordering keys orders versions
+        static constexpr uint64_t make_key(uint32 win, uint32 mark, uint32 build, uint32 qfe)
         {
-            wversion wv;
-            wv.source = ver;
+            return (uint64_t(win) << 48) | (uint64_t(mark) << 32) | (uint64_t(build) << 16) | uint64_t(qfe);
+        }
+
+        // Reads "win.mark.build[.qfe]" without allocating or throwing. Every part has to be a plain decimal
+        // number that fits in 16 bits, anything else is rejected.
+        static constexpr std::optional<uint64_t> parse_key(std::string_view ver)
+        {
+            uint32 parts[4] = {};
+            size_t count = 0;
 
-            auto spl = ulib::list<ulib::string>{ver.split(".")};
-            if (spl.size() >= 3)
+            for (size_t i = 0;; i++)
             {
-                wv.win = std::stoul(spl[0]);
-                wv.mark = std::stoul(spl[1]);
-                wv.build = std::stoul(spl[2]);
+                if (count == 4)
+                    return std::nullopt;
 
-                if (spl.size() >= 4)
-                    wv.qfe = std::stoul(spl[3]);
-                else
-                    wv.qfe = 0;
+                size_t begin = i;
+                uint32 value = 0;
+
+                for (; i < ver.size() && ver[i] >= '0' && ver[i] <= '9'; i++)
+                {
+                    value = value * 10 + uint32(ver[i] - '0');
+                    if (value > 0xFFFF)
+                        return std::nullopt;
+                }
+
+                if (i == begin)
+                    return std::nullopt;
+
+                parts[count++] = value;
+
+                if (i == ver.size())
+                    break;
+
+                if (ver[i] != '.')
+                    return std::nullopt;
             }
 
+            if (count < 3)
+                return std::nullopt;
+
+            return make_key(parts[0], parts[1], parts[2], parts[3]);
+        }
+
+        uint64_t key() const
+        {
+            return make_key(win, mark, build, qfe);
+        }
+
+        static std::optional<wversion> try_parse(ulib::string_view ver)
+        {
+            auto key = parse_key(std::string_view{ver.data(), ver.size()});
+            if (!key)
+                return std::nullopt;
+
+            wversion wv;
+            wv.source = ver;
+            wv.win = uint32(*key >> 48);
+            wv.mark = uint32(*key >> 32) & 0xFFFF;
+            wv.build = uint32(*key >> 16) & 0xFFFF;
+            wv.qfe = uint32(*key) & 0xFFFF;
+
+            return wv;
+        }
+
+        // A malformed version leaves every part zero
+        static wversion parse(ulib::string_view ver)
+        {
+            if (auto wv = try_parse(ver))
+                return *wv;
+
+            wversion wv;
+            wv.source = ver;
             return wv;
         }
 
@@ -92,8 +157,26 @@ namespace vcwin
         {
             return parse(ver).build;
         }
+
+        // Identity of a Windows build: the key with mark and QFE cleared
+        static constexpr uint64_t build_id(uint64_t key)
+        {
+            return key & make_key(0xFFFF, 0, 0xFFFF, 0);
+        }
+
+        static uint64_t build_id(const wversion &wver)
+        {
+            return build_id(wver.key());
+        }
     };
 
+    static_assert(wversion::parse_key("10.0.22621.2428") == wversion::make_key(10, 0, 22621, 2428));
+    static_assert(wversion::parse_key("10.1.19041") == wversion::make_key(10, 1, 19041, 0));
+    static_assert(*wversion::parse_key("10.0.22621.0") < *wversion::parse_key("10.0.22621.1"));
+    static_assert(*wversion::parse_key("10.0.9999.9") < *wversion::parse_key("10.0.10000.0"));
+    static_assert(!wversion::parse_key("10.0") && !wversion::parse_key("10.0.x.1") && !wversion::parse_key("1.2.3."));
+    static_assert(!wversion::parse_key("10.0.70000.0") && !wversion::parse_key("1.2.3.4.5"));
+
     struct WDKUninstallComponent
     {
         ulib::string name;
@@ -144,242 +227,422 @@ namespace vcwin
         }
     };
 
+    inline void emit_component_fields(Emitter &emitter, const WindowsComponent &comp)
+    {
+        emitter.Field("DisplayVersion", comp.DisplayVersion);
+        emitter.Field("SystemComponent", comp.SystemComponent);
+        emitter.Field("UninstallString", comp.UninstallString);
+    }
+
+    // Members of an SDK item as the state document has them, the component lists only with `withComponents`
+    inline void emit_sdk_item_fields(Emitter &emitter, const WindowsSDKItem &sdk, bool withComponents)
+    {
+        emitter.Field("windows_version", sdk.windowsBuildVersion);
+        emitter.Field("has_wdk_in_options", sdk.hasWDKInOptions);
+        emitter.Field("in_InstalledRoots", sdk.inInstalledRoots);
+
+        // Lists that have nothing in them stay null, as they always were in the output. Components sharing a
+        // DisplayName are one member, in the place of the first and with the fields of the last, as the JSON tree
+        // this replaced had them.
+        auto components = [&](const char *key, const ulib::list<WindowsComponent> &list) {
+            emitter.Key(key);
+            if (list.size() == 0)
+                return emitter.Null();
+
+            std::unordered_map<std::string_view, const WindowsComponent *> last;
+            for (auto &comp : list)
+                last[std::string_view{comp.DisplayName.data(), comp.DisplayName.size()}] = &comp;
+
+            emitter.BeginObject();
+            for (auto &comp : list)
+            {
+                auto it = last.find(std::string_view{comp.DisplayName.data(), comp.DisplayName.size()});
+                if (it == last.end())
+                    continue;
+
+                emitter.Key(comp.DisplayName);
+                emitter.BeginObject();
+                emit_component_fields(emitter, *it->second);
+                emitter.EndObject();
+                last.erase(it);
+            }
+            emitter.EndObject();
+        };
+
+        if (withComponents)
+        {
+            components("wdk_uninstall_components", sdk.wdkUninstallComponents);
+            components("wdk_installer_components", sdk.wdkInstallerComponents);
+            components("sdk_uninstall_components", sdk.sdkUninstallComponents);
+            components("sdk_installer_components", sdk.sdkInstallerComponents);
+        }
+
+        emitter.Key("options");
+        if (sdk.options.size() == 0)
+        {
+            emitter.Null();
+        }
+        else
+        {
+            emitter.BeginObject();
+            for (auto &opt : sdk.options)
+                emitter.Field(opt.first, opt.second);
+            emitter.EndObject();
+        }
+    }
+
     class WindowsSDK
     {
     public:
-        WindowsSDK()
+        // Sees each SDK ("sdk") or WDK ("wdk") component the moment the registry scan hands it over, before the
+        // items are put together
+        using ComponentObserver =
+            std::function<void(ulib::string_view kind, ComponentSource source, const WindowsComponent &component)>;
+
+        // Nothing is probed here. Each getter reads only the section it needs, once, so the registry backend and
+        // the index have to outlive the model.
+        WindowsSDK(const RegistryBackend &registry = default_registry(), ComponentIndex *index = nullptr)
+            : mRegistry(&registry), mIndex(index)
         {
-            // for (size_t i = 0; i != 20; i++)
-            {
-                try
-                {
-                    mWindows10SdkInfoSource = "HKLM:SOFTWARE\\WOW6432Node\\Microsoft\\Microsoft SDKs\\Windows\\v10.0";
-                    mWindows10SdkInfo = detail::get_windows10_sdk_info();
-                    mWindowsSDKDirectory = mWindows10SdkInfo->directory;
-                    mWindowsSDKVersion = mWindows10SdkInfo->version;
-                    mWindowsSDKName = mWindows10SdkInfo->name;
-                }
-                catch (...)
-                {
-                }
+        }
 
-                try
-                {
-                    ReadInstalledRoots();
-                }
-                catch (...)
-                {
-                }
+        std::optional<detail::Windows10SdkInfo> GetWindows10SdkInfo() const
+        {
+            Probe(Section::Info);
+            return mWindows10SdkInfo;
+        }
 
-                try
-                {
-                    auto filter = [](WindowsComponent &component) {
-                        if (component.DisplayName.contains("Windows") && component.DisplayName.contains("SDK"))
-                        {
-                            try
-                            {
-                                auto ver = wversion::parse(component.DisplayVersion);
-                                return ver.mark == 1 && ver.build != 0 && ver.win > 6 && ver.win < 12;
-                            }
-                            catch (...)
-                            {
-                            }
-                        }
+        ulib::string GetWindows10SdkInfoSource() const
+        {
+            Probe(Section::Info);
+            return mWindows10SdkInfoSource;
+        }
 
-                        return false;
-                    };
+        // Items never move once created, references to them stay valid while the model lives
+        const std::deque<WindowsSDKItem> &GetSDKs() const
+        {
+            Probe(Section::Items);
+            return mSDKs;
+        }
 
-                    ulib::list<WindowsComponent> uninstall_components =
-                        list_uninstall_components().filter([](WindowsComponent &component) {
-                            return (component.DisplayName.contains("Windows") && component.DisplayName.contains("SDK"));
-                        });
+        std::optional<ulib::string> GetWDKProductVersion10() const
+        {
+            Probe(Section::WDK);
+            return mWDKProductVersion10;
+        }
 
-                    for (auto &package : uninstall_components.group_by(
-                             [](const WindowsComponent &component) { return component.DisplayVersion; }))
-                    {
-                        MakeSDKItem(wversion::to_windows_build(package.first)).sdkUninstallComponents = package.second;
-                    }
+        ulib::string GetWDKProductVersion10Source() const
+        {
+            Probe(Section::WDK);
+            return mWDKProductVersion10Source;
+        }
 
-                    ulib::list<WindowsComponent> installer_components =
-                        list_installer_components().filter([](WindowsComponent &component) {
-                            return (component.DisplayName.contains("Windows") && component.DisplayName.contains("SDK"));
-                        });
+        const ulib::list<ulib::string> &GetKMDFVersions() const
+        {
+            Probe(Section::KMDF);
+            return mKMDFVersions;
+        }
 
-                    for (auto &package : installer_components.group_by(
-                             [](const WindowsComponent &component) { return component.DisplayVersion; }))
-                    {
-                        MakeSDKItem(wversion::to_windows_build(package.first)).sdkInstallerComponents = package.second;
-                    }
-                }
-                catch (...)
-                {
-                }
+        ulib::string GetKMDFVersionsSource() const
+        {
+            Probe(Section::KMDF);
+            return mKMDFVersionsSource;
+        }
 
-                try
-                {
+        // Whether the items, and with them the components, are already there, probed or loaded from a snapshot
+        bool HasItems() const
+        {
+            return mProbed & uint8_t(Section::Items);
+        }
+
+        // Has to be set before the items are probed, a model loaded from a snapshot never calls it
+        void SetComponentObserver(ComponentObserver observer)
+        {
+            mComponentObserver = std::move(observer);
+        }
 
-                    ulib::list<WindowsComponent> uninstall_components =
-                        list_uninstall_components().filter([](WindowsComponent &component) {
-                            return component.DisplayName.contains("Windows Driver Kit") ||
-                                   component.DisplayName.contains("Windows Driver Framework");
-                        });
+        // Runs every probe that has not run yet
+        void ProbeAll() const
+        {
+            Probe(Section::Info);
+            Probe(Section::Items);
+            Probe(Section::KMDF);
+            Probe(Section::WDK);
+        }
 
-                    for (auto &package : uninstall_components.group_by(
-                             [](const WindowsComponent &component) { return component.DisplayVersion; }))
-                    {
-                        MakeSDKItem(wversion::to_windows_build(package.first)).wdkUninstallComponents = package.second;
-                    }
+        // Sections are probed as their members come up, members the emitter does not want are left out
+        void Emit(Emitter &emitter) const
+        {
+            emitter.BeginObject();
 
-                    ulib::list<WindowsComponent> installer_components =
-                        list_installer_components().filter([](WindowsComponent &component) {
-                            return component.DisplayName.contains("Windows Driver Kit") ||
-                                   component.DisplayName.contains("Windows Driver Framework");
-                        });
+            if (emitter.Wants("v10_source") || emitter.Wants("v10"))
+            {
+                Probe(Section::Info);
+                emitter.Field("v10_source", mWindows10SdkInfoSource);
+
+                emitter.Key("v10");
+                emitter.BeginObject();
+                emitter.Field("InstallationFolder", mWindowsSDKDirectory);
+                emitter.Field("ProductVersion", mWindowsSDKVersion);
+                emitter.Field("ProductName", mWindowsSDKName);
+                emitter.EndObject();
+            }
+
+            if (emitter.Wants("WdkProductVersion10") || emitter.Wants("WdkProductVersion10_source"))
+            {
+                Probe(Section::WDK);
+                emitter.Field("WdkProductVersion10", mWDKProductVersion10);
+                emitter.Field("WdkProductVersion10_source", mWDKProductVersion10Source);
+            }
+
+            if (emitter.Wants("SDKs"))
+            {
+                Probe(Section::Items);
 
-                    for (auto &package : installer_components.group_by(
-                             [](const WindowsComponent &component) { return component.DisplayVersion; }))
+                emitter.Key("SDKs");
+                if (mSDKs.empty())
+                {
+                    emitter.Null();
+                }
+                else
+                {
+                    emitter.BeginArray();
+                    for (auto &sdk : mSDKs)
                     {
-                        MakeSDKItem(wversion::to_windows_build(package.first)).wdkInstallerComponents = package.second;
+                        emitter.BeginObject();
+                        emit_sdk_item_fields(emitter, sdk, true);
+                        emitter.EndObject();
                     }
+                    emitter.EndArray();
                 }
-                catch (...)
+            }
+
+            if (emitter.Wants("kmdf_source") || emitter.Wants("kmdf"))
+            {
+                Probe(Section::KMDF);
+                emitter.Field("kmdf_source", mKMDFVersionsSource);
+
+                emitter.Key("kmdf");
+                if (mKMDFVersions.size() == 0)
                 {
+                    emitter.Null();
+                }
+                else
+                {
+                    emitter.BeginArray();
+                    for (auto &kmdf : mKMDFVersions)
+                        emitter.Value(kmdf);
+                    emitter.EndArray();
                 }
-
-                ReadKMDFDir();
-                ReadWDKProductVersion();
             }
+
+            emitter.EndObject();
         }
 
-        std::optional<detail::Windows10SdkInfo> GetWindows10SdkInfo()
+        ulib::json ToJson() const
         {
-            return mWindows10SdkInfo;
+            JsonDomEmitter emitter;
+            Emit(emitter);
+            return emitter.Take();
         }
 
-        ulib::string GetWindows10SdkInfoSource()
+        const WindowsSDKItem *FindSDKByWDKVersion(ulib::string_view wdkVersion) const
         {
-            return mWindows10SdkInfoSource;
+            // WDK components are filed under the build of their own version, so only that item can match
+            auto sdk = FindSDKItem(wdkVersion);
+            if (sdk && sdk->wdkUninstallComponents.size() > 0)
+            {
+                if (sdk->wdkUninstallComponents.front().DisplayVersion == wdkVersion)
+                    return sdk;
+            }
+
+            return nullptr;
         }
 
-        const ulib::list<WindowsSDKItem> &GetSDKs() const
+        const WindowsSDKItem *FindSDKItem(ulib::string_view windowsBuildVersion) const
         {
-            return mSDKs;
+            Probe(Section::Items);
+
+            auto it = mSDKIndex.find(SDKItemKey(windowsBuildVersion));
+            return it == mSDKIndex.end() ? nullptr : &mSDKs[it->second];
         }
 
-        std::optional<ulib::string> GetWDKProductVersion10()
+        // (build id, index in GetSDKs()) of every item whose name is a version, ascending by build id.
+        // Built on first use and again whenever items were added since.
+        const std::vector<std::pair<uint64_t, size_t>> &GetSDKsByBuild() const
         {
-            return mWDKProductVersion10;
+            Probe(Section::Items);
+
+            if (mSDKsByBuildCount != mSDKs.size())
+            {
+                mSDKsByBuild.clear();
+                for (auto &[key, index] : mSDKIndex)
+                {
+                    if ((key & 1) == 0)
+                        mSDKsByBuild.push_back({key, index});
+                }
+
+                std::sort(mSDKsByBuild.begin(), mSDKsByBuild.end(),
+                          [](auto &left, auto &right) { return left.first < right.first; });
+                mSDKsByBuildCount = mSDKs.size();
+            }
+
+            return mSDKsByBuild;
         }
 
-        ulib::string GetWDKProductVersion10Source()
+        static bool IsSDKComponent(ulib::string_view displayName)
         {
-            return mWDKProductVersion10Source;
+            return displayName.contains("Windows") && displayName.contains("SDK");
         }
 
-        const ulib::list<ulib::string> &GetKMDFVersions()
+        static bool IsWDKComponent(ulib::string_view displayName)
         {
-            return mKMDFVersions;
+            return displayName.contains("Windows Driver Kit") || displayName.contains("Windows Driver Framework");
         }
 
-        ulib::string GetKMDFVersionsSource()
+        // Same answer as FindSDKByWDKVersion(wdkVersion)->FindWdkUninstaller(), without building the SDK model:
+        // Uninstall entries are read one by one and the scan stops at the first match.
+        static std::optional<WindowsComponent> FindWdkUninstaller(ulib::string_view wdkVersion, StringArena &arena,
+                                                                  const RegistryBackend &registry = default_registry())
         {
-            return mKMDFVersionsSource;
+            for (auto &component : enumerate_uninstall_components(IsWDKComponent, arena, registry))
+            {
+                if (component.DisplayVersion == wdkVersion && !component.SystemComponent)
+                    return component;
+            }
+
+            return std::nullopt;
         }
 
-        ulib::json ToJson()
+    private:
+        friend class StateSnapshot;
+
+        // Empty model to be filled from a snapshot
+        struct Unprobed
         {
-            ulib::json val;
+        };
 
-            val["v10_source"] = mWindows10SdkInfoSource;
+        WindowsSDK(Unprobed) : mProbed(uint8_t(Section::All))
+        {
+        }
 
-            auto &v10 = val["v10"];
-            v10["InstallationFolder"] = mWindowsSDKDirectory;
-            v10["ProductVersion"] = mWindowsSDKVersion;
-            v10["ProductName"] = mWindowsSDKName;
+        // Independently probed parts of the model
+        enum class Section : uint8_t
+        {
+            Info = 1 << 0,  // v10.0 SDK key
+            Items = 1 << 1, // Installed Roots and the SDK/WDK components
+            KMDF = 1 << 2,  // KMDF include directories, needs Info
+            WDK = 1 << 3,   // WDKProductVersion10
+            All = Info | Items | KMDF | WDK,
+        };
 
-            val["WdkProductVersion10"] = mWDKProductVersion10;
-            val["WdkProductVersion10_source"] = mWDKProductVersion10Source;
+        void Probe(Section section) const
+        {
+            if (mProbed & uint8_t(section))
+                return;
 
-            auto &jSDKs = val["SDKs"];
+            // Marked up front, a failing probe leaves its section empty instead of retrying on every call
+            mProbed |= uint8_t(section);
 
-            for (auto &sdk : mSDKs)
+            switch (section)
             {
-                auto &jsdk = jSDKs.push_back();
-                jsdk["windows_version"] = sdk.windowsBuildVersion;
-                jsdk["has_wdk_in_options"] = sdk.hasWDKInOptions;
-                jsdk["in_InstalledRoots"] = sdk.inInstalledRoots;
-
-                auto &jwuc = jsdk["wdk_uninstall_components"];
-                for (auto &comp : sdk.wdkUninstallComponents)
-                {
-                    auto &jcomp = jwuc[comp.DisplayName];
-                    jcomp["DisplayVersion"] = comp.DisplayVersion;
-                    jcomp["SystemComponent"] = comp.SystemComponent;
-                    jcomp["UninstallString"] = comp.UninstallString;
-                }
-
-                auto &jwic = jsdk["wdk_installer_components"];
-                for (auto &comp : sdk.wdkInstallerComponents)
+            case Section::Info:
+                ReadWindows10SdkInfo();
+                break;
+            case Section::Items:
+                try
                 {
-                    auto &jcomp = jwic[comp.DisplayName];
-                    jcomp["DisplayVersion"] = comp.DisplayVersion;
-                    jcomp["SystemComponent"] = comp.SystemComponent;
-                    jcomp["UninstallString"] = comp.UninstallString;
+                    ReadInstalledRoots();
                 }
-
-                auto &jsuc = jsdk["sdk_uninstall_components"];
-                for (auto &comp : sdk.sdkUninstallComponents)
+                catch (...)
                 {
-                    auto &jcomp = jsuc[comp.DisplayName];
-                    jcomp["DisplayVersion"] = comp.DisplayVersion;
-                    jcomp["SystemComponent"] = comp.SystemComponent;
-                    jcomp["UninstallString"] = comp.UninstallString;
                 }
 
-                auto &jsic = jsdk["sdk_installer_components"];
-                for (auto &comp : sdk.sdkInstallerComponents)
+                try
                 {
-                    auto &jcomp = jsic[comp.DisplayName];
-                    jcomp["DisplayVersion"] = comp.DisplayVersion;
-                    jcomp["SystemComponent"] = comp.SystemComponent;
-                    jcomp["UninstallString"] = comp.UninstallString;
+                    ReadComponents();
                 }
-
-                auto &joptions = jsdk["options"];
-                for (auto &opt : sdk.options)
+                catch (...)
                 {
-                    joptions[opt.first] = opt.second;
                 }
+                break;
+            case Section::KMDF:
+                ReadKMDFDir();
+                break;
+            case Section::WDK:
+                ReadWDKProductVersion();
+                break;
+            default:
+                break;
             }
+        }
 
-            val["kmdf_source"] = mKMDFVersionsSource;
-
-            auto &jkmdf = val["kmdf"];
-            for (auto &kmdf : mKMDFVersions)
+        void ReadWindows10SdkInfo() const
+        {
+            try
             {
-                jkmdf.push_back() = kmdf;
+                mWindows10SdkInfoSource = "HKLM:SOFTWARE\\WOW6432Node\\Microsoft\\Microsoft SDKs\\Windows\\v10.0";
+                mWindows10SdkInfo = detail::get_windows10_sdk_info(*mRegistry);
+                mWindowsSDKDirectory = mWindows10SdkInfo->directory;
+                mWindowsSDKVersion = mWindows10SdkInfo->version;
+                mWindowsSDKName = mWindows10SdkInfo->name;
             }
+            catch (...)
+            {
+            }
+        }
 
-            return val;
+        void ReadComponents() const
+        {
+            auto &registry = *mRegistry;
+            auto index = mIndex;
+
+            ulib::list<WindowsComponent> sdkUninstall, sdkInstaller;
+            ulib::list<WindowsComponent> wdkUninstall, wdkInstaller;
+
+            auto collect = [this](ulib::string_view kind, ulib::list<WindowsComponent> &uninstall,
+                                  ulib::list<WindowsComponent> &installer) {
+                return [this, kind, &uninstall, &installer](ComponentSource source, const WindowsComponent &component) {
+                    (source == ComponentSource::Uninstall ? uninstall : installer).push_back(component);
+
+                    if (mComponentObserver)
+                        mComponentObserver(kind, source, component);
+                };
+            };
+
+            // Components only hold views, whoever owns the strings is kept alive with this object
+            auto arena = index ? index->GetArena() : std::make_shared<StringArena>();
+            mComponentStorage = arena;
+
+            scan_components(
+                {
+                    {"sdk", IsSDKComponent, collect("sdk", sdkUninstall, sdkInstaller)},
+                    {"wdk", IsWDKComponent, collect("wdk", wdkUninstall, wdkInstaller)},
+                },
+                *arena, registry, index);
+
+            AssignComponents(sdkUninstall, &WindowsSDKItem::sdkUninstallComponents);
+            AssignComponents(sdkInstaller, &WindowsSDKItem::sdkInstallerComponents);
+            AssignComponents(wdkUninstall, &WindowsSDKItem::wdkUninstallComponents);
+            AssignComponents(wdkInstaller, &WindowsSDKItem::wdkInstallerComponents);
         }
 
-        const WindowsSDKItem *FindSDKByWDKVersion(ulib::string_view wdkVersion) const
+        void AssignComponents(ulib::list<WindowsComponent> &components,
+                              ulib::list<WindowsComponent> WindowsSDKItem::*field) const
         {
-            for (auto &sdk : GetSDKs())
+            for (auto &package :
+                 components.group_by([](const WindowsComponent &component) { return component.DisplayVersion; }))
             {
-                if (sdk.wdkUninstallComponents.size() > 0)
-                {
-                    if (sdk.wdkUninstallComponents.front().DisplayVersion == wdkVersion)
-                        return &sdk;
-                }
+                // A version that does not parse cannot be filed under a build
+                if (auto wver = wversion::try_parse(package.first))
+                    MakeSDKItem(wversion::to_windows_build(*wver)).*field = package.second;
             }
-
-            return nullptr;
         }
 
-    private:
-        void ReadKMDFDir()
+        void ReadKMDFDir() const
         {
+            Probe(Section::Info);
+
             mKMDFVersionsSource = "mWindows10SdkInfo->directory / \"Include\\wdf\\kmdf\"";
 
             if (mWindows10SdkInfo)
@@ -399,20 +662,23 @@ namespace vcwin
             }
             else
             {
-                fmt::print("Error: Windows 10 SDK directory not found\n");
+                fmt::print(stderr, "Error: Windows 10 SDK directory not found\n");
             }
         }
 
-        void ReadInstalledRoots()
+        void ReadInstalledRoots() const
         {
+            auto &registry = *mRegistry;
+
             try
             {
-                winreg::RegKey winsdk_node;
-                winsdk_node.Create(HKEY_LOCAL_MACHINE,
-                                   L"SOFTWARE\\WOW6432Node\\Microsoft\\Windows Kits\\Installed Roots",
-                                   KEY_READ | KEY_WOW64_32KEY | KEY_ENUMERATE_SUB_KEYS);
+                std::wstring rootsPath = L"SOFTWARE\\WOW6432Node\\Microsoft\\Windows Kits\\Installed Roots";
 
-                auto subkeys = winsdk_node.EnumSubKeys();
+                auto winsdk_node = registry.OpenKey(RegistryRoot::LocalMachine, rootsPath, RegistryView::Wow64_32);
+                if (!winsdk_node)
+                    return;
+
+                auto subkeys = winsdk_node->EnumSubKeys();
                 for (auto &sk : subkeys)
                 {
                     auto &sdkItem = MakeSDKItem(ulib::str(ulib::u8(sk)));
@@ -420,22 +686,18 @@ namespace vcwin
 
                     try
                     {
-                        winreg::RegKey node;
-                        node.Create(HKEY_LOCAL_MACHINE,
-                                    ulib::format(L"SOFTWARE\\WOW6432Node\\Microsoft\\Windows Kits\\Installed "
-                                                 L"Roots\\{}\\Installed Options",
-                                                 ulib::wstr(sk)),
-                                    KEY_READ | KEY_WOW64_32KEY);
-
-                        for (auto &val : node.EnumValues())
+                        auto skNode = winsdk_node->OpenSubKey(sk);
+                        auto node = skNode ? skNode->OpenSubKey(L"Installed Options") : nullptr;
+                        if (!node)
+                            continue;
+
+                        for (auto &val : node->EnumValues())
                         {
                             if (val.first == L"OptionId.WindowsDriverKitComplete")
                                 sdkItem.hasWDKInOptions = true;
 
-                            sdkItem.options.push_back({ulib::u8(val.first), val.second});
+                            sdkItem.options.push_back({ulib::u8(val.first), val.second != RegistryValueType::None});
                         }
-
-                        node.Close();
                     }
                     catch (const std::exception &ex)
                     {
@@ -444,40 +706,50 @@ namespace vcwin
             }
             catch (const std::exception &ex)
             {
-                fmt::print("Installed Roots: Error: {}\n", ex.what());
+                fmt::print(stderr, "Installed Roots: Error: {}\n", ex.what());
             }
         }
 
-        WindowsSDKItem &MakeSDKItem(ulib::string_view windowsBuildVersion)
+        static uint64_t SDKItemKey(ulib::string_view windowsBuildVersion)
         {
-            for (auto &item : mSDKs)
-            {
-                if (item.windowsBuildVersion == windowsBuildVersion)
-                    return item;
-            }
+            std::string_view name{windowsBuildVersion.data(), windowsBuildVersion.size()};
+            if (auto key = wversion::parse_key(name))
+                return wversion::build_id(*key);
 
-            WindowsSDKItem item;
-            mSDKs.push_back(item);
+            // Names that are not versions still get an item. Build ids always have a zero low bit, these never do.
+            return (uint64_t(std::hash<std::string_view>{}(name)) << 1) | 1;
+        }
 
-            auto &rv = mSDKs.back();
+        WindowsSDKItem &MakeSDKItem(ulib::string_view windowsBuildVersion) const
+        {
+            auto [it, inserted] = mSDKIndex.try_emplace(SDKItemKey(windowsBuildVersion), mSDKs.size());
+            if (!inserted)
+                return mSDKs[it->second];
+
+            auto &rv = mSDKs.emplace_back();
             rv.windowsBuildVersion = windowsBuildVersion;
 
             return rv;
         }
 
-        void ReadWDKProductVersion()
+        void ReadWDKProductVersion() const
         {
+            auto &registry = *mRegistry;
+
             mWDKProductVersion10Source =
                 "HKLM:SOFTWARE\\WOW6432Node\\Microsoft\\Windows Kits\\WDK\\WDKProductVersion10";
 
             try
             {
-                winreg::RegKey winsdk_node;
-                winsdk_node.Create(HKEY_LOCAL_MACHINE, L"SOFTWARE\\WOW6432Node\\Microsoft\\Windows Kits\\WDK",
-                                   KEY_READ | KEY_WOW64_32KEY);
+                auto winsdk_node = registry.OpenKey(RegistryRoot::LocalMachine,
+                                                    L"SOFTWARE\\WOW6432Node\\Microsoft\\Windows Kits\\WDK",
+                                                    RegistryView::Wow64_32);
+
+                if (!winsdk_node)
+                    return;
 
-                ulib::string productVersion = ulib::u8(winsdk_node.GetStringValue(L"WDKProductVersion10"));
-                mWDKProductVersion10 = productVersion;
+                if (auto productVersion = winsdk_node->TryGetString(L"WDKProductVersion10"))
+                    mWDKProductVersion10 = ulib::u8(*productVersion);
             }
             catch (const std::exception &ex)
             {
@@ -485,20 +757,33 @@ namespace vcwin
             }
         }
 
-        std::optional<detail::Windows10SdkInfo> mWindows10SdkInfo;
-        ulib::string mWindows10SdkInfoSource;
+        const RegistryBackend *mRegistry = nullptr;
+        ComponentIndex *mIndex = nullptr;
+
+        // Everything below is filled on demand by Probe(), one bit of mProbed per Section
+        mutable uint8_t mProbed = 0;
+
+        mutable std::optional<detail::Windows10SdkInfo> mWindows10SdkInfo;
+        mutable ulib::string mWindows10SdkInfoSource;
+
+        mutable std::optional<fs::path> mWindowsSDKDirectory;
+        mutable std::optional<ulib::string> mWindowsSDKVersion;
+        mutable std::optional<ulib::string> mWindowsSDKName;
 
-        std::optional<fs::path> mWindowsSDKDirectory;
-        std::optional<ulib::string> mWindowsSDKVersion;
-        std::optional<ulib::string> mWindowsSDKName;
+        mutable std::deque<WindowsSDKItem> mSDKs;
+        mutable std::unordered_map<uint64_t, size_t> mSDKIndex;
+        mutable std::vector<std::pair<uint64_t, size_t>> mSDKsByBuild;
+        mutable size_t mSDKsByBuildCount = 0;
+        // Arena or snapshot mapping the component strings point into
+        mutable std::shared_ptr<const void> mComponentStorage;
 
-        ulib::list<WindowsSDKItem> mSDKs;
+        mutable std::optional<ulib::string> mWDKProductVersion10;
+        mutable ulib::string mWDKProductVersion10Source;
 
-        std::optional<ulib::string> mWDKProductVersion10;
-        ulib::string mWDKProductVersion10Source;
+        mutable ulib::list<ulib::string> mKMDFVersions;
+        mutable ulib::string mKMDFVersionsSource;
 
-        ulib::list<ulib::string> mKMDFVersions;
-        ulib::string mKMDFVersionsSource;
+        ComponentObserver mComponentObserver;
     };
 
 } // namespace vcwin
\ No newline at end of file